@@ -0,0 +1,119 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+# Measure the per-call overhead of logging in the extension's hot paths, with the
+# logger at :debug vs. :info, before and after disabled log levels were skipped in
+# C. The "before" numbers come from a build of the commit that change was made on
+# top of, which is checked out into a worktree under tmp/ and compiled the first
+# time this is run; pass a different revision to compare against that instead.
+# Both builds are measured against the same testing slapd, each in its own
+# process, and the time per call of each is printed side by side.
+#
+#   $ rake compile && ruby experiments/log_overhead.rb [BASELINE_REVISION]
+#
+# Run it after `rake compile -- --disable-debug-logging` to see what's left when
+# debug logging is compiled out.
+
+require 'pathname'
+require 'benchmark'
+require 'json'
+
+BASEDIR     = Pathname( __FILE__ ).dirname.parent.expand_path
+ITERATIONS  = Integer( ENV['ITERATIONS'] || 20_000 )
+URL         = 'ldap://ldap.acme.com/dc=acme,dc=com'
+LEVELS      = %i[ debug info ]
+
+# The commit that added the C-side level check, whose parent is the baseline
+LEVEL_CHECK_COMMIT = %w[
+	git log --reverse --format=%H -S ropenldap_do_log -- ext/openldap_ext/openldap.h
+]
+
+
+### Time each of the benchmarks with the extension in +libdir+ against the slapd at
+### +uri+, returning the seconds per call of each, keyed by benchmark and level.
+def measure( libdir, uri )
+	$LOAD_PATH.unshift( libdir )
+	require 'openldap'
+	require_relative '../spec/constants'
+
+	OpenLDAP.logger.output_to( File::NULL )
+	conn = OpenLDAP::Connection.new( uri )
+	conn.bind
+
+	benchmarks = {
+		'split_url' => lambda { OpenLDAP.split_url(URL) },
+		'search'    => lambda { conn.search(OpenLDAP::TestConstants::TEST_BASE, :base).fetch },
+	}
+
+	return benchmarks.each_with_object( {} ) do |(name, block), results|
+		LEVELS.each do |level|
+			OpenLDAP.logger.level = level
+			ITERATIONS.times( &block ) # warm-up
+			time = Benchmark.realtime { ITERATIONS.times(&block) }
+			results[ "#{name} (#{level})" ] = time / ITERATIONS
+		end
+	end
+end
+
+
+### Return the lib directory of a build of the baseline +revision+, checking it out
+### and compiling it if that hasn't been done already.
+def baseline_libdir( revision )
+	revision = IO.popen( ['git', '-C', BASEDIR.to_s, 'rev-parse', '--short', revision], &:read ).chomp
+	abort "No such revision" if revision.empty?
+	worktree = BASEDIR + 'tmp' + "log_overhead-#{revision}"
+
+	unless worktree.exist?
+		system( 'git', '-C', BASEDIR.to_s, 'worktree', 'add', '--detach', worktree.to_s, revision ) or
+			abort "Couldn't check out #{revision}"
+	end
+	unless ( worktree + 'lib' + "openldap_ext.#{RbConfig::CONFIG['DLEXT']}" ).exist?
+		Dir.chdir( worktree ) { system('rake', 'compile') } or
+			abort "Couldn't compile #{revision}"
+	end
+
+	return worktree + 'lib'
+end
+
+
+### Measure the extension in +libdir+ in a child process, and return its results.
+def measure_in_child( libdir, uri )
+	output = IO.popen( [RbConfig.ruby, __FILE__, '--measure', libdir.to_s, uri], &:read )
+	abort "Measuring #{libdir} failed" unless $?.success?
+	return JSON.parse( output )
+end
+
+
+if ARGV.first == '--measure'
+	puts JSON.generate( measure(ARGV[1], ARGV[2]) )
+	exit
+end
+
+revision = ARGV.first || begin
+	commit = IO.popen( LEVEL_CHECK_COMMIT, chdir: BASEDIR.to_s, &:read ).lines.first or
+		abort "Couldn't find the commit that added ropenldap_do_log(); pass a revision"
+	commit.chomp + '^'
+end
+
+$LOAD_PATH.unshift( BASEDIR + 'lib' )
+require 'openldap'
+require_relative '../spec/helpers'
+
+baseline = baseline_libdir( revision )
+pid = OpenLDAP::SpecHelpers.start_testing_slapd
+sleep 1
+
+begin
+	uri = OpenLDAP::TestConstants::TEST_LDAP_URI.to_s
+	before = measure_in_child( baseline, uri )
+	after = measure_in_child( BASEDIR + 'lib', uri )
+
+	puts "%d calls each, microseconds per call; before is %s" % [ ITERATIONS, revision ]
+	puts "%-18s %10s %10s %8s" % %w[ benchmark before after change ]
+	before.each do |name, secs|
+		change = ( after[name] - secs ) / secs * 100
+		puts "%-18s %10.2f %10.2f %+7.1f%%" % [ name, secs * 1_000_000, after[name] * 1_000_000, change ]
+	end
+ensure
+	OpenLDAP::SpecHelpers.stop_testing_slapd( pid )
+end
@@ -51,6 +51,24 @@ VALUE ropenldap_cOpenLDAPConnection;
 ID id_base;
 ID id_subtree;
 ID id_onelevel;
+static ID id_wait;
+static ID id_refresh_decode_schema;
+
+
+/* Estimates of what libldap allocates for a session that hasn't been unbound,
+ * which can't be measured from here: the LDAP handle with its options, the
+ * LDAPConn and Sockbuf for its connection, and the socket's read buffer and the
+ * BerElement a request is written into */
+#define ROPENLDAP_SESSION_HANDLE_SIZE  1024
+#define ROPENLDAP_SESSION_CONN_SIZE    512
+#define ROPENLDAP_SESSION_BUFFER_SIZE  ( 2 * 4096 )
+#define ROPENLDAP_SESSION_SIZE \
+	( ROPENLDAP_SESSION_HANDLE_SIZE + ROPENLDAP_SESSION_CONN_SIZE + ROPENLDAP_SESSION_BUFFER_SIZE )
+
+
+/* The number of libldap sessions that have been initialized and not yet
+ * unbound */
+static long ropenldap_live_sessions = 0;
 
 
 /* --------------------------------------------------
@@ -66,18 +84,53 @@ ropenldap_conn_alloc( LDAP *ldp )
 	struct ropenldap_connection *ptr = ALLOC( struct ropenldap_connection );
 
 	ptr->ldap = ldp;
+	ptr->schema = Qnil;
+	ptr->bind_dn = Qnil;
+	ptr->pending_bind_dn = Qnil;
+	ptr->bind_msgid = 0;
+	ptr->waiters = 0;
+	ropenldap_live_sessions++;
 
 	return ptr;
 }
 
 
+/*
+ * Unbind the connection's session if it's still open, forgetting the DN it was
+ * bound as. Returns the result of ldap_unbind_ext(), or LDAP_SUCCESS if it was
+ * already unbound.
+ */
+static int
+ropenldap_conn_unbind( struct ropenldap_connection *ptr )
+{
+	int res = LDAP_SUCCESS;
+
+	ptr->bind_dn = ptr->pending_bind_dn = Qnil;
+	ptr->bind_msgid = 0;
+
+	if ( ptr->ldap ) {
+		res = ldap_unbind_ext( ptr->ldap, NULL, NULL );
+		ptr->ldap = NULL;
+		ropenldap_live_sessions--;
+	}
+
+	return res;
+}
+
+
 /*
  * GC Mark function
  */
 static void
-ropenldap_conn_gc_mark( struct ropenldap_connection *ptr )
+ropenldap_conn_gc_mark( void *data )
 {
-	/* No-op */
+	struct ropenldap_connection *ptr = data;
+
+	if ( ptr ) {
+		rb_gc_mark( ptr->schema );
+		rb_gc_mark( ptr->bind_dn );
+		rb_gc_mark( ptr->pending_bind_dn );
+	}
 }
 
 
@@ -86,10 +139,12 @@ ropenldap_conn_gc_mark( struct ropenldap_connection *ptr )
  * GC Free function
  */
 static void
-ropenldap_conn_gc_free( struct ropenldap_connection *ptr )
+ropenldap_conn_gc_free( void *data )
 {
+	struct ropenldap_connection *ptr = data;
+
 	if ( ptr ) {
-		ptr->ldap = NULL;
+		ropenldap_conn_unbind( ptr );
 
 		xfree( ptr );
 		ptr = NULL;
@@ -97,20 +152,40 @@ ropenldap_conn_gc_free( struct ropenldap_connection *ptr )
 }
 
 
+/*
+ * GC Size function; counts an estimate of the session's memory until it's
+ * unbound.
+ */
+static size_t
+ropenldap_conn_gc_size( const void *data )
+{
+	const struct ropenldap_connection *ptr = data;
+	size_t size = sizeof( struct ropenldap_connection );
+
+	if ( ptr && ptr->ldap ) size += ROPENLDAP_SESSION_SIZE;
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_connection_type = {
+	"OpenLDAP::Connection",
+	{
+		ropenldap_conn_gc_mark,
+		ropenldap_conn_gc_free,
+		ropenldap_conn_gc_size,
+	},
+	0, 0, 0
+};
+
+
 /*
  * Object validity checker. Returns the data pointer.
  */
 static struct ropenldap_connection *
 check_conn( VALUE self )
 {
-	Check_Type( self, T_DATA );
-
-    if ( !IsConnection(self) ) {
-		rb_raise( rb_eTypeError, "wrong argument type %s (expected an OpenLDAP::Connection)",
-				  rb_obj_classname( self ) );
-    }
-
-	return DATA_PTR( self );
+	return rb_check_typeddata( self, &ropenldap_connection_type );
 }
 
 
@@ -123,6 +198,7 @@ ropenldap_get_conn( VALUE self )
 	struct ropenldap_connection *conn = check_conn( self );
 
 	if ( !conn ) rb_fatal( "Use of uninitialized OpenLDAP::Connection" );
+	if ( !conn->ldap ) rb_raise( ropenldap_eOpenLDAPError, "connection is unbound" );
 
 	return conn;
 }
@@ -134,11 +210,80 @@ ropenldap_get_conn( VALUE self )
 LDAP *
 ropenldap_conn_get_ldap( VALUE connection )
 {
-	struct ropenldap_connection *conn = check_conn( connection );
+	struct ropenldap_connection *conn = ropenldap_get_conn( connection );
 	return conn->ldap;
 }
 
 
+/*
+ * Note that a thread or fiber is about to wait for results on the
+ * OpenLDAP::Connection object +connection+, so it isn't unbound while the
+ * session is in use without the GVL.
+ */
+void
+ropenldap_conn_begin_wait( VALUE connection )
+{
+	struct ropenldap_connection *conn = ropenldap_get_conn( connection );
+	conn->waiters++;
+}
+
+
+/*
+ * Note that a wait started with ropenldap_conn_begin_wait() on the
+ * OpenLDAP::Connection object +connection+ has finished.
+ */
+void
+ropenldap_conn_end_wait( VALUE connection )
+{
+	struct ropenldap_connection *conn = check_conn( connection );
+	if ( conn && conn->waiters > 0 ) conn->waiters--;
+}
+
+
+/*
+ * Record the outcome of the bind +msgid+ on the OpenLDAP::Connection object
+ * +connection+: if it's the last bind sent and it +succeeded+, the connection is
+ * now bound as its DN, and otherwise as nobody.
+ */
+void
+ropenldap_conn_finish_bind( VALUE connection, int msgid, int succeeded )
+{
+	struct ropenldap_connection *conn = check_conn( connection );
+
+	if ( !conn || msgid != conn->bind_msgid ) return;
+
+	conn->bind_dn = succeeded ? conn->pending_bind_dn : Qnil;
+	conn->pending_bind_dn = Qnil;
+	conn->bind_msgid = 0;
+}
+
+
+/*
+ * Fetch the OpenLDAP::Schema the values of entries from the OpenLDAP::Connection
+ * object +connection+ are decoded with, or +nil+ if they aren't. If the schema
+ * has been superseded since it was set, the connection switches to the current
+ * one first.
+ */
+VALUE
+ropenldap_conn_get_schema( VALUE connection )
+{
+	struct ropenldap_connection *conn = check_conn( connection );
+	VALUE stale;
+
+	if ( !conn ) return Qnil;
+
+	if ( !NIL_P(conn->schema) && ropenldap_schema_is_stale(conn->schema) ) {
+		/* Values are left undecoded while the current schema is fetched, so the
+		   searches that fetch it don't end up back here */
+		stale = conn->schema;
+		conn->schema = Qnil;
+		rb_funcall( connection, id_refresh_decode_schema, 1, stale );
+	}
+
+	return conn->schema;
+}
+
+
 /* --------------------------------------------------------------
  * Class methods
  * -------------------------------------------------------------- */
@@ -153,7 +298,24 @@ ropenldap_conn_get_ldap( VALUE connection )
 static VALUE
 ropenldap_conn_s_allocate( VALUE klass )
 {
-	return Data_Wrap_Struct( klass, ropenldap_conn_gc_mark, ropenldap_conn_gc_free, 0 );
+	return TypedData_Wrap_Struct( klass, &ropenldap_connection_type, 0 );
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Connection.live_sessions   -> integer
+ *
+ * Return the number of libldap sessions in the current process that have been
+ * created and not yet unbound, either explicitly or by garbage collection.
+ *
+ *    OpenLDAP::Connection.live_sessions
+ *    # => 4
+ */
+static VALUE
+ropenldap_conn_s_live_sessions( VALUE klass )
+{
+	return LONG2NUM( ropenldap_live_sessions );
 }
 
 
@@ -419,53 +581,212 @@ ropenldap_conn_search_timeout_eq( VALUE self, VALUE arg )
 
 /*
  * call-seq:
- *    conn.bind( bind_dn, password )   -> result
- *    conn.bind( bind_dn, password ) {|result| ... }
+ *    conn.bind_dn   -> string or nil
+ *
+ * Return the DN the connection is bound as, or +nil+ if it hasn't been bound,
+ * was last bound anonymously, its last bind failed or hasn't finished yet, or
+ * it's been unbound.
+ */
+static VALUE
+ropenldap_conn_bind_dn( VALUE self )
+{
+	struct ropenldap_connection *ptr = check_conn( self );
+	return ptr ? ptr->bind_dn : Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    conn.decode_schema   -> schema or nil
+ *
+ * Return the OpenLDAP::Schema whose attribute syntaxes are used to decode the values
+ * of entries found by the connection, or +nil+ if values are returned as Strings.
+ */
+static VALUE
+ropenldap_conn_decode_schema( VALUE self )
+{
+	struct ropenldap_connection *ptr = ropenldap_get_conn( self );
+	return ptr->schema;
+}
+
+
+/*
+ * call-seq:
+ *    conn.decode_schema = schema or nil
  *
- * Bind to the directory using a simple +bind_dn+ and a +password+.
+ * Set the OpenLDAP::Schema whose attribute syntaxes are used to decode the values of
+ * entries found by the connection: Integer values are returned as Integers,
+ * Boolean ones as +true+ or +false+, and GeneralizedTime ones as Times. Setting it
+ * to +nil+ returns all values as Strings again.
  *
+ *    conn.decode_schema = conn.schema
  */
 static VALUE
-ropenldap_conn_bind( int argc, VALUE *argv, VALUE self )
+ropenldap_conn_decode_schema_eq( VALUE self, VALUE schema )
+{
+	struct ropenldap_connection *ptr = ropenldap_get_conn( self );
+
+	if ( !NIL_P(schema) && !IsSchema(schema) )
+		rb_raise( rb_eTypeError, "wrong argument type %s (expected OpenLDAP::Schema)",
+		          rb_obj_classname(schema) );
+
+	ptr->schema = schema;
+	return schema;
+}
+
+
+/*
+ * Return a new OpenLDAP::Result for the operation +msgid+ on the connection +self+.
+ */
+static VALUE
+ropenldap_conn_new_result( VALUE self, int msgid )
+{
+	VALUE result_args[2];
+
+	result_args[0] = self;
+	result_args[1] = INT2FIX( msgid );
+
+	return rb_class_new_instance( 2, result_args, ropenldap_cOpenLDAPResult );
+}
+
+
+/*
+ * Send a simple bind request for the +bind_dn+ and +password+ (either of which can
+ * be +nil+ for an anonymous bind) with the given +rb_serverctrls+ on the connection
+ * +self+ without waiting for the response, and return an OpenLDAP::Result for it.
+ */
+static VALUE
+ropenldap_conn_start_bind( VALUE self, VALUE bind_dn, VALUE password, VALUE rb_serverctrls )
 {
 	struct ropenldap_connection *ptr = ropenldap_get_conn( self );
-	VALUE bind_dn = Qnil, password = Qnil;
 	int res    = 0;
+	int msgid  = 0;
 	char *who  = NULL;
 	struct berval cred = BER_BVNULL;
-	struct berval *s_cred = NULL;
-
-	rb_scan_args( argc, argv, "02", &bind_dn, &password );
+	LDAPControl **serverctrls;
 
 	if ( bind_dn != Qnil ) {
 		who = StringValueCStr( bind_dn );
 	}
 
 	if ( password != Qnil ) {
-		VALUE pass_string = rb_obj_as_string( password );
-		cred.bv_val = ber_strdup( RSTRING_PTR(pass_string) );
-		cred.bv_len = RSTRING_LEN( pass_string );
+		password = rb_obj_as_string( password );
+		cred.bv_val = RSTRING_PTR( password );
+		cred.bv_len = RSTRING_LEN( password );
 	}
 
-	/* TODO:  async for block form, sync otherwise */
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
 
 	/* TODO: SASL interactive, ANONYMOUS (RFC2245?) */
-	// int ldap_sasl_bind(LDAP *ld, const char *dn, const char *mechanism,
-	//               struct berval *cred, LDAPControl *sctrls[],
-	//               LDAPControl *cctrls[], int *msgidp);
-	res = ldap_sasl_bind_s( ptr->ldap, who, LDAP_SASL_SIMPLE, &cred, NULL, NULL, &s_cred );
-	if ( !BER_BVISNULL(&cred) ) {
-		ber_memfree( cred.bv_val );
-		BER_BVZERO( &cred );
-	}
+	res = ldap_sasl_bind( ptr->ldap, who, LDAP_SASL_SIMPLE, &cred, serverctrls, NULL, &msgid );
+	RB_GC_GUARD( password );
+
+	ropenldap_log_obj( self, "debug", "Rval from ldap_sasl_bind: %d", res );
+	ropenldap_check_result( res, "ldap_sasl_bind" );
 
-	ropenldap_log_obj( self, "debug", "Rval from ldap_sasl_bind_s: %d", res );
-	ropenldap_check_result( res, "ldap_sasl_bind_s" );
+	/* The connection isn't bound as anyone until the bind succeeds */
+	ptr->bind_dn = Qnil;
+	ptr->pending_bind_dn = ( who && *who ) ? rb_str_new_frozen( bind_dn ) : Qnil;
+	ptr->bind_msgid = msgid;
+
+	return ropenldap_conn_new_result( self, msgid );
+}
+
+
+/*
+ * call-seq:
+ *    conn.bind( bind_dn=nil, password=nil, serverctrls=nil )                 -> true
+ *    conn.bind( bind_dn=nil, password=nil, serverctrls=nil ) {|result| ... }  -> true
+ *
+ * Bind to the directory using a simple +bind_dn+ and a +password+, raising an
+ * appropriate exception if the bind fails. Other threads continue to run while
+ * waiting for the server's response. If a block is given, it's called with the
+ * OpenLDAP::Result of the bind while the bind is in flight, so other work can
+ * overlap it; the bind is waited for after the block returns.
+ *
+ */
+static VALUE
+ropenldap_conn_bind( int argc, VALUE *argv, VALUE self )
+{
+	VALUE bind_dn = Qnil, password = Qnil, serverctrls = Qnil, result;
+
+	rb_scan_args( argc, argv, "03", &bind_dn, &password, &serverctrls );
+
+	result = ropenldap_conn_start_bind( self, bind_dn, password, serverctrls );
+	if ( rb_block_given_p() ) rb_yield( result );
+
+	rb_funcall( result, id_wait, 0 );
 
 	return Qtrue;
 }
 
 
+/*
+ * call-seq:
+ *    conn.bind_async( bind_dn=nil, password=nil, serverctrls=nil )   -> result
+ *
+ * Send a simple bind request for the +bind_dn+ and +password+ without waiting
+ * for the response. Returns an OpenLDAP::Result that can be waited on with
+ * Result#wait, which raises if the bind failed. Any response controls (e.g., for
+ * a password policy) are available from the result's #controls once it's finished.
+ *
+ *    result = conn.bind_async( dn, password )
+ *    ...
+ *    result.wait
+ *
+ */
+static VALUE
+ropenldap_conn_bind_async( int argc, VALUE *argv, VALUE self )
+{
+	VALUE bind_dn = Qnil, password = Qnil, serverctrls = Qnil;
+
+	rb_scan_args( argc, argv, "03", &bind_dn, &password, &serverctrls );
+
+	return ropenldap_conn_start_bind( self, bind_dn, password, serverctrls );
+}
+
+
+/*
+ * #_unbind: backend of the #unbind method.
+ */
+static VALUE
+ropenldap_conn__unbind( VALUE self )
+{
+	struct ropenldap_connection *ptr = check_conn( self );
+	int res;
+
+	/* Unbinding an unbound connection does nothing */
+	if ( !ptr || !ptr->ldap ) return Qtrue;
+
+	/* The session's handle would be freed out from under the waits */
+	if ( ptr->waiters )
+		rb_raise( ropenldap_eOpenLDAPError,
+		          "can't unbind while %d wait(s) for results are in progress", ptr->waiters );
+
+	ropenldap_log_obj( self, "debug", "Unbinding." );
+	res = ropenldap_conn_unbind( ptr );
+	ropenldap_check_result( res, "ldap_unbind_ext" );
+
+	return Qtrue;
+}
+
+
+/*
+ * call-seq:
+ *    conn.unbound?   -> true or false
+ *
+ * Returns +true+ if the connection has been unbound.
+ */
+static VALUE
+ropenldap_conn_unbound_p( VALUE self )
+{
+	struct ropenldap_connection *ptr = check_conn( self );
+
+	return ( !ptr || !ptr->ldap ) ? Qtrue : Qfalse;
+}
+
+
 /*
  * Start TLS synchronously; called from ropenldap_conn__start_tls after
  * the GVL is released.
@@ -1163,15 +1484,13 @@ ropenldap_get_scope( VALUE scope )
 
 
 /*
- * call-seq:
- *    conn.search( base, scope=:subtree, ... )   -> <return value>
- *
- * Execute a search given the args.
- *
- *    example code
+ * Start a search on the connection +self+ given the Ruby arguments in +argv+, adding
+ * the +extractrls+ (if non-NULL) to the search's server controls. Returns the
+ * OpenLDAP::Result for the search, which only keeps the arguments if there are no
+ * +extractrls+, since they aren't enough to re-issue the search.
  */
 static VALUE
-ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
+ropenldap_conn_start_search( int argc, VALUE *argv, VALUE self, LDAPControl **extractrls )
 {
 	struct ropenldap_connection *ptr = ropenldap_get_conn( self );
 	VALUE rb_base             = Qnil,
@@ -1190,11 +1509,11 @@ ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
 	int attrsonly             = 0;
 	LDAPControl **serverctrls = NULL,
 	            **clientctrls = NULL;
+	long extracount           = 0;
 	struct timeval *timeout   = NULL;
 	int sizelimit             = -1;
-	const VALUE utf8          = rb_enc_from_encoding(rb_utf8_encoding());
 	VALUE string_attrs        = Qnil;
-	VALUE result_args[2];
+	VALUE result_args[3];
 
 	// Result
 	int rval = -1;
@@ -1207,8 +1526,7 @@ ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
 
 	// Base
 	SafeStringValue( rb_base );
-	rb_base = rb_str_encode( rb_base, utf8, 0, Qnil );
-	rb_gc_register_address( &rb_base );
+	rb_base = ropenldap_str_utf8( rb_base );
 	base = StringValueCStr( rb_base );
 	ropenldap_log_obj( self, "debug", "  search base set to '%s'", base );
 
@@ -1219,36 +1537,62 @@ ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
 	// Filter
 	if ( !NIL_P(rb_filter) ) {
 		SafeStringValue( rb_filter );
-		rb_filter = rb_str_encode( rb_filter, utf8, 0, Qnil );
-		rb_gc_register_address( &rb_filter );
+		rb_filter = ropenldap_str_utf8( rb_filter );
 		filter = StringValueCStr( rb_filter );
 		ropenldap_log_obj( self, "debug", "  filter set to %s", filter );
 	}
 
 	// Attrs
 	if ( !NIL_P(rb_attrs) ) {
-		string_attrs = rb_ary_new();
-		rb_gc_register_address( &string_attrs );
 		int i = 0;
 		VALUE obj = Qnil;
 
 		if ( TYPE(rb_attrs) != T_ARRAY ) {
-			rb_ary_push( string_attrs, rb_obj_as_string(rb_attrs) );
+			string_attrs = rb_ary_new_capa( 1 );
+			rb_ary_push( string_attrs, ropenldap_str_utf8(rb_obj_as_string(rb_attrs)) );
 		} else {
+			string_attrs = rb_ary_new_capa( RARRAY_LEN(rb_attrs) );
 			for ( i = 0; i < RARRAY_LEN(rb_attrs); i++ ) {
 				obj = rb_ary_entry( rb_attrs, i );
-				rb_ary_push( string_attrs, rb_str_encode(rb_obj_as_string(obj), utf8, 0, Qnil) );
+				rb_ary_push( string_attrs, ropenldap_str_utf8(rb_obj_as_string(obj)) );
 			}
 		}
 
 		attrs = ALLOCA_N( char *, RARRAY_LEN(string_attrs) + 1 );
 		for ( i = 0; i < RARRAY_LEN(string_attrs); i++ ) {
-			attrs[i] = RSTRING_PTR( RARRAY_PTR(string_attrs)[i] );
+			attrs[i] = StringValueCStr( RARRAY_PTR(string_attrs)[i] );
 			ropenldap_log_obj( self, "debug", "  added attr %s", attrs[i] );
 		}
 		attrs[i] = NULL;
 	}
 
+	// Attrsonly
+	attrsonly = RTEST( rb_attrsonly ) ? 1 : 0;
+
+	// Timeout
+	if ( !NIL_P(rb_timeout) ) {
+		double seconds = NUM2DBL( rb_timeout );
+		timeout = ALLOCA_N( struct timeval, 1 );
+		timeout->tv_sec = (time_t)floor( seconds );
+		timeout->tv_usec = (suseconds_t)( fmod(seconds, 1.0) * MILLION_F );
+		ropenldap_log_obj( self, "debug", "  timeout set to %0.3fs", seconds );
+	}
+
+	// Size limit
+	if ( !NIL_P(rb_sizelimit) ) {
+		sizelimit = NUM2INT( rb_sizelimit );
+		ropenldap_log_obj( self, "debug", "  size limit set to %d", sizelimit );
+	}
+
+	// Controls
+	while ( extractrls && extractrls[extracount] ) extracount++;
+	extracount += ropenldap_control_count( rb_serverctrls );
+	serverctrls = ALLOCA_N( LDAPControl *, extracount + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, extractrls, serverctrls );
+
+	clientctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_clientctrls) + 1 );
+	clientctrls = ropenldap_fill_controls( rb_clientctrls, NULL, clientctrls );
+
 	// Do the search
 	ropenldap_log_obj( self, "debug", "  ldap_search_ext(%p, %s, %d, %s, %p, ...)",
 	                   ptr->ldap, base, scope, filter, attrs );
@@ -1256,10 +1600,10 @@ ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
 	                        serverctrls, clientctrls, timeout, sizelimit,
 	                        &msgid );
 
-	// Release all of the strings we were using
-	if ( !NIL_P(string_attrs) ) rb_gc_unregister_address( &string_attrs );
-	rb_gc_unregister_address( &rb_base );
-	rb_gc_unregister_address( &rb_filter );
+	// Keep the strings we were using alive until libldap is done with them
+	RB_GC_GUARD( rb_base );
+	RB_GC_GUARD( rb_filter );
+	RB_GC_GUARD( string_attrs );
 
 	// Check the results of the search and raise if there was a problem
 	ropenldap_check_result( rval, "ldap_search_ext( %s, %d, %s )", base, scope, filter );
@@ -1268,8 +1612,452 @@ ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
 
 	result_args[0] = self;
 	result_args[1] = INT2FIX( msgid );
+	result_args[2] = extractrls ? Qnil : rb_ary_new4( argc, argv );
 
-	return rb_class_new_instance( 2, result_args, ropenldap_cOpenLDAPResult );
+	return rb_class_new_instance( 3, result_args, ropenldap_cOpenLDAPResult );
+}
+
+
+/*
+ * call-seq:
+ *    conn.search( base, scope=:subtree, filter=nil, attrs=nil, attrsonly=false,
+ *                 serverctrls=nil, clientctrls=nil, timeout=nil, sizelimit=nil )   -> result
+ *
+ * Start a search of the directory under +base+ and return an OpenLDAP::Result
+ * for it. The +serverctrls+ and +clientctrls+ can be an OpenLDAP::Control or an
+ * Array of them; they're sent as-is, so the same controls can be re-used for any
+ * number of searches.
+ *
+ *    result = conn.search( 'dc=example,dc=com', :subtree, '(objectClass=person)' )
+ */
+static VALUE
+ropenldap_conn_search( int argc, VALUE *argv, VALUE self )
+{
+	return ropenldap_conn_start_search( argc, argv, self, NULL );
+}
+
+
+/* Arguments for starting a search with request controls under rb_ensure() */
+struct ropenldap_ctrl_search {
+	int         argc;
+	VALUE       *argv;
+	VALUE       self;
+	LDAPControl *ctrls[3];
+};
+
+
+/*
+ * Start the search described by the +arg+ struct.
+ */
+static VALUE
+ropenldap_conn_ctrl_search_body( VALUE arg )
+{
+	struct ropenldap_ctrl_search *search = (struct ropenldap_ctrl_search *)arg;
+	return ropenldap_conn_start_search( search->argc, search->argv, search->self, search->ctrls );
+}
+
+
+/*
+ * Free the request controls of the search described by the +arg+ struct.
+ */
+static VALUE
+ropenldap_conn_ctrl_search_ensure( VALUE arg )
+{
+	struct ropenldap_ctrl_search *search = (struct ropenldap_ctrl_search *)arg;
+	int i;
+
+	for ( i = 0; search->ctrls[i]; i++ ) {
+		ldap_control_free( search->ctrls[i] );
+		search->ctrls[i] = NULL;
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    conn._search_page( page_size, cookie, base, scope=:subtree, ... )   -> result
+ *
+ * Start a search for one page of +page_size+ entries using the paged results
+ * control (RFC 2696). The +cookie+ is the Result#paged_cookie of the previous page,
+ * or +nil+ for the first page. The rest of the arguments are the same as for
+ * #search.
+ */
+static VALUE
+ropenldap_conn__search_page( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	struct ropenldap_ctrl_search search = { 0, NULL, Qnil, { NULL, NULL, NULL } };
+	struct berval cookie = { 0, NULL };
+	int res;
+
+	rb_check_arity( argc, 3, UNLIMITED_ARGUMENTS );
+
+	if ( !NIL_P(argv[1]) ) {
+		StringValue( argv[1] );
+		cookie.bv_val = RSTRING_PTR( argv[1] );
+		cookie.bv_len = RSTRING_LEN( argv[1] );
+	}
+
+	search.argc = argc - 2;
+	search.argv = argv + 2;
+	search.self = self;
+
+	res = ldap_create_page_control( ldap, NUM2INT(argv[0]), cookie.bv_val ? &cookie : NULL, 0,
+	                                &search.ctrls[0] );
+	ropenldap_check_result( res, "ldap_create_page_control" );
+
+	return rb_ensure( ropenldap_conn_ctrl_search_body, (VALUE)&search,
+	                  ropenldap_conn_ctrl_search_ensure, (VALUE)&search );
+}
+
+
+/*
+ * Create a server-side sort control (RFC 2891) for the +keys+, a String of
+ * space-separated attribute names, each optionally prefixed with '-' for reverse
+ * order and suffixed with ':<matching rule>'.
+ */
+static LDAPControl *
+ropenldap_conn_make_sort_control( LDAP *ldap, VALUE keys, int critical )
+{
+	LDAPSortKey **keylist = NULL;
+	LDAPControl *ctrl = NULL;
+	int res;
+
+	res = ldap_create_sort_keylist( &keylist, StringValueCStr(keys) );
+	ropenldap_check_result( res, "ldap_create_sort_keylist( %s )", RSTRING_PTR(keys) );
+
+	res = ldap_create_sort_control( ldap, keylist, critical, &ctrl );
+	ldap_free_sort_keylist( keylist );
+	ropenldap_check_result( res, "ldap_create_sort_control" );
+
+	return ctrl;
+}
+
+
+/*
+ * Fill in the VLV +info+ from the +window+ Array of
+ * [ before_count, after_count, offset, content_count, assertion_value, context ],
+ * pointing the +value+ and +context+ bervals at the strings in it. If
+ * +assertion_value+ is non-nil, the target is the first entry whose sort key is
+ * greater than or equal to it; otherwise it's the entry at +offset+ (1-based) in a
+ * list of +content_count+ entries (0 if the count isn't known).
+ */
+static void
+ropenldap_conn_get_vlv_info( VALUE window, LDAPVLVInfo *info, struct berval *value,
+                             struct berval *context )
+{
+	VALUE rb_value, rb_context;
+
+	Check_Type( window, T_ARRAY );
+	if ( RARRAY_LEN(window) != 6 )
+		rb_raise( rb_eArgError, "expected a VLV window of 6 elements, got %ld",
+		          RARRAY_LEN(window) );
+
+	rb_value = RARRAY_AREF( window, 4 );
+	rb_context = RARRAY_AREF( window, 5 );
+
+	info->ldvlv_version      = 1;
+	info->ldvlv_before_count = NUM2INT( RARRAY_AREF(window, 0) );
+	info->ldvlv_after_count  = NUM2INT( RARRAY_AREF(window, 1) );
+	info->ldvlv_offset       = NUM2INT( RARRAY_AREF(window, 2) );
+	info->ldvlv_count        = NUM2INT( RARRAY_AREF(window, 3) );
+	info->ldvlv_attrvalue    = NULL;
+	info->ldvlv_context      = NULL;
+	info->ldvlv_extradata    = NULL;
+
+	if ( !NIL_P(rb_value) ) {
+		StringValue( rb_value );
+		value->bv_val = RSTRING_PTR( rb_value );
+		value->bv_len = RSTRING_LEN( rb_value );
+		info->ldvlv_attrvalue = value;
+	}
+
+	if ( !NIL_P(rb_context) ) {
+		StringValue( rb_context );
+		context->bv_val = RSTRING_PTR( rb_context );
+		context->bv_len = RSTRING_LEN( rb_context );
+		info->ldvlv_context = context;
+	}
+}
+
+
+/*
+ * call-seq:
+ *    conn._search_sorted( sort_keys, window, base, scope=:subtree, ... )   -> result
+ *
+ * Start a search whose results are sorted by the server according to the
+ * +sort_keys+ String (see #search_sorted). If +window+ isn't +nil+, it's an Array
+ * describing the Virtual List View window to return. The rest of the arguments
+ * are the same as for #search.
+ */
+static VALUE
+ropenldap_conn__search_sorted( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	struct ropenldap_ctrl_search search = { 0, NULL, Qnil, { NULL, NULL, NULL } };
+	LDAPVLVInfo info;
+	struct berval value = { 0, NULL }, context = { 0, NULL };
+	int res;
+
+	rb_check_arity( argc, 3, UNLIMITED_ARGUMENTS );
+	StringValue( argv[0] );
+
+	search.argc = argc - 2;
+	search.argv = argv + 2;
+	search.self = self;
+
+	if ( !NIL_P(argv[1]) ) ropenldap_conn_get_vlv_info( argv[1], &info, &value, &context );
+
+	/* The sort control has to be critical for the server to honour a VLV request */
+	search.ctrls[0] = ropenldap_conn_make_sort_control( ldap, argv[0], !NIL_P(argv[1]) );
+
+	if ( !NIL_P(argv[1]) ) {
+		res = ldap_create_vlv_control( ldap, &info, &search.ctrls[1] );
+		if ( res != LDAP_SUCCESS ) ldap_control_free( search.ctrls[0] );
+		ropenldap_check_result( res, "ldap_create_vlv_control" );
+	}
+
+	return rb_ensure( ropenldap_conn_ctrl_search_body, (VALUE)&search,
+	                  ropenldap_conn_ctrl_search_ensure, (VALUE)&search );
+}
+
+
+/*
+ * Build a NULL-terminated array of LDAPMods from +rb_mods+, an Array of
+ * [ op, attribute, [values] ] triples whose attributes and values are Strings. The
+ * array is allocated in a single block which must be freed with xfree(), and its
+ * values point into the Strings of +rb_mods+, so it's only valid while they are.
+ */
+static LDAPMod **
+ropenldap_conn_make_mods( VALUE rb_mods )
+{
+	long i, j, nmods, nvals = 0;
+	VALUE mod, attr, values, value;
+	LDAPMod **mods, *modbuf;
+	struct berval **bvptrs, *bvbuf;
+
+	Check_Type( rb_mods, T_ARRAY );
+	nmods = RARRAY_LEN( rb_mods );
+
+	/* Check everything before allocating so nothing leaks if it raises */
+	for ( i = 0; i < nmods; i++ ) {
+		mod = RARRAY_AREF( rb_mods, i );
+		Check_Type( mod, T_ARRAY );
+		if ( RARRAY_LEN(mod) != 3 )
+			rb_raise( rb_eArgError, "malformed modification at index %ld", i );
+
+		NUM2INT( RARRAY_AREF(mod, 0) );
+		attr = RARRAY_AREF( mod, 1 );
+		Check_Type( attr, T_STRING );
+		StringValueCStr( attr );
+
+		values = RARRAY_AREF( mod, 2 );
+		Check_Type( values, T_ARRAY );
+		for ( j = 0; j < RARRAY_LEN(values); j++ )
+			Check_Type( RARRAY_AREF(values, j), T_STRING );
+
+		nvals += RARRAY_LEN( values ) + 1;
+	}
+
+	mods = xmalloc( sizeof(LDAPMod *) * (nmods + 1) + sizeof(LDAPMod) * nmods +
+	                sizeof(struct berval *) * nvals + sizeof(struct berval) * nvals );
+	modbuf = (LDAPMod *)( mods + nmods + 1 );
+	bvptrs = (struct berval **)( modbuf + nmods );
+	bvbuf  = (struct berval *)( bvptrs + nvals );
+
+	for ( i = 0; i < nmods; i++ ) {
+		mod = RARRAY_AREF( rb_mods, i );
+		values = RARRAY_AREF( mod, 2 );
+
+		modbuf[i].mod_op      = NUM2INT( RARRAY_AREF(mod, 0) ) | LDAP_MOD_BVALUES;
+		modbuf[i].mod_type    = RSTRING_PTR( RARRAY_AREF(mod, 1) );
+		modbuf[i].mod_bvalues = bvptrs;
+
+		for ( j = 0; j < RARRAY_LEN(values); j++ ) {
+			value = RARRAY_AREF( values, j );
+			bvbuf->bv_val = RSTRING_PTR( value );
+			bvbuf->bv_len = RSTRING_LEN( value );
+			*bvptrs++ = bvbuf++;
+		}
+		*bvptrs++ = NULL;
+
+		mods[i] = &modbuf[i];
+	}
+	mods[nmods] = NULL;
+
+	return mods;
+}
+
+
+/*
+ * call-seq:
+ *    conn._add( dn, mods, serverctrls=nil )   -> result
+ *
+ * Send a request to add an entry with the given +dn+ and attributes, which are
+ * given as an Array of [ LDAP_MOD_ADD, attribute, [values] ] triples. Returns the
+ * OpenLDAP::Result of the operation without waiting for it to finish.
+ */
+static VALUE
+ropenldap_conn__add( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	VALUE dn, rb_mods, rb_serverctrls = Qnil;
+	LDAPControl **serverctrls;
+	LDAPMod **mods;
+	int res, msgid = 0;
+
+	rb_scan_args( argc, argv, "21", &dn, &rb_mods, &rb_serverctrls );
+	StringValueCStr( dn );
+
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
+
+	mods = ropenldap_conn_make_mods( rb_mods );
+	res = ldap_add_ext( ldap, RSTRING_PTR(dn), mods, serverctrls, NULL, &msgid );
+	xfree( mods );
+	RB_GC_GUARD( rb_mods );
+
+	ropenldap_check_result( res, "ldap_add_ext( %s )", RSTRING_PTR(dn) );
+
+	return ropenldap_conn_new_result( self, msgid );
+}
+
+
+/*
+ * call-seq:
+ *    conn._modify( dn, mods, serverctrls=nil )   -> result
+ *
+ * Send a request to modify the entry with the given +dn+, where the +mods+ are an
+ * Array of [ op, attribute, [values] ] triples, and +op+ is one of the
+ * LDAP_MOD_* constants. Returns the OpenLDAP::Result of the operation without
+ * waiting for it to finish.
+ */
+static VALUE
+ropenldap_conn__modify( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	VALUE dn, rb_mods, rb_serverctrls = Qnil;
+	LDAPControl **serverctrls;
+	LDAPMod **mods;
+	int res, msgid = 0;
+
+	rb_scan_args( argc, argv, "21", &dn, &rb_mods, &rb_serverctrls );
+	StringValueCStr( dn );
+
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
+
+	mods = ropenldap_conn_make_mods( rb_mods );
+	res = ldap_modify_ext( ldap, RSTRING_PTR(dn), mods, serverctrls, NULL, &msgid );
+	xfree( mods );
+	RB_GC_GUARD( rb_mods );
+
+	ropenldap_check_result( res, "ldap_modify_ext( %s )", RSTRING_PTR(dn) );
+
+	return ropenldap_conn_new_result( self, msgid );
+}
+
+
+/*
+ * call-seq:
+ *    conn._delete( dn, serverctrls=nil )   -> result
+ *
+ * Send a request to delete the entry with the given +dn+. Returns the
+ * OpenLDAP::Result of the operation without waiting for it to finish.
+ */
+static VALUE
+ropenldap_conn__delete( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	VALUE dn, rb_serverctrls = Qnil;
+	LDAPControl **serverctrls;
+	int res, msgid = 0;
+
+	rb_scan_args( argc, argv, "11", &dn, &rb_serverctrls );
+	StringValueCStr( dn );
+
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
+
+	res = ldap_delete_ext( ldap, RSTRING_PTR(dn), serverctrls, NULL, &msgid );
+	ropenldap_check_result( res, "ldap_delete_ext( %s )", RSTRING_PTR(dn) );
+
+	return ropenldap_conn_new_result( self, msgid );
+}
+
+
+/*
+ * call-seq:
+ *    conn._rename( dn, newrdn, newsuperior=nil, delete_old_rdn=true, serverctrls=nil )   -> result
+ *
+ * Send a request to rename the entry with the given +dn+ to +newrdn+, optionally
+ * moving it under +newsuperior+. Returns the OpenLDAP::Result of the operation
+ * without waiting for it to finish.
+ */
+static VALUE
+ropenldap_conn__rename( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	VALUE dn, newrdn, newsuperior = Qnil, delete_old_rdn = Qtrue, rb_serverctrls = Qnil;
+	LDAPControl **serverctrls;
+	int res, msgid = 0;
+
+	rb_scan_args( argc, argv, "23", &dn, &newrdn, &newsuperior, &delete_old_rdn,
+	              &rb_serverctrls );
+	StringValueCStr( dn );
+	StringValueCStr( newrdn );
+	if ( !NIL_P(newsuperior) ) StringValueCStr( newsuperior );
+
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
+
+	res = ldap_rename( ldap, RSTRING_PTR(dn), RSTRING_PTR(newrdn),
+	                   NIL_P(newsuperior) ? NULL : RSTRING_PTR(newsuperior),
+	                   RTEST(delete_old_rdn) ? 1 : 0, serverctrls, NULL, &msgid );
+	ropenldap_check_result( res, "ldap_rename( %s, %s )", RSTRING_PTR(dn), RSTRING_PTR(newrdn) );
+
+	return ropenldap_conn_new_result( self, msgid );
+}
+
+
+/*
+ * call-seq:
+ *    conn._compare( dn, attribute, value, serverctrls=nil )   -> result
+ *
+ * Send a request to compare the +value+ with the values of the +attribute+ of the
+ * entry with the given +dn+. Returns the OpenLDAP::Result of the operation without
+ * waiting for it to finish; see Result#compare_result.
+ */
+static VALUE
+ropenldap_conn__compare( int argc, VALUE *argv, VALUE self )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( self );
+	VALUE dn, attribute, value, rb_serverctrls = Qnil;
+	LDAPControl **serverctrls;
+	struct berval bvalue;
+	int res, msgid = 0;
+
+	rb_scan_args( argc, argv, "31", &dn, &attribute, &value, &rb_serverctrls );
+	StringValueCStr( dn );
+	StringValueCStr( attribute );
+	StringValue( value );
+
+	serverctrls = ALLOCA_N( LDAPControl *, ropenldap_control_count(rb_serverctrls) + 1 );
+	serverctrls = ropenldap_fill_controls( rb_serverctrls, NULL, serverctrls );
+
+	bvalue.bv_val = RSTRING_PTR( value );
+	bvalue.bv_len = RSTRING_LEN( value );
+
+	res = ldap_compare_ext( ldap, RSTRING_PTR(dn), RSTRING_PTR(attribute), &bvalue,
+	                        serverctrls, NULL, &msgid );
+	RB_GC_GUARD( value );
+
+	ropenldap_check_result( res, "ldap_compare_ext( %s, %s )", RSTRING_PTR(dn),
+	                        RSTRING_PTR(attribute) );
+
+	return ropenldap_conn_new_result( self, msgid );
 }
 
 
@@ -1288,12 +2076,16 @@ ropenldap_init_connection( void )
 	id_base     = rb_intern_const( "base" );
 	id_subtree  = rb_intern_const( "subtree" );
 	id_onelevel = rb_intern_const( "onelevel" );
+	id_wait     = rb_intern_const( "wait" );
+	id_refresh_decode_schema = rb_intern_const( "refresh_decode_schema" );
 
 	/* OpenLDAP::Connection */
 	ropenldap_cOpenLDAPConnection =
 		rb_define_class_under( ropenldap_mOpenLDAP, "Connection", rb_cObject );
 
 	rb_define_alloc_func( ropenldap_cOpenLDAPConnection, ropenldap_conn_s_allocate );
+	rb_define_singleton_method( ropenldap_cOpenLDAPConnection, "live_sessions",
+	                            ropenldap_conn_s_live_sessions, 0 );
 
 	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_initialize",
 	                            ropenldap_conn__initialize, 1 );
@@ -1302,9 +2094,26 @@ ropenldap_init_connection( void )
 	rb_define_method( ropenldap_cOpenLDAPConnection, "fdno", ropenldap_conn_fdno, 0 );
 	rb_define_alias(  ropenldap_cOpenLDAPConnection, "fileno", "fdno" );
 	rb_define_method( ropenldap_cOpenLDAPConnection, "bind", ropenldap_conn_bind, -1 );
+	rb_define_method( ropenldap_cOpenLDAPConnection, "bind_async", ropenldap_conn_bind_async, -1 );
+	rb_define_method( ropenldap_cOpenLDAPConnection, "bind_dn", ropenldap_conn_bind_dn, 0 );
+	rb_define_method( ropenldap_cOpenLDAPConnection, "unbound?", ropenldap_conn_unbound_p, 0 );
 
 	rb_define_method( ropenldap_cOpenLDAPConnection, "search", ropenldap_conn_search, -1 );
 	rb_define_alias ( ropenldap_cOpenLDAPConnection, "search_ext", "search" );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_search_page",
+	                            ropenldap_conn__search_page, -1 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_search_sorted",
+	                            ropenldap_conn__search_sorted, -1 );
+
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_add", ropenldap_conn__add, -1 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_modify",
+	                            ropenldap_conn__modify, -1 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_delete",
+	                            ropenldap_conn__delete, -1 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_rename",
+	                            ropenldap_conn__rename, -1 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_compare",
+	                            ropenldap_conn__compare, -1 );
 
 	/* Options */
 	rb_define_method( ropenldap_cOpenLDAPConnection, "protocol_version",
@@ -1325,6 +2134,10 @@ ropenldap_init_connection( void )
 	rb_define_method( ropenldap_cOpenLDAPConnection, "search_timeout=",
 	                  ropenldap_conn_search_timeout_eq, 1 );
 	rb_define_alias ( ropenldap_cOpenLDAPConnection, "timelimit", "search_timeout" );
+	rb_define_method( ropenldap_cOpenLDAPConnection, "decode_schema",
+	                  ropenldap_conn_decode_schema, 0 );
+	rb_define_method( ropenldap_cOpenLDAPConnection, "decode_schema=",
+	                  ropenldap_conn_decode_schema_eq, 1 );
 	// rb_define_method( ropenldap_cOpenLDAPConnection, "result_timeout",
 	//                   ropenldap_conn_result_timeout, 0 );
 	// rb_define_method( ropenldap_cOpenLDAPConnection, "result_timeout=",
@@ -1385,6 +2198,8 @@ ropenldap_init_connection( void )
 	/* Methods with Ruby front-ends */
 	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_start_tls",
 	                            ropenldap_conn__start_tls, 0 );
+	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_unbind",
+	                            ropenldap_conn__unbind, 0 );
 	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_tls_require_cert",
 	                            ropenldap_conn__tls_require_cert, 0 );
 	rb_define_protected_method( ropenldap_cOpenLDAPConnection, "_tls_require_cert=",
@@ -0,0 +1,472 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::Control class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ * - Mahlon E. Smith <mahlon@martini.nu>
+ *
+ * Copyright (c) 2013 Michael Granger and Mahlon E. Smith
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+#include "openldap.h"
+
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPControl;
+
+
+
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_control_gc_free( void *data )
+{
+	struct ropenldap_control *ptr = data;
+
+	if ( ptr ) {
+		xfree( ptr->ctrl.ldctl_oid );
+		xfree( ptr->ctrl.ldctl_value.bv_val );
+
+		ptr->ctrl.ldctl_oid = NULL;
+		ptr->ctrl.ldctl_value.bv_val = NULL;
+
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_control_gc_size( const void *data )
+{
+	const struct ropenldap_control *ptr = data;
+	size_t size = sizeof( struct ropenldap_control );
+
+	if ( ptr && ptr->ctrl.ldctl_oid ) {
+		size += strlen( ptr->ctrl.ldctl_oid ) + 1;
+		size += ptr->ctrl.ldctl_value.bv_len;
+	}
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_control_type = {
+	"OpenLDAP::Control",
+	{
+		NULL,
+		ropenldap_control_gc_free,
+		ropenldap_control_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_control *
+check_control( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_control_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_control *
+ropenldap_get_control( VALUE self )
+{
+	struct ropenldap_control *ptr = check_control( self );
+
+	if ( !ptr->ctrl.ldctl_oid ) rb_fatal( "Use of uninitialized OpenLDAP::Control" );
+
+	return ptr;
+}
+
+
+/*
+ * Copy the +oid+, +value+ and +critical+ flag into the control +ptr+.
+ */
+static void
+ropenldap_control_set( struct ropenldap_control *ptr, const char *oid, const char *value,
+                       ber_len_t len, int critical )
+{
+	size_t oidlen = strlen( oid );
+
+	ptr->ctrl.ldctl_oid = ALLOC_N( char, oidlen + 1 );
+	memcpy( ptr->ctrl.ldctl_oid, oid, oidlen + 1 );
+
+	if ( value ) {
+		ptr->ctrl.ldctl_value.bv_val = ALLOC_N( char, len ? len : 1 );
+		memcpy( ptr->ctrl.ldctl_value.bv_val, value, len );
+		ptr->ctrl.ldctl_value.bv_len = len;
+	} else {
+		ptr->ctrl.ldctl_value.bv_val = NULL;
+		ptr->ctrl.ldctl_value.bv_len = 0;
+	}
+
+	ptr->ctrl.ldctl_iscritical = critical ? 1 : 0;
+}
+
+
+/*
+ * Control constructor; copies the OID and value of the libldap +ctrl+ into a new
+ * OpenLDAP::Control.
+ */
+VALUE
+ropenldap_new_control( LDAPControl *ctrl )
+{
+	struct ropenldap_control *ptr;
+	VALUE control = TypedData_Make_Struct( ropenldap_cOpenLDAPControl, struct ropenldap_control,
+	                                       &ropenldap_control_type, ptr );
+
+	ropenldap_control_set( ptr, ctrl->ldctl_oid, ctrl->ldctl_value.bv_val,
+	                       ctrl->ldctl_value.bv_len, ctrl->ldctl_iscritical );
+
+	return control;
+}
+
+
+/*
+ * Return an Array of OpenLDAP::Controls copied from the NULL-terminated +ctrls+.
+ */
+VALUE
+ropenldap_rb_controls( LDAPControl **ctrls )
+{
+	VALUE rval = rb_ary_new();
+	int i;
+
+	if ( !ctrls ) return rval;
+
+	for ( i = 0; ctrls[i]; i++ )
+		rb_ary_push( rval, ropenldap_new_control(ctrls[i]) );
+
+	return rval;
+}
+
+
+/*
+ * Return the number of controls in +rb_ctrls+, which may be +nil+, a single
+ * OpenLDAP::Control, or an Array of them.
+ */
+long
+ropenldap_control_count( VALUE rb_ctrls )
+{
+	long i;
+
+	if ( NIL_P(rb_ctrls) ) return 0;
+	if ( rb_typeddata_is_kind_of(rb_ctrls, &ropenldap_control_type) ) return 1;
+
+	Check_Type( rb_ctrls, T_ARRAY );
+	for ( i = 0; i < RARRAY_LEN(rb_ctrls); i++ )
+		ropenldap_get_control( RARRAY_AREF(rb_ctrls, i) );
+
+	return RARRAY_LEN( rb_ctrls );
+}
+
+
+/*
+ * Fill +buf+ (which must have room for ropenldap_control_count() of +rb_ctrls+ plus
+ * the number of +extra+ controls plus one) with pointers to the already-encoded
+ * controls in +rb_ctrls+ followed by the NULL-terminated +extra+ controls. Returns
+ * +buf+, or NULL if there are no controls at all. The pointers are only valid for
+ * as long as the +rb_ctrls+ are.
+ */
+LDAPControl **
+ropenldap_fill_controls( VALUE rb_ctrls, LDAPControl **extra, LDAPControl **buf )
+{
+	long i, count = 0;
+
+	if ( NIL_P(rb_ctrls) ) {
+		/* no-op */
+	}
+	else if ( rb_typeddata_is_kind_of(rb_ctrls, &ropenldap_control_type) ) {
+		buf[ count++ ] = &ropenldap_get_control( rb_ctrls )->ctrl;
+	}
+	else {
+		for ( i = 0; i < RARRAY_LEN(rb_ctrls); i++ )
+			buf[ count++ ] = &ropenldap_get_control( RARRAY_AREF(rb_ctrls, i) )->ctrl;
+	}
+
+	for ( i = 0; extra && extra[i]; i++ )
+		buf[ count++ ] = extra[i];
+
+	buf[ count ] = NULL;
+
+	return count ? buf : NULL;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Class methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::Control.allocate   -> control
+ *
+ * Allocate a new OpenLDAP::Control object.
+ *
+ */
+static VALUE
+ropenldap_control_s_allocate( VALUE klass )
+{
+	struct ropenldap_control *ptr;
+	return TypedData_Make_Struct( klass, struct ropenldap_control, &ropenldap_control_type, ptr );
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::Control.new( oid, value=nil, critical=false )   -> control
+ *
+ * Create a new control with the given +oid+ and BER-encoded +value+. The control
+ * is stored in the form libldap uses, so it can be sent with any number of
+ * operations without being encoded again. If +critical+ is true, the server must
+ * refuse the operation if it doesn't support the control.
+ *
+ *    manage_dsa_it = OpenLDAP::Control.new( OpenLDAP::LDAP_CONTROL_MANAGEDSAIT, nil, true )
+ *    conn.search( base, :subtree, filter, nil, false, [manage_dsa_it] )
+ *
+ */
+static VALUE
+ropenldap_control_initialize( int argc, VALUE *argv, VALUE self )
+{
+	struct ropenldap_control *ptr = check_control( self );
+	VALUE oid, value = Qnil, critical = Qfalse;
+
+	rb_scan_args( argc, argv, "12", &oid, &value, &critical );
+
+	if ( ptr->ctrl.ldctl_oid )
+		rb_raise( ropenldap_eOpenLDAPError,
+		          "Cannot re-initialize a control once it's been created." );
+
+	StringValueCStr( oid );
+	if ( NIL_P(value) ) {
+		ropenldap_control_set( ptr, RSTRING_PTR(oid), NULL, 0, RTEST(critical) );
+	} else {
+		StringValue( value );
+		ropenldap_control_set( ptr, RSTRING_PTR(oid), RSTRING_PTR(value), RSTRING_LEN(value),
+		                       RTEST(critical) );
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    control.oid   -> string
+ *
+ * Return the control's object identifier.
+ *
+ */
+static VALUE
+ropenldap_control_oid( VALUE self )
+{
+	struct ropenldap_control *ptr = ropenldap_get_control( self );
+	return rb_usascii_str_new_cstr( ptr->ctrl.ldctl_oid );
+}
+
+
+/*
+ * call-seq:
+ *    control.value   -> string or nil
+ *
+ * Return the BER-encoded value of the control as a binary String, or +nil+ if it
+ * doesn't have one.
+ *
+ */
+static VALUE
+ropenldap_control_value( VALUE self )
+{
+	struct ropenldap_control *ptr = ropenldap_get_control( self );
+
+	if ( !ptr->ctrl.ldctl_value.bv_val ) return Qnil;
+
+	return rb_str_new( ptr->ctrl.ldctl_value.bv_val, ptr->ctrl.ldctl_value.bv_len );
+}
+
+
+/*
+ * call-seq:
+ *    control.critical?   -> true or false
+ *
+ * Returns +true+ if the server must refuse an operation it's sent with if it
+ * doesn't support the control.
+ *
+ */
+static VALUE
+ropenldap_control_critical_p( VALUE self )
+{
+	struct ropenldap_control *ptr = ropenldap_get_control( self );
+	return ptr->ctrl.ldctl_iscritical ? Qtrue : Qfalse;
+}
+
+
+/* The context-specific tags of the parts of a password policy response */
+#define ROPENLDAP_PPOLICY_WARNING 0xa0L
+#define ROPENLDAP_PPOLICY_ERROR   0x81L
+
+/*
+ * call-seq:
+ *    control._password_policy_error   -> integer or nil
+ *
+ * Decode the value of a password policy response control
+ * (draft-behera-ldap-password-policy) and return its error code, or +nil+ if it
+ * doesn't have one or can't be decoded.
+ *
+ */
+static VALUE
+ropenldap_control__password_policy_error( VALUE self )
+{
+	struct ropenldap_control *ptr = ropenldap_get_control( self );
+	BerElement *ber;
+	ber_tag_t tag;
+	ber_len_t len;
+	ber_int_t value, error = -1;
+	char *last;
+
+	if ( !ptr->ctrl.ldctl_value.bv_val ) return Qnil;
+	if ( !(ber = ber_init(&ptr->ctrl.ldctl_value)) ) rb_memerror();
+
+	if ( ber_peek_tag(ber, &len) == LBER_SEQUENCE ) {
+		for ( tag = ber_first_element( ber, &len, &last );
+		      tag != LBER_DEFAULT;
+		      tag = ber_next_element( ber, &len, last ) )
+		{
+			if ( tag == ROPENLDAP_PPOLICY_WARNING ) {
+				ber_skip_tag( ber, &len );
+				if ( ber_get_int(ber, &value) == LBER_DEFAULT ) break;
+			}
+			else if ( tag == ROPENLDAP_PPOLICY_ERROR ) {
+				if ( ber_get_enum(ber, &error) == LBER_DEFAULT ) error = -1;
+				break;
+			}
+			else {
+				break;
+			}
+		}
+	}
+
+	ber_free( ber, 1 );
+
+	return error < 0 ? Qnil : INT2FIX( error );
+}
+
+
+
+/*
+ * document-class: OpenLDAP::Control
+ */
+void
+ropenldap_init_control( void )
+{
+	ropenldap_log( "debug", "Initializing OpenLDAP::Control" );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::Control */
+	ropenldap_cOpenLDAPControl =
+		rb_define_class_under( ropenldap_mOpenLDAP, "Control", rb_cObject );
+
+	rb_define_alloc_func( ropenldap_cOpenLDAPControl, ropenldap_control_s_allocate );
+
+	rb_define_method( ropenldap_cOpenLDAPControl, "initialize", ropenldap_control_initialize, -1 );
+	rb_define_method( ropenldap_cOpenLDAPControl, "oid", ropenldap_control_oid, 0 );
+	rb_define_method( ropenldap_cOpenLDAPControl, "value", ropenldap_control_value, 0 );
+	rb_define_method( ropenldap_cOpenLDAPControl, "critical?", ropenldap_control_critical_p, 0 );
+	rb_define_protected_method( ropenldap_cOpenLDAPControl, "_password_policy_error",
+	                            ropenldap_control__password_policy_error, 0 );
+
+	/* Control OIDs */
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_MANAGEDSAIT",
+	                 rb_str_new2(LDAP_CONTROL_MANAGEDSAIT) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_PROXY_AUTHZ",
+	                 rb_str_new2(LDAP_CONTROL_PROXY_AUTHZ) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_ASSERT", rb_str_new2(LDAP_CONTROL_ASSERT) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_PRE_READ",
+	                 rb_str_new2(LDAP_CONTROL_PRE_READ) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_POST_READ",
+	                 rb_str_new2(LDAP_CONTROL_POST_READ) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_SUBENTRIES",
+	                 rb_str_new2(LDAP_CONTROL_SUBENTRIES) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_RELAX", rb_str_new2(LDAP_CONTROL_RELAX) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_PAGEDRESULTS",
+	                 rb_str_new2(LDAP_CONTROL_PAGEDRESULTS) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_SORTREQUEST",
+	                 rb_str_new2(LDAP_CONTROL_SORTREQUEST) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_SORTRESPONSE",
+	                 rb_str_new2(LDAP_CONTROL_SORTRESPONSE) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_VLVREQUEST",
+	                 rb_str_new2(LDAP_CONTROL_VLVREQUEST) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_VLVRESPONSE",
+	                 rb_str_new2(LDAP_CONTROL_VLVRESPONSE) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_PASSWORDPOLICYREQUEST",
+	                 rb_str_new2(LDAP_CONTROL_PASSWORDPOLICYREQUEST) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_CONTROL_PASSWORDPOLICYRESPONSE",
+	                 rb_str_new2(LDAP_CONTROL_PASSWORDPOLICYRESPONSE) );
+
+	rb_require( "openldap/control" );
+}
+
@@ -0,0 +1,963 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::DN class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ * - Mahlon E. Smith <mahlon@martini.nu>
+ *
+ * Copyright (c) 2013 Michael Granger and Mahlon E. Smith
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+
+#include "openldap.h"
+
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPDN;
+
+/* The DNs returned by OpenLDAP::DN.parse, keyed by the strings they were parsed
+ * from, least-recently used first */
+static VALUE ropenldap_dn_cache;
+static long ropenldap_dn_cache_size = 4096;
+
+/* The format DNs and RDNs are written in */
+#define ROPENLDAP_DN_FORMAT ( LDAP_DN_FORMAT_LDAPV3 | LDAP_DN_PRETTY )
+
+/* Attribute types (and the OIDs of the common ones) whose values match without
+ * regard to case, from RFC 4519 and the cosine and inetOrgPerson schemas. The
+ * values of these are folded to lowercase when a DN is normalized; the values of
+ * any other type are compared exactly, since folding them could make the DNs of
+ * distinct entries equal. */
+static const char * const ropenldap_dn_case_ignore_types[] = {
+	"associateddomain", "businesscategory", "c", "cn", "commonname", "countryname",
+	"dc", "departmentnumber", "description", "destinationindicator", "displayname",
+	"dnqualifier", "documentidentifier", "domaincomponent", "employeenumber",
+	"employeetype", "generationqualifier", "givenname", "host", "houseidentifier",
+	"initials", "l", "localityname", "mail", "name", "o", "organizationalunitname",
+	"organizationname", "ou", "physicaldeliveryofficename", "postalcode",
+	"postofficebox", "rfc822mailbox", "serialnumber", "sn", "st",
+	"stateorprovincename", "street", "streetaddress", "surname", "title", "uid",
+	"uniqueidentifier", "userid",
+	"0.9.2342.19200300.100.1.1", "0.9.2342.19200300.100.1.3",
+	"0.9.2342.19200300.100.1.25", "2.5.4.3", "2.5.4.4", "2.5.4.6", "2.5.4.7",
+	"2.5.4.8", "2.5.4.9", "2.5.4.10", "2.5.4.11", "2.5.4.12", "2.5.4.42",
+};
+
+/* OpenLDAP::DN struct */
+struct ropenldap_dn {
+	VALUE string;
+	VALUE normalized;
+	VALUE rdns;        /* the RDNs as given, as frozen Strings */
+	VALUE avas;        /* [type, value, ...] for each RDN, with lowercased types */
+	VALUE parent;      /* the parent DN, once it's been asked for */
+	long *offsets;     /* of each RDN in the normalized form */
+	long nrdns;
+	st_index_t hash;   /* of the normalized form */
+};
+
+
+
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
+
+/*
+ * GC Mark function
+ */
+static void
+ropenldap_dn_gc_mark( void *data )
+{
+	struct ropenldap_dn *ptr = data;
+
+	if ( ptr ) {
+		rb_gc_mark( ptr->string );
+		rb_gc_mark( ptr->normalized );
+		rb_gc_mark( ptr->rdns );
+		rb_gc_mark( ptr->avas );
+		rb_gc_mark( ptr->parent );
+	}
+}
+
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_dn_gc_free( void *data )
+{
+	struct ropenldap_dn *ptr = data;
+
+	if ( ptr ) {
+		xfree( ptr->offsets );
+		ptr->offsets = NULL;
+
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_dn_gc_size( const void *data )
+{
+	const struct ropenldap_dn *ptr = data;
+	size_t size = sizeof( struct ropenldap_dn );
+
+	if ( ptr ) size += ptr->nrdns * sizeof( long );
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_dn_type = {
+	"OpenLDAP::DN",
+	{
+		ropenldap_dn_gc_mark,
+		ropenldap_dn_gc_free,
+		ropenldap_dn_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_dn *
+check_dn( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_dn_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_dn *
+ropenldap_get_dn( VALUE self )
+{
+	struct ropenldap_dn *ptr = check_dn( self );
+
+	if ( NIL_P(ptr->string) ) rb_fatal( "Use of uninitialized OpenLDAP::DN" );
+
+	return ptr;
+}
+
+
+/*
+ * Parse the DN +string+, raising an OpenLDAP::InvalidDNSyntax if it isn't valid.
+ * The returned DN (which is NULL for the empty DN) has to be freed with
+ * ldap_dnfree(), and may point into +string+.
+ */
+static LDAPDN
+ropenldap_dn_explode( VALUE string )
+{
+	LDAPDN dn = NULL;
+
+	if ( ldap_str2dn(StringValueCStr(string), &dn, LDAP_DN_FORMAT_LDAP) != LDAP_SUCCESS )
+		ropenldap_check_result( LDAP_INVALID_DN_SYNTAX, "%s", RSTRING_PTR(string) );
+
+	return dn;
+}
+
+
+/*
+ * Fold the ASCII letters of the +len+ bytes at +ptr+ to lowercase.
+ */
+static void
+ropenldap_dn_downcase( char *ptr, ber_len_t len )
+{
+	ber_len_t i;
+
+	for ( i = 0; i < len; i++ )
+		if ( ptr[i] >= 'A' && ptr[i] <= 'Z' ) ptr[i] += 'a' - 'A';
+}
+
+
+/*
+ * Compare the bytes of two bervals, ordering shorter ones first if one is a
+ * prefix of the other.
+ */
+static int
+ropenldap_berval_cmp( const struct berval *a, const struct berval *b )
+{
+	ber_len_t len = a->bv_len < b->bv_len ? a->bv_len : b->bv_len;
+	int cmp = memcmp( a->bv_val, b->bv_val, len );
+
+	if ( cmp ) return cmp;
+	return a->bv_len < b->bv_len ? -1 : a->bv_len > b->bv_len;
+}
+
+
+/*
+ * Returns nonzero if values of the (lowercased) attribute +type+ match without
+ * regard to case.
+ */
+static int
+ropenldap_dn_ignores_case( const struct berval *type )
+{
+	size_t i;
+
+	for ( i = 0; i < sizeof(ropenldap_dn_case_ignore_types) / sizeof(char *); i++ )
+		if ( strlen(ropenldap_dn_case_ignore_types[i]) == type->bv_len &&
+		     memcmp(ropenldap_dn_case_ignore_types[i], type->bv_val, type->bv_len) == 0 )
+			return 1;
+
+	return 0;
+}
+
+
+/*
+ * Put the parsed +dn+ in its canonical form: attribute types folded to lowercase,
+ * the string values of types that match without regard to case folded too, and
+ * the AVAs of multi-valued RDNs sorted.
+ */
+static void
+ropenldap_dn_canonicalize( LDAPDN dn )
+{
+	LDAPRDN rdn;
+	LDAPAVA *ava;
+	int i, j, k, cmp;
+
+	if ( !dn ) return;
+
+	for ( i = 0; dn[i]; i++ ) {
+		rdn = dn[i];
+		for ( j = 0; rdn[j]; j++ ) {
+			ava = rdn[j];
+			ropenldap_dn_downcase( ava->la_attr.bv_val, ava->la_attr.bv_len );
+			if ( !(ava->la_flags & LDAP_AVA_BINARY) && ropenldap_dn_ignores_case(&ava->la_attr) )
+				ropenldap_dn_downcase( ava->la_value.bv_val, ava->la_value.bv_len );
+
+			for ( k = j; k > 0; k-- ) {
+				cmp = ropenldap_berval_cmp( &rdn[k - 1]->la_attr, &ava->la_attr );
+				if ( !cmp ) cmp = ropenldap_berval_cmp( &rdn[k - 1]->la_value, &ava->la_value );
+				if ( cmp <= 0 ) break;
+				rdn[k] = rdn[k - 1];
+			}
+			rdn[k] = ava;
+		}
+	}
+}
+
+
+/*
+ * Return an Array of the types and values of the AVAs of the parsed +rdn+, with
+ * the types folded to lowercase.
+ */
+static VALUE
+ropenldap_dn_rdn_avas( LDAPRDN rdn )
+{
+	VALUE avas = rb_ary_new(), type;
+	LDAPAVA *ava;
+	int i;
+
+	for ( i = 0; (ava = rdn[i]); i++ ) {
+		type = rb_str_new( ava->la_attr.bv_val, ava->la_attr.bv_len );
+		ropenldap_dn_downcase( RSTRING_PTR(type), RSTRING_LEN(type) );
+		rb_ary_push( avas, rb_obj_freeze(type) );
+		rb_ary_push( avas, rb_obj_freeze(ropenldap_attr_value(ava->la_value.bv_val,
+			ava->la_value.bv_len, (ava->la_flags & LDAP_AVA_BINARY) ? ROPENLDAP_ATTR_BINARY : 0)) );
+	}
+
+	return rb_obj_freeze( avas );
+}
+
+
+/*
+ * Parse +string+ and set the RDNs and AVAs of the DN +ptr+ from it, as well as its
+ * normalized form and the offsets of its RDNs in that. The rest of the DN's
+ * methods work from these, so a DN is only parsed once.
+ *
+ * This doesn't use ldap_dn_normalize(), which only re-writes the DN in another
+ * format: it doesn't fold the case of types or values or sort the parts of
+ * multi-valued RDNs, and it doesn't say where the RDNs start.
+ */
+static void
+ropenldap_dn_load( struct ropenldap_dn *ptr, VALUE string )
+{
+	/* Canonicalizing changes the parsed values in place, and they can point into
+	 * the string they were parsed from, so parse a copy */
+	VALUE copy = rb_str_new( RSTRING_PTR(string), RSTRING_LEN(string) );
+	VALUE normalized = rb_enc_str_new( NULL, 0, rb_utf8_encoding() );
+	VALUE rdns, avas;
+	LDAPDN dn = ropenldap_dn_explode( copy );
+	struct berval bv;
+	char *str = NULL;
+	const char *func = "ldap_rdn2str";
+	long count = 0, i;
+	int rc = LDAP_SUCCESS;
+
+	if ( dn ) while ( dn[count] ) count++;
+	rdns = rb_ary_new_capa( count );
+	avas = rb_ary_new_capa( count );
+
+	/* The RDNs as they were given, before they're canonicalized */
+	for ( i = 0; i < count; i++ ) {
+		if ( (rc = ldap_rdn2str(dn[i], &str, ROPENLDAP_DN_FORMAT)) != LDAP_SUCCESS ) break;
+		rb_ary_push( rdns, rb_obj_freeze(rb_enc_str_new_cstr(str, rb_utf8_encoding())) );
+		ldap_memfree( str );
+		rb_ary_push( avas, ropenldap_dn_rdn_avas(dn[i]) );
+	}
+
+	xfree( ptr->offsets );
+	ptr->offsets = ALLOC_N( long, count ? count : 1 );
+
+	if ( rc == LDAP_SUCCESS ) {
+		ropenldap_dn_canonicalize( dn );
+		func = "ldap_rdn2bv";
+
+		for ( i = 0; i < count; i++ ) {
+			if ( i ) rb_str_cat( normalized, ",", 1 );
+			ptr->offsets[ i ] = RSTRING_LEN( normalized );
+
+			if ( (rc = ldap_rdn2bv(dn[i], &bv, ROPENLDAP_DN_FORMAT)) != LDAP_SUCCESS ) break;
+			rb_str_cat( normalized, bv.bv_val, bv.bv_len );
+			ldap_memfree( bv.bv_val );
+		}
+	}
+
+	ldap_dnfree( dn );
+	RB_GC_GUARD( copy );
+	ropenldap_check_result( rc, "%s", func );
+
+	ptr->normalized = rb_obj_freeze( normalized );
+	ptr->rdns       = rb_obj_freeze( rdns );
+	ptr->avas       = rb_obj_freeze( avas );
+	ptr->nrdns      = count;
+	ptr->hash       = rb_str_hash( normalized );
+}
+
+
+/*
+ * Return a new DN for the parent of the DN +ptr+, written as +string+, made from
+ * the RDNs that were already parsed instead of parsing them again.
+ */
+static VALUE
+ropenldap_dn_make_parent( struct ropenldap_dn *ptr, VALUE string )
+{
+	VALUE self = rb_obj_alloc( ropenldap_cOpenLDAPDN );
+	struct ropenldap_dn *parent = check_dn( self );
+	long count = ptr->nrdns - 1, skip = count ? ptr->offsets[1] : RSTRING_LEN( ptr->normalized );
+	long i;
+
+	parent->offsets = ALLOC_N( long, count ? count : 1 );
+	for ( i = 0; i < count; i++ )
+		parent->offsets[ i ] = ptr->offsets[ i + 1 ] - skip;
+
+	parent->normalized = rb_obj_freeze( rb_enc_str_new(RSTRING_PTR(ptr->normalized) + skip,
+		RSTRING_LEN(ptr->normalized) - skip, rb_utf8_encoding()) );
+	parent->rdns       = rb_obj_freeze( rb_ary_subseq(ptr->rdns, 1, count) );
+	parent->avas       = rb_obj_freeze( rb_ary_subseq(ptr->avas, 1, count) );
+	parent->nrdns      = count;
+	parent->hash       = rb_str_hash( parent->normalized );
+	parent->string     = string;
+
+	return rb_obj_freeze( self );
+}
+
+
+/*
+ * Returns true if the DN +ptr+ is below +other+ in the tree: +depth+ levels
+ * below it, or any number if +depth+ is 0.
+ */
+static int
+ropenldap_dn_is_below( struct ropenldap_dn *ptr, struct ropenldap_dn *other, long depth )
+{
+	long levels = ptr->nrdns - other->nrdns, offset;
+
+	if ( levels <= 0 || (depth && levels != depth) ) return 0;
+	if ( other->nrdns == 0 ) return 1;
+
+	/* The normalized form of an ancestor is the tail of the normalized form from
+	 * one of its RDNs on */
+	offset = ptr->offsets[ levels ];
+	return RSTRING_LEN( ptr->normalized ) - offset == RSTRING_LEN( other->normalized ) &&
+		memcmp( RSTRING_PTR(ptr->normalized) + offset, RSTRING_PTR(other->normalized),
+		        RSTRING_LEN(other->normalized) ) == 0;
+}
+
+
+/*
+ * Callback for finding the first key of the DN cache.
+ */
+static int
+ropenldap_dn_cache_oldest( VALUE key, VALUE UNUSED(value), VALUE oldest )
+{
+	*(VALUE *)oldest = key;
+	return ST_STOP;
+}
+
+
+/*
+ * Drop the least-recently used DNs from the cache until there are no more than
+ * +size+ of them.
+ */
+static void
+ropenldap_dn_cache_trim( long size )
+{
+	VALUE oldest;
+
+	while ( RHASH_SIZE(ropenldap_dn_cache) > (size_t)size ) {
+		oldest = Qnil;
+		rb_hash_foreach( ropenldap_dn_cache, ropenldap_dn_cache_oldest, (VALUE)&oldest );
+		rb_hash_delete( ropenldap_dn_cache, oldest );
+	}
+}
+
+
+
+/*
+ * Return the DN for the UTF-8 +string+ from the cache, or make it and add it to the
+ * cache if it isn't there: by parsing +string+, or if +child+ isn't NULL, from the
+ * RDNs of the DN +child+ it's the parent of.
+ */
+static VALUE
+ropenldap_dn_cached( VALUE string, struct ropenldap_dn *child )
+{
+	VALUE dn = Qnil;
+
+	/* Take the DN out of the cache and add it again, so the cache stays in order
+	 * of use */
+	if ( ropenldap_dn_cache_size ) dn = rb_hash_delete( ropenldap_dn_cache, string );
+
+	if ( NIL_P(dn) ) {
+		if ( child ) {
+			dn = ropenldap_dn_make_parent( child, rb_str_new_frozen(string) );
+		} else {
+			dn = rb_class_new_instance( 1, &string, ropenldap_cOpenLDAPDN );
+		}
+		if ( ropenldap_dn_cache_size == 0 ) return dn;
+		ropenldap_dn_cache_trim( ropenldap_dn_cache_size - 1 );
+	}
+	rb_hash_aset( ropenldap_dn_cache, ropenldap_get_dn(dn)->string, dn );
+
+	return dn;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Class methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.allocate   -> dn
+ *
+ * Allocate a new OpenLDAP::DN object.
+ *
+ */
+static VALUE
+ropenldap_dn_s_allocate( VALUE klass )
+{
+	struct ropenldap_dn *ptr;
+	VALUE self = TypedData_Make_Struct( klass, struct ropenldap_dn, &ropenldap_dn_type, ptr );
+
+	ptr->string     = Qnil;
+	ptr->normalized = Qnil;
+	ptr->rdns       = Qnil;
+	ptr->avas       = Qnil;
+	ptr->parent     = Qnil;
+	ptr->offsets    = NULL;
+	ptr->nrdns      = 0;
+	ptr->hash       = 0;
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.parse( string )   -> dn
+ *
+ * Return the DN for +string+, from the cache of recently-parsed DNs if it's
+ * there. DNs are immutable, so the same DN is returned each time a string is
+ * parsed until it drops out of the cache. If +string+ is already a DN, it's
+ * returned as it is.
+ *
+ *    members = group['member'].map {|dn| OpenLDAP::DN.parse(dn) }.to_set
+ *    members.include?( OpenLDAP::DN.parse(user_dn) )
+ */
+static VALUE
+ropenldap_dn_s_parse( VALUE UNUSED(klass), VALUE string )
+{
+	if ( rb_obj_is_kind_of(string, ropenldap_cOpenLDAPDN) ) return string;
+	return ropenldap_dn_cached( ropenldap_str_utf8(string), NULL );
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.normalize( string )   -> string
+ *
+ * Return the normalized form of the DN +string+ (see #normalized), using the cache
+ * of recently-parsed DNs.
+ *
+ *    OpenLDAP::DN.normalize( 'UID=JDoe, OU=People,DC=Example,DC=com' )
+ *    # => "uid=jdoe,ou=people,dc=example,dc=com"
+ */
+static VALUE
+ropenldap_dn_s_normalize( VALUE klass, VALUE string )
+{
+	return ropenldap_get_dn( ropenldap_dn_s_parse(klass, string) )->normalized;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.cache_size   -> integer
+ *
+ * Return the maximum number of DNs kept in the cache used by ::parse.
+ *
+ */
+static VALUE
+ropenldap_dn_s_cache_size( VALUE UNUSED(klass) )
+{
+	return LONG2NUM( ropenldap_dn_cache_size );
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.cache_size = integer
+ *
+ * Set the maximum number of DNs kept in the cache used by ::parse, dropping the
+ * least-recently used ones if there are more than that already. Setting it to 0
+ * turns the cache off.
+ *
+ */
+static VALUE
+ropenldap_dn_s_cache_size_eq( VALUE UNUSED(klass), VALUE size )
+{
+	long max = NUM2LONG( size );
+
+	if ( max < 0 ) rb_raise( rb_eArgError, "cache size can't be negative" );
+
+	ropenldap_dn_cache_size = max;
+	ropenldap_dn_cache_trim( max );
+
+	return size;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.clear_cache
+ *
+ * Drop all of the DNs from the cache used by ::parse.
+ *
+ */
+static VALUE
+ropenldap_dn_s_clear_cache( VALUE UNUSED(klass) )
+{
+	rb_hash_clear( ropenldap_dn_cache );
+	return Qnil;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::DN.new( string )   -> dn
+ *
+ * Parse the DN +string+ (RFC 4514), raising an OpenLDAP::InvalidDNSyntax if it
+ * isn't valid. Use ::parse instead to reuse DNs that were parsed recently.
+ *
+ */
+static VALUE
+ropenldap_dn_initialize( VALUE self, VALUE string )
+{
+	struct ropenldap_dn *ptr = check_dn( self );
+
+	if ( !NIL_P(ptr->string) )
+		rb_raise( ropenldap_eOpenLDAPError, "Cannot re-initialize a DN object." );
+
+	string = rb_str_new_frozen( ropenldap_str_utf8(string) );
+	ropenldap_dn_load( ptr, string );
+	ptr->string = string;
+
+	return rb_obj_freeze( self );
+}
+
+
+/*
+ * call-seq:
+ *    dn.to_s   -> string
+ *
+ * Return the DN as it was given.
+ *
+ */
+static VALUE
+ropenldap_dn_to_s( VALUE self )
+{
+	return ropenldap_get_dn( self )->string;
+}
+
+
+/*
+ * call-seq:
+ *    dn.normalized   -> string
+ *
+ * Return the normalized form of the DN: written as in RFC 4514, with attribute
+ * types folded to lowercase, the (ASCII) letters in the values of types that match
+ * without regard to case (+cn+, +ou+, +dc+, +uid+, and the other common naming
+ * attributes of RFC 4519 and the cosine and inetOrgPerson schemas) folded too, and
+ * the parts of multi-valued RDNs sorted. The values of other types are left as
+ * they are. Two DNs are equal if their normalized forms are.
+ *
+ */
+static VALUE
+ropenldap_dn_normalized( VALUE self )
+{
+	return ropenldap_get_dn( self )->normalized;
+}
+
+
+/*
+ * call-seq:
+ *    dn.size   -> integer
+ *
+ * Return the number of RDNs in the DN.
+ *
+ */
+static VALUE
+ropenldap_dn_size( VALUE self )
+{
+	return LONG2NUM( ropenldap_get_dn(self)->nrdns );
+}
+
+
+/*
+ * call-seq:
+ *    dn.rdns   -> array
+ *
+ * Return the RDNs of the DN as Strings, starting with the leftmost one.
+ *
+ *    OpenLDAP::DN.new( 'uid=jdoe, ou=People,dc=example,dc=com' ).rdns
+ *    # => ["uid=jdoe", "ou=People", "dc=example", "dc=com"]
+ */
+static VALUE
+ropenldap_dn_rdns( VALUE self )
+{
+	return rb_ary_dup( ropenldap_get_dn(self)->rdns );
+}
+
+
+/*
+ * call-seq:
+ *    dn.rdn   -> string or nil
+ *
+ * Return the leftmost RDN of the DN, or +nil+ if it's the empty DN.
+ *
+ */
+static VALUE
+ropenldap_dn_rdn( VALUE self )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+
+	return rb_ary_entry( ptr->rdns, 0 );
+}
+
+
+/*
+ * call-seq:
+ *    dn[ attribute ]   -> string or nil
+ *
+ * Return the value of the first (leftmost) RDN component of the DN with the
+ * given +attribute+ type, or +nil+ if there isn't one.
+ *
+ *    OpenLDAP::DN.new( 'uid=jdoe,ou=People,dc=example,dc=com' )[ :ou ]
+ *    # => "People"
+ */
+static VALUE
+ropenldap_dn_aref( VALUE self, VALUE attribute )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE avas, type;
+	long i, j;
+
+	if ( SYMBOL_P(attribute) ) attribute = rb_sym2str( attribute );
+	StringValue( attribute );
+
+	for ( i = 0; i < ptr->nrdns; i++ ) {
+		avas = RARRAY_AREF( ptr->avas, i );
+		for ( j = 0; j < RARRAY_LEN(avas); j += 2 ) {
+			type = RARRAY_AREF( avas, j );
+			if ( RSTRING_LEN(type) == RSTRING_LEN(attribute) &&
+			     strncasecmp(RSTRING_PTR(type), RSTRING_PTR(attribute), RSTRING_LEN(type)) == 0 )
+				return RARRAY_AREF( avas, j + 1 );
+		}
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    dn.parent   -> dn or nil
+ *
+ * Return the DN of the entry above this one in the tree (the empty DN for a DN
+ * with one RDN), or +nil+ if this is the empty DN.
+ *
+ */
+static VALUE
+ropenldap_dn_parent( VALUE self )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE string;
+
+	if ( ptr->nrdns == 0 ) return Qnil;
+
+	/* Made from the RDNs that were already parsed, and kept, so walking up the
+	 * tree (e.g. by #ancestors) doesn't parse anything again */
+	if ( NIL_P(ptr->parent) ) {
+		string = rb_ary_join( rb_ary_subseq(ptr->rdns, 1, ptr->nrdns - 1), rb_str_new_cstr(",") );
+		rb_enc_associate( string, rb_utf8_encoding() );
+		ptr->parent = ropenldap_dn_cached( string, ptr );
+	}
+
+	return ptr->parent;
+}
+
+
+/*
+ * Return +other+ as a DN, parsing it (using the cache) if it isn't one already.
+ */
+static VALUE
+ropenldap_dn_coerce( VALUE other )
+{
+	if ( rb_obj_is_kind_of(other, ropenldap_cOpenLDAPDN) ) return other;
+	return ropenldap_dn_s_parse( ropenldap_cOpenLDAPDN, other );
+}
+
+
+/*
+ * call-seq:
+ *    dn.child_of?( other )   -> true or false
+ *
+ * Returns +true+ if the DN is directly below +other+ (a DN or a String) in the
+ * tree.
+ *
+ */
+static VALUE
+ropenldap_dn_child_of_p( VALUE self, VALUE other )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE rval;
+
+	other = ropenldap_dn_coerce( other );
+	rval = ropenldap_dn_is_below( ptr, ropenldap_get_dn(other), 1 ) ? Qtrue : Qfalse;
+	RB_GC_GUARD( other );
+
+	return rval;
+}
+
+
+/*
+ * call-seq:
+ *    dn.descendant_of?( other )   -> true or false
+ *
+ * Returns +true+ if the DN is anywhere below +other+ (a DN or a String) in the
+ * tree.
+ *
+ *    OpenLDAP::DN.new( 'uid=jdoe,ou=People,dc=example,dc=com' ).
+ *        descendant_of?( 'DC=Example,DC=Com' )
+ *    # => true
+ */
+static VALUE
+ropenldap_dn_descendant_of_p( VALUE self, VALUE other )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE rval;
+
+	other = ropenldap_dn_coerce( other );
+	rval = ropenldap_dn_is_below( ptr, ropenldap_get_dn(other), 0 ) ? Qtrue : Qfalse;
+	RB_GC_GUARD( other );
+
+	return rval;
+}
+
+
+/*
+ * call-seq:
+ *    dn.parent_of?( other )   -> true or false
+ *
+ * Returns +true+ if +other+ (a DN or a String) is directly below the DN in the
+ * tree.
+ *
+ */
+static VALUE
+ropenldap_dn_parent_of_p( VALUE self, VALUE other )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE rval;
+
+	other = ropenldap_dn_coerce( other );
+	rval = ropenldap_dn_is_below( ropenldap_get_dn(other), ptr, 1 ) ? Qtrue : Qfalse;
+	RB_GC_GUARD( other );
+
+	return rval;
+}
+
+
+/*
+ * call-seq:
+ *    dn.ancestor_of?( other )   -> true or false
+ *
+ * Returns +true+ if +other+ (a DN or a String) is anywhere below the DN in the
+ * tree.
+ *
+ */
+static VALUE
+ropenldap_dn_ancestor_of_p( VALUE self, VALUE other )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self );
+	VALUE rval;
+
+	other = ropenldap_dn_coerce( other );
+	rval = ropenldap_dn_is_below( ropenldap_get_dn(other), ptr, 0 ) ? Qtrue : Qfalse;
+	RB_GC_GUARD( other );
+
+	return rval;
+}
+
+
+/*
+ * call-seq:
+ *    dn == other   -> true or false
+ *    dn.eql?( other )   -> true or false
+ *
+ * Returns +true+ if +other+ is a DN with the same normalized form.
+ *
+ */
+static VALUE
+ropenldap_dn_eql( VALUE self, VALUE other )
+{
+	struct ropenldap_dn *ptr = ropenldap_get_dn( self ), *other_ptr;
+
+	if ( self == other ) return Qtrue;
+	if ( !rb_obj_is_kind_of(other, ropenldap_cOpenLDAPDN) ) return Qfalse;
+
+	other_ptr = ropenldap_get_dn( other );
+	if ( ptr->hash != other_ptr->hash ) return Qfalse;
+
+	return rb_str_equal( ptr->normalized, other_ptr->normalized );
+}
+
+
+/*
+ * call-seq:
+ *    dn.hash   -> integer
+ *
+ * Return a hash of the DN's normalized form, so equal DNs can be used
+ * interchangeably as Hash keys and Set members.
+ *
+ */
+static VALUE
+ropenldap_dn_hash( VALUE self )
+{
+	return LONG2FIX( (long)ropenldap_get_dn(self)->hash );
+}
+
+
+
+/*
+ * document-class: OpenLDAP::DN
+ */
+void
+ropenldap_init_dn( void )
+{
+	ropenldap_log( "debug", "Initializing OpenLDAP::DN" );
+
+	ropenldap_dn_cache = rb_hash_new();
+	rb_gc_register_address( &ropenldap_dn_cache );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::DN */
+	ropenldap_cOpenLDAPDN = rb_define_class_under( ropenldap_mOpenLDAP, "DN", rb_cObject );
+	rb_define_alloc_func( ropenldap_cOpenLDAPDN, ropenldap_dn_s_allocate );
+
+	rb_define_singleton_method( ropenldap_cOpenLDAPDN, "parse", ropenldap_dn_s_parse, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPDN, "normalize", ropenldap_dn_s_normalize, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPDN, "cache_size", ropenldap_dn_s_cache_size, 0 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPDN, "cache_size=",
+	                            ropenldap_dn_s_cache_size_eq, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPDN, "clear_cache", ropenldap_dn_s_clear_cache, 0 );
+
+	rb_define_method( ropenldap_cOpenLDAPDN, "initialize", ropenldap_dn_initialize, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "to_s", ropenldap_dn_to_s, 0 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "to_str", ropenldap_dn_to_s, 0 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "normalized", ropenldap_dn_normalized, 0 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "size", ropenldap_dn_size, 0 );
+	rb_define_alias(  ropenldap_cOpenLDAPDN, "length", "size" );
+	rb_define_method( ropenldap_cOpenLDAPDN, "rdns", ropenldap_dn_rdns, 0 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "rdn", ropenldap_dn_rdn, 0 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "[]", ropenldap_dn_aref, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "parent", ropenldap_dn_parent, 0 );
+
+	rb_define_method( ropenldap_cOpenLDAPDN, "child_of?", ropenldap_dn_child_of_p, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "descendant_of?", ropenldap_dn_descendant_of_p, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "parent_of?", ropenldap_dn_parent_of_p, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "ancestor_of?", ropenldap_dn_ancestor_of_p, 1 );
+
+	rb_define_method( ropenldap_cOpenLDAPDN, "==", ropenldap_dn_eql, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "eql?", ropenldap_dn_eql, 1 );
+	rb_define_method( ropenldap_cOpenLDAPDN, "hash", ropenldap_dn_hash, 0 );
+
+	rb_require( "openldap/dn" );
+}
+
@@ -0,0 +1,311 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::Entry class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ *
+ * Copyright (c) 2013 Michael Granger
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+#include "openldap.h"
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPEntry;
+
+
+/* --------------------------------------------------
+ *	Memory-management functions
+ * -------------------------------------------------- */
+
+/*
+ * GC Mark function
+ */
+static void
+ropenldap_entry_gc_mark( void *data )
+{
+	struct ropenldap_entry *ptr = data;
+
+	if ( ptr ) {
+		rb_gc_mark( ptr->message );
+		rb_gc_mark( ptr->dn );
+		rb_gc_mark( ptr->attributes );
+	}
+}
+
+
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_entry_gc_free( void *data )
+{
+	struct ropenldap_entry *ptr = data;
+
+	if ( ptr ) {
+		/* The entry itself belongs to the message's chain */
+		ptr->entry      = NULL;
+		ptr->message    = Qnil;
+		ptr->dn         = Qnil;
+		ptr->attributes = Qnil;
+
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function; counts the entry's slots in the Hash of the attribute values
+ * it has converted so far as well as its struct.
+ */
+static size_t
+ropenldap_entry_gc_size( const void *data )
+{
+	const struct ropenldap_entry *ptr = data;
+	size_t size = sizeof( struct ropenldap_entry );
+
+	if ( ptr && RB_TYPE_P(ptr->attributes, T_HASH) )
+		size += RHASH_SIZE( ptr->attributes ) * 2 * sizeof( VALUE );
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_entry_type = {
+	"OpenLDAP::Entry",
+	{
+		ropenldap_entry_gc_mark,
+		ropenldap_entry_gc_free,
+		ropenldap_entry_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Entry constructor; wraps the +entry+ from the chain belonging to the
+ * OpenLDAP::Message +message+.
+ */
+VALUE
+ropenldap_new_entry( VALUE message, LDAPMessage *entry )
+{
+	struct ropenldap_entry *ptr;
+	VALUE self = TypedData_Make_Struct( ropenldap_cOpenLDAPEntry, struct ropenldap_entry,
+	                                    &ropenldap_entry_type, ptr );
+
+	ptr->entry      = entry;
+	ptr->message    = message;
+	ptr->dn         = Qnil;
+	ptr->attributes = Qnil;
+
+	return self;
+}
+
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_entry *
+check_entry( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_entry_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_entry *
+ropenldap_get_entry( VALUE self )
+{
+	struct ropenldap_entry *entry = check_entry( self );
+
+	if ( !entry ) rb_fatal( "Use of uninitialized OpenLDAP::Entry" );
+
+	return entry;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    entry.dn   -> string
+ *
+ * Return the entry's Distinguished Name.
+ *
+ *    entry.dn
+ *    # => "cn=admin,dc=example,dc=com"
+ */
+static VALUE
+ropenldap_entry_dn( VALUE self )
+{
+	struct ropenldap_entry *ptr = ropenldap_get_entry( self );
+	LDAP *ldap;
+	char *dn;
+
+	if ( NIL_P(ptr->dn) ) {
+		ldap = ropenldap_message_get_ldap( ptr->message );
+		if ( !(dn = ldap_get_dn(ldap, ptr->entry)) )
+			ropenldap_check_result( LDAP_DECODING_ERROR, "ldap_get_dn" );
+
+		ptr->dn = rb_enc_str_new( dn, strlen(dn), rb_utf8_encoding() );
+		ldap_memfree( dn );
+	}
+
+	return ptr->dn;
+}
+
+
+/*
+ * call-seq:
+ *    entry[ attribute ]   -> array or nil
+ *
+ * Return the values of the specified +attribute+ as an Array of Strings, or +nil+ if
+ * the entry doesn't have the attribute. Values are only converted to Strings the
+ * first time the attribute is read.
+ *
+ *    entry['objectClass']
+ *    # => ["dcObject", "organization"]
+ */
+static VALUE
+ropenldap_entry_aref( VALUE self, VALUE attribute )
+{
+	struct ropenldap_entry *ptr = ropenldap_get_entry( self );
+	int flags = 0, type;
+	VALUE name = ropenldap_attr_key( attribute, &flags );
+	VALUE values = Qnil, schema;
+	struct berval **bvals = NULL;
+	LDAP *ldap;
+
+	if ( NIL_P(ptr->attributes) ) ptr->attributes = rb_hash_new();
+
+	values = rb_hash_lookup2( ptr->attributes, name, Qundef );
+	if ( values != Qundef ) return values;
+
+	/* Look up the value type before fetching the values, since getting the schema can
+	 * search for it, which can raise */
+	schema = ropenldap_message_get_schema( ptr->message );
+	type = NIL_P( schema ) ? ROPENLDAP_VALUE_STRING :
+		ropenldap_schema_value_type( schema, RSTRING_PTR(name), RSTRING_LEN(name) );
+
+	ldap = ropenldap_message_get_ldap( ptr->message );
+	bvals = ldap_get_values_len( ldap, ptr->entry, StringValueCStr(name) );
+
+	if ( bvals ) {
+		values = ropenldap_rb_values_array( bvals, flags, type );
+		ldap_value_free_len( bvals );
+	} else {
+		values = Qnil;
+	}
+
+	rb_hash_aset( ptr->attributes, name, values );
+
+	return values;
+}
+
+
+/*
+ * call-seq:
+ *    entry.attribute_names   -> array
+ *
+ * Return the names of the entry's attributes as an Array of Strings.
+ *
+ *    entry.attribute_names
+ *    # => ["objectClass", "o", "dc"]
+ */
+static VALUE
+ropenldap_entry_attribute_names( VALUE self )
+{
+	struct ropenldap_entry *ptr = ropenldap_get_entry( self );
+	LDAP *ldap = ropenldap_message_get_ldap( ptr->message );
+	VALUE names = rb_ary_new();
+	BerElement *ber = NULL;
+	char *attr;
+
+	for ( attr = ldap_first_attribute(ldap, ptr->entry, &ber);
+	      attr != NULL;
+	      attr = ldap_next_attribute(ldap, ptr->entry, ber) )
+	{
+		rb_ary_push( names, ropenldap_attr_name(attr, strlen(attr), NULL) );
+		ldap_memfree( attr );
+	}
+
+	if ( ber ) ber_free( ber, 0 );
+
+	return names;
+}
+
+
+/*
+ * document-class: OpenLDAP::Entry
+ */
+void
+ropenldap_init_entry( void )
+{
+	ropenldap_log( "debug", "Initializing OpenLDAP::Entry" );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::Entry */
+	ropenldap_cOpenLDAPEntry =
+		rb_define_class_under( ropenldap_mOpenLDAP, "Entry", rb_cObject );
+
+	rb_undef_alloc_func( ropenldap_cOpenLDAPEntry );
+
+	rb_define_method( ropenldap_cOpenLDAPEntry, "dn", ropenldap_entry_dn, 0 );
+	rb_define_method( ropenldap_cOpenLDAPEntry, "[]", ropenldap_entry_aref, 1 );
+	rb_define_method( ropenldap_cOpenLDAPEntry, "attribute_names",
+	                  ropenldap_entry_attribute_names, 0 );
+
+	rb_require( "openldap/entry" );
+}
+
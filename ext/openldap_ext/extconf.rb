@@ -32,5 +32,18 @@ have_const( 'LDAP_API_VERSION', 'ldap.h' ) or
 
 have_func( 'ldap_tls_inplace' )
 
+unless enable_config( 'debug-logging', true )
+	$stderr.puts "Debug logging disabled."
+	$defs << '-DROPENLDAP_NO_DEBUG_LOGGING'
+end
+
+have_func( 'rb_gc_adjust_memory_usage', 'ruby.h' )
+have_func( 'rb_hash_new_capa', 'ruby.h' )
+have_func( 'rb_hash_bulk_insert', 'ruby.h' )
+have_func( 'rb_enc_interned_str', 'ruby/encoding.h' )
+
+have_header( 'ruby/fiber/scheduler.h' ) and
+	have_func( 'rb_fiber_scheduler_current', 'ruby/fiber/scheduler.h' )
+
 create_header()
 create_makefile( 'openldap_ext' )
@@ -0,0 +1,689 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::Filter class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ * - Mahlon E. Smith <mahlon@martini.nu>
+ *
+ * Copyright (c) 2013 Michael Granger and Mahlon E. Smith
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+
+#include "openldap.h"
+
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPFilter;
+
+static ID id_getutc, id_strftime;
+static VALUE ropenldap_filter_time_format;
+
+/* Characters that have to be escaped in filter values (RFC 4515, 3) */
+#define ROPENLDAP_FILTER_SPECIAL   (1 << 0)
+/* Characters that mark placeholders in templates */
+#define ROPENLDAP_FILTER_TEMPLATE  (1 << 1)
+/* Bytes that are escaped in binary values */
+#define ROPENLDAP_FILTER_HIGH      (1 << 2)
+
+static unsigned char ropenldap_filter_escapes[ 256 ];
+
+/* Word-at-a-time tests for whether any byte of +word+ is zero, or is +byte+ */
+#define ROPENLDAP_ONES  0x0101010101010101ULL
+#define ROPENLDAP_HIGHS 0x8080808080808080ULL
+#define ROPENLDAP_HAS_ZERO( word ) ( ((word) - ROPENLDAP_ONES) & ~(word) & ROPENLDAP_HIGHS )
+#define ROPENLDAP_HAS_BYTE( word, byte ) ROPENLDAP_HAS_ZERO( (word) ^ (ROPENLDAP_ONES * (byte)) )
+
+/* The kinds of parts of a compiled template */
+enum ropenldap_filter_part_kind {
+	ROPENLDAP_FILTER_TEXT,
+	ROPENLDAP_FILTER_POSITIONAL,
+	ROPENLDAP_FILTER_NAMED,
+};
+
+/* A run of literal text or a placeholder in a compiled template */
+struct ropenldap_filter_part {
+	int kind;
+	size_t offset;   /* of the text in the template, for TEXT parts */
+	size_t len;
+	VALUE name;      /* the Symbol of a NAMED placeholder */
+};
+
+/* OpenLDAP::Filter struct */
+struct ropenldap_filter {
+	VALUE template;
+	struct ropenldap_filter_part *parts;
+	long nparts;
+	long positional;
+	long named;
+};
+
+
+
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
+
+/*
+ * GC Mark function
+ */
+static void
+ropenldap_filter_gc_mark( void *data )
+{
+	struct ropenldap_filter *ptr = data;
+	long i;
+
+	if ( ptr ) {
+		rb_gc_mark( ptr->template );
+		for ( i = 0; i < ptr->nparts; i++ )
+			rb_gc_mark( ptr->parts[i].name );
+	}
+}
+
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_filter_gc_free( void *data )
+{
+	struct ropenldap_filter *ptr = data;
+
+	if ( ptr ) {
+		xfree( ptr->parts );
+		ptr->parts = NULL;
+
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_filter_gc_size( const void *data )
+{
+	const struct ropenldap_filter *ptr = data;
+	size_t size = sizeof( struct ropenldap_filter );
+
+	if ( ptr ) size += ptr->nparts * sizeof( struct ropenldap_filter_part );
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_filter_type = {
+	"OpenLDAP::Filter",
+	{
+		ropenldap_filter_gc_mark,
+		ropenldap_filter_gc_free,
+		ropenldap_filter_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_filter *
+check_filter( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_filter_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_filter *
+ropenldap_get_filter( VALUE self )
+{
+	struct ropenldap_filter *ptr = check_filter( self );
+
+	if ( NIL_P(ptr->template) ) rb_fatal( "Use of uninitialized OpenLDAP::Filter" );
+
+	return ptr;
+}
+
+
+/*
+ * Return the number of bytes at the start of the +len+ bytes at +ptr+ that don't
+ * need escaping for any of the ROPENLDAP_FILTER_* flags in +mask+. Eight bytes are
+ * checked at a time until one that might need escaping turns up.
+ */
+static size_t
+ropenldap_filter_clean_span( const char *ptr, size_t len, int mask )
+{
+	size_t i = 0;
+	uint64_t word, hits;
+
+	for ( ; i + 8 <= len; i += 8 ) {
+		memcpy( &word, ptr + i, 8 );
+
+		hits = ROPENLDAP_HAS_ZERO( word ) | ROPENLDAP_HAS_BYTE( word, '(' ) |
+			ROPENLDAP_HAS_BYTE( word, ')' ) | ROPENLDAP_HAS_BYTE( word, '*' ) |
+			ROPENLDAP_HAS_BYTE( word, '\\' );
+		if ( mask & ROPENLDAP_FILTER_TEMPLATE )
+			hits |= ROPENLDAP_HAS_BYTE( word, '?' ) | ROPENLDAP_HAS_BYTE( word, '{' ) |
+				ROPENLDAP_HAS_BYTE( word, '}' );
+		if ( mask & ROPENLDAP_FILTER_HIGH )
+			hits |= word & ROPENLDAP_HIGHS;
+
+		if ( hits ) break;
+	}
+
+	for ( ; i < len; i++ )
+		if ( ropenldap_filter_escapes[(unsigned char)ptr[i]] & mask ) break;
+
+	return i;
+}
+
+
+/*
+ * Append the +len+ bytes at +ptr+ to +str+, escaping the bytes that need it for
+ * any of the ROPENLDAP_FILTER_* flags in +mask+ as \XX.
+ */
+static void
+ropenldap_filter_escape_append( VALUE str, const char *ptr, size_t len, int mask )
+{
+	static const char hex[] = "0123456789abcdef";
+	char escaped[ 3 ] = { '\\', 0, 0 };
+	size_t span;
+
+	while ( len ) {
+		span = ropenldap_filter_clean_span( ptr, len, mask );
+		if ( span ) rb_str_cat( str, ptr, span );
+		if ( span == len ) break;
+
+		escaped[1] = hex[ (unsigned char)ptr[span] >> 4 ];
+		escaped[2] = hex[ (unsigned char)ptr[span] & 0x0f ];
+		rb_str_cat( str, escaped, 3 );
+
+		ptr += span + 1;
+		len -= span + 1;
+	}
+}
+
+
+/*
+ * Return the String form of +value+ for use as a filter assertion value: +true+
+ * and +false+ become LDAP Booleans, Times become GeneralizedTimes, and everything
+ * else is converted with #to_s.
+ */
+static VALUE
+ropenldap_filter_value_string( VALUE value )
+{
+	if ( NIL_P(value) )
+		rb_raise( rb_eArgError, "can't use nil as a filter value" );
+	if ( value == Qtrue ) return rb_usascii_str_new_cstr( "TRUE" );
+	if ( value == Qfalse ) return rb_usascii_str_new_cstr( "FALSE" );
+	if ( rb_obj_is_kind_of(value, rb_cTime) )
+		return rb_funcall( rb_funcall(value, id_getutc, 0), id_strftime, 1,
+		                   ropenldap_filter_time_format );
+
+	return rb_obj_as_string( value );
+}
+
+
+/*
+ * Append the escaped filter value +value+ to +str+. Binary values have any bytes
+ * outside of ASCII escaped too, since they can't be sent as UTF-8.
+ */
+static void
+ropenldap_filter_append_value( VALUE str, VALUE value, int mask )
+{
+	value = ropenldap_filter_value_string( value );
+	if ( rb_enc_get(value) == rb_ascii8bit_encoding() )
+		mask |= ROPENLDAP_FILTER_HIGH;
+	else
+		value = ropenldap_str_utf8( value );
+
+	ropenldap_filter_escape_append( str, RSTRING_PTR(value), RSTRING_LEN(value), mask );
+	RB_GC_GUARD( value );
+}
+
+
+/*
+ * Add a part of the given +kind+ to the filter +ptr+, which has room for it.
+ */
+static struct ropenldap_filter_part *
+ropenldap_filter_add_part( struct ropenldap_filter *ptr, int kind, size_t offset, size_t len )
+{
+	struct ropenldap_filter_part *part;
+
+	/* Runs of text are merged */
+	if ( kind == ROPENLDAP_FILTER_TEXT && ptr->nparts &&
+	     ptr->parts[ptr->nparts - 1].kind == ROPENLDAP_FILTER_TEXT ) {
+		ptr->parts[ ptr->nparts - 1 ].len += len;
+		return &ptr->parts[ ptr->nparts - 1 ];
+	}
+
+	part = &ptr->parts[ ptr->nparts++ ];
+	part->kind   = kind;
+	part->offset = offset;
+	part->len    = len;
+	part->name   = Qnil;
+
+	return part;
+}
+
+
+/*
+ * Compile the +template+ into the parts of the filter +ptr+, raising an
+ * ArgumentError if it's malformed.
+ */
+static void
+ropenldap_filter_compile( struct ropenldap_filter *ptr, VALUE template )
+{
+	const char *text = RSTRING_PTR( template );
+	long len = RSTRING_LEN( template ), i = 0, start, end, depth = 0;
+	struct ropenldap_filter_part *part;
+
+	if ( len == 0 ) rb_raise( rb_eArgError, "empty filter template" );
+
+	/* There's at most one part per byte */
+	xfree( ptr->parts );
+	ptr->parts = ALLOC_N( struct ropenldap_filter_part, len );
+	ptr->nparts = ptr->positional = ptr->named = 0;
+
+	while ( i < len ) {
+		switch ( text[i] ) {
+			case '?':
+				ropenldap_filter_add_part( ptr, ROPENLDAP_FILTER_POSITIONAL, i, 1 );
+				ptr->positional++;
+				i++;
+				break;
+
+			case '{':
+				/* Braces that don't enclose a name are just text */
+				start = i + 1;
+				end = start;
+				while ( end < len && (rb_isalnum(text[end]) || text[end] == '_') ) end++;
+				if ( end == start || end == len || text[end] != '}' ) {
+					ropenldap_filter_add_part( ptr, ROPENLDAP_FILTER_TEXT, i, 1 );
+					i++;
+					break;
+				}
+
+				part = ropenldap_filter_add_part( ptr, ROPENLDAP_FILTER_NAMED, i, end - i + 1 );
+				part->name = ID2SYM( rb_intern2(text + start, end - start) );
+				ptr->named++;
+				i = end + 1;
+				break;
+
+			case '\\':
+				if ( i + 2 >= len || !rb_isxdigit(text[i + 1]) || !rb_isxdigit(text[i + 2]) )
+					rb_raise( rb_eArgError, "malformed escape at offset %ld of filter template", i );
+				ropenldap_filter_add_part( ptr, ROPENLDAP_FILTER_TEXT, i, 3 );
+				i += 3;
+				break;
+
+			case '(':
+			case ')':
+				depth += text[i] == '(' ? 1 : -1;
+				if ( depth < 0 )
+					rb_raise( rb_eArgError, "unbalanced parentheses in filter template" );
+				/* fall through */
+
+			default:
+				ropenldap_filter_add_part( ptr, ROPENLDAP_FILTER_TEXT, i, 1 );
+				i++;
+		}
+	}
+
+	if ( depth != 0 )
+		rb_raise( rb_eArgError, "unbalanced parentheses in filter template" );
+
+	REALLOC_N( ptr->parts, struct ropenldap_filter_part, ptr->nparts );
+}
+
+
+
+/* --------------------------------------------------------------
+ * Class methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::Filter.allocate   -> filter
+ *
+ * Allocate a new OpenLDAP::Filter object.
+ *
+ */
+static VALUE
+ropenldap_filter_s_allocate( VALUE klass )
+{
+	struct ropenldap_filter *ptr;
+	VALUE self = TypedData_Make_Struct( klass, struct ropenldap_filter, &ropenldap_filter_type, ptr );
+
+	ptr->template   = Qnil;
+	ptr->parts      = NULL;
+	ptr->nparts     = 0;
+	ptr->positional = 0;
+	ptr->named      = 0;
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Filter.escape( value )   -> string
+ *
+ * Return +value+ escaped for use as an assertion value in a filter string
+ * (RFC 4515, 3). Binary (ASCII-8BIT) values have their non-ASCII bytes escaped
+ * as well.
+ *
+ *    OpenLDAP::Filter.escape( 'Smith (ret*)' )
+ *    # => "Smith \\28ret\\2a\\29"
+ */
+static VALUE
+ropenldap_filter_s_escape( VALUE UNUSED(klass), VALUE value )
+{
+	VALUE str = rb_enc_str_new( NULL, 0, rb_utf8_encoding() );
+
+	ropenldap_filter_append_value( str, value, ROPENLDAP_FILTER_SPECIAL );
+	return str;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Filter.escape_literal( value )   -> string
+ *
+ * Return +value+ escaped like ::escape, and also with any characters that would
+ * be mistaken for placeholders escaped, for including it in a template.
+ *
+ *    OpenLDAP::Filter.escape_literal( 'who?' )
+ *    # => "who\\3f"
+ */
+static VALUE
+ropenldap_filter_s_escape_literal( VALUE UNUSED(klass), VALUE value )
+{
+	VALUE str = rb_enc_str_new( NULL, 0, rb_utf8_encoding() );
+
+	ropenldap_filter_append_value( str, value, ROPENLDAP_FILTER_SPECIAL|ROPENLDAP_FILTER_TEMPLATE );
+	return str;
+}
+
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Filter.literal( filter_string )   -> filter
+ *
+ * Return a Filter for the filter string +filter_string+ (RFC 4515) without any
+ * placeholders: any <tt>?</tt>, <tt>{</tt>, or <tt>}</tt> in it are values, not
+ * placeholders, and are escaped in the new filter's template. This is how the
+ * builder methods use filter Strings.
+ *
+ *    OpenLDAP::Filter.literal( '(cn=who?)' ).template
+ *    # => "(cn=who\\3f)"
+ */
+static VALUE
+ropenldap_filter_s_literal( VALUE klass, VALUE filter )
+{
+	VALUE template = rb_enc_str_new( NULL, 0, rb_utf8_encoding() );
+
+	filter = ropenldap_str_utf8( rb_obj_as_string(filter) );
+	ropenldap_filter_escape_append( template, RSTRING_PTR(filter), RSTRING_LEN(filter),
+	                                ROPENLDAP_FILTER_TEMPLATE );
+	RB_GC_GUARD( filter );
+
+	return rb_class_new_instance( 1, &template, klass );
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::Filter.new( template )   -> filter
+ *
+ * Compile the filter +template+, a filter string (RFC 4515) which can contain
+ * placeholders for values: <tt>?</tt> for values passed in order, and
+ * <tt>{name}</tt> for values passed in a Hash, where +name+ is made of letters,
+ * digits, and underscores; any other braces are left as they are. Values are
+ * escaped when they're bound, so placeholders can only stand for assertion values
+ * (or parts of them), never for attribute names or filter syntax. Use ::literal
+ * for filter strings that have a raw <tt>?</tt> in a value.
+ *
+ *    USER_FILTER = OpenLDAP::Filter.new( '(&(objectClass=person)(|(uid={login})(mail={login})))' )
+ */
+static VALUE
+ropenldap_filter_initialize( VALUE self, VALUE template )
+{
+	struct ropenldap_filter *ptr = check_filter( self );
+
+	if ( !NIL_P(ptr->template) )
+		rb_raise( ropenldap_eOpenLDAPError, "Cannot re-initialize a Filter object." );
+
+	template = rb_str_new_frozen( ropenldap_str_utf8(template) );
+	ropenldap_filter_compile( ptr, template );
+	ptr->template = template;
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    filter.template   -> string
+ *
+ * Return the template the filter was compiled from.
+ *
+ */
+static VALUE
+ropenldap_filter_template( VALUE self )
+{
+	return ropenldap_get_filter( self )->template;
+}
+
+
+/*
+ * call-seq:
+ *    filter.placeholders   -> array
+ *
+ * Return the filter's placeholders in order: +nil+ for positional ones, and the
+ * Symbol of the name of named ones.
+ *
+ *    OpenLDAP::Filter.new( '(&(uid=?)(ou={ou}))' ).placeholders
+ *    # => [nil, :ou]
+ */
+static VALUE
+ropenldap_filter_placeholders( VALUE self )
+{
+	struct ropenldap_filter *ptr = ropenldap_get_filter( self );
+	VALUE placeholders = rb_ary_new_capa( ptr->positional + ptr->named );
+	long i;
+
+	for ( i = 0; i < ptr->nparts; i++ ) {
+		if ( ptr->parts[i].kind != ROPENLDAP_FILTER_TEXT )
+			rb_ary_push( placeholders, ptr->parts[i].name );
+	}
+
+	return placeholders;
+}
+
+
+/*
+ * call-seq:
+ *    filter.bind( *values )                -> string
+ *    filter.bind( *values, name: value )   -> string
+ *
+ * Return the filter string with the escaped +values+ in place of its
+ * placeholders: positional values in order, followed by a Hash of the values for
+ * named placeholders if there are any. +true+ and +false+ are bound as LDAP
+ * Booleans, Times as GeneralizedTimes, and anything else as its #to_s.
+ *
+ *    USER_FILTER.bind( login: params[:login] )
+ *    # => "(&(objectClass=person)(|(uid=jrandom)(mail=jrandom)))"
+ */
+static VALUE
+ropenldap_filter_bind( int argc, VALUE *argv, VALUE self )
+{
+	struct ropenldap_filter *ptr = ropenldap_get_filter( self );
+	const char *text = RSTRING_PTR( ptr->template );
+	VALUE names = Qnil, str, value;
+	long i, positional = 0;
+
+	if ( ptr->named ) {
+		if ( argc == 0 || !RB_TYPE_P(argv[argc - 1], T_HASH) )
+			rb_raise( rb_eArgError, "no Hash of values for the named placeholders" );
+		names = argv[ --argc ];
+	}
+	if ( argc != ptr->positional )
+		rb_raise( rb_eArgError, "wrong number of values (given %d, expected %ld)",
+		          argc, ptr->positional );
+
+	str = rb_str_buf_new( RSTRING_LEN(ptr->template) + 32 * (ptr->positional + ptr->named) );
+	rb_enc_associate( str, rb_utf8_encoding() );
+
+	for ( i = 0; i < ptr->nparts; i++ ) {
+		struct ropenldap_filter_part *part = &ptr->parts[ i ];
+
+		switch ( part->kind ) {
+			case ROPENLDAP_FILTER_TEXT:
+				rb_str_cat( str, text + part->offset, part->len );
+				break;
+
+			case ROPENLDAP_FILTER_POSITIONAL:
+				ropenldap_filter_append_value( str, argv[positional++], ROPENLDAP_FILTER_SPECIAL );
+				break;
+
+			case ROPENLDAP_FILTER_NAMED:
+				value = rb_hash_lookup2( names, part->name, Qundef );
+				if ( value == Qundef )
+					value = rb_hash_lookup2( names, rb_sym2str(part->name), Qundef );
+				if ( value == Qundef )
+					rb_raise( rb_eArgError, "no value for the placeholder %"PRIsVALUE,
+					          rb_sym2str(part->name) );
+
+				ropenldap_filter_append_value( str, value, ROPENLDAP_FILTER_SPECIAL );
+				break;
+		}
+	}
+
+	return str;
+}
+
+
+/*
+ * call-seq:
+ *    filter.to_s   -> string
+ *
+ * Return the filter string of a filter that doesn't have any placeholders. This
+ * lets a Filter be passed anywhere a filter String is expected, such as
+ * Connection#search.
+ *
+ *    conn.search( base, :subtree, OpenLDAP::Filter.eq(:objectClass, 'person') )
+ */
+static VALUE
+ropenldap_filter_to_s( VALUE self )
+{
+	struct ropenldap_filter *ptr = ropenldap_get_filter( self );
+
+	if ( ptr->positional || ptr->named )
+		rb_raise( rb_eArgError, "filter has placeholders; use #bind to give them values" );
+
+	return ptr->template;
+}
+
+
+
+/*
+ * document-class: OpenLDAP::Filter
+ */
+void
+ropenldap_init_filter( void )
+{
+	const char *special = "()*\\";
+	int i;
+
+	ropenldap_log( "debug", "Initializing OpenLDAP::Filter" );
+
+	memset( ropenldap_filter_escapes, 0, sizeof(ropenldap_filter_escapes) );
+	ropenldap_filter_escapes[ 0 ] = ROPENLDAP_FILTER_SPECIAL;
+	for ( i = 0; special[i]; i++ )
+		ropenldap_filter_escapes[ (unsigned char)special[i] ] = ROPENLDAP_FILTER_SPECIAL;
+	ropenldap_filter_escapes[ '?' ] = ROPENLDAP_FILTER_TEMPLATE;
+	ropenldap_filter_escapes[ '{' ] = ROPENLDAP_FILTER_TEMPLATE;
+	ropenldap_filter_escapes[ '}' ] = ROPENLDAP_FILTER_TEMPLATE;
+	for ( i = 0x80; i < 0x100; i++ )
+		ropenldap_filter_escapes[ i ] = ROPENLDAP_FILTER_HIGH;
+
+	id_getutc   = rb_intern( "getutc" );
+	id_strftime = rb_intern( "strftime" );
+	ropenldap_filter_time_format = rb_str_new_cstr( "%Y%m%d%H%M%SZ" );
+	rb_gc_register_address( &ropenldap_filter_time_format );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::Filter */
+	ropenldap_cOpenLDAPFilter = rb_define_class_under( ropenldap_mOpenLDAP, "Filter", rb_cObject );
+	rb_define_alloc_func( ropenldap_cOpenLDAPFilter, ropenldap_filter_s_allocate );
+
+	rb_define_singleton_method( ropenldap_cOpenLDAPFilter, "escape", ropenldap_filter_s_escape, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPFilter, "escape_literal",
+	                            ropenldap_filter_s_escape_literal, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPFilter, "literal", ropenldap_filter_s_literal, 1 );
+
+	rb_define_method( ropenldap_cOpenLDAPFilter, "initialize", ropenldap_filter_initialize, 1 );
+	rb_define_method( ropenldap_cOpenLDAPFilter, "template", ropenldap_filter_template, 0 );
+	rb_define_method( ropenldap_cOpenLDAPFilter, "placeholders", ropenldap_filter_placeholders, 0 );
+	rb_define_method( ropenldap_cOpenLDAPFilter, "bind", ropenldap_filter_bind, -1 );
+	rb_define_method( ropenldap_cOpenLDAPFilter, "to_s", ropenldap_filter_to_s, 0 );
+	rb_define_method( ropenldap_cOpenLDAPFilter, "to_str", ropenldap_filter_to_s, 0 );
+
+	rb_require( "openldap/filter" );
+}
+
@@ -0,0 +1,1235 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::LDIF class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ * - Mahlon E. Smith <mahlon@martini.nu>
+ *
+ * Copyright (c) 2013 Michael Granger and Mahlon E. Smith
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+#include "openldap.h"
+
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPLDIF;
+VALUE ropenldap_eOpenLDAPLDIFParseError;
+
+static ID id_read, id_subclass_for;
+static ID id_add, id_modify, id_delete, id_modrdn, id_replace, id_increment;
+static VALUE sym_newrdn, sym_delete_old_rdn, sym_newsuperior;
+static VALUE sym_records, sym_succeeded, sym_failed, sym_errors;
+
+/* The number of bytes to read from the IO at a time */
+#define ROPENLDAP_LDIF_CHUNK 65536
+
+/* The default number of operations to keep outstanding while loading */
+#define ROPENLDAP_LDIF_WINDOW 32
+
+/* Base64 decoding table; -1 for invalid characters */
+static signed char ropenldap_b64_table[256];
+
+/* Change types */
+enum ropenldap_ldif_changetype {
+	ROPENLDAP_LDIF_ADD,
+	ROPENLDAP_LDIF_MODIFY,
+	ROPENLDAP_LDIF_DELETE,
+	ROPENLDAP_LDIF_MODRDN,
+};
+
+/* One attribute/value line of a record */
+struct ropenldap_ldif_item {
+	char          *type;
+	struct berval value;
+	int           op;
+	long          group;
+};
+
+/* The current record, with pointers into the reader's buffers */
+struct ropenldap_ldif_record {
+	enum ropenldap_ldif_changetype changetype;
+	long        lineno;
+	char        *dn;
+	LDAPMod     **mods;
+	char        *newrdn;
+	char        *newsuperior;
+	int         deleteoldrdn;
+	char        *critical_control;   /* the OID of a critical control, which can't be sent */
+};
+
+/* OpenLDAP::LDIF struct */
+struct ropenldap_ldif {
+	VALUE  io;
+	VALUE  chunk;
+	int    eof;
+	long   lineno;
+
+	/* Input that's been read but not consumed */
+	char   *input;
+	size_t input_len, input_cap, input_pos;
+
+	/* The unfolded lines of the current record, each NUL-terminated */
+	char   *rec;
+	size_t rec_len, rec_cap;
+	size_t *lines;
+	long   nlines, lines_cap;
+	long   rec_lineno;
+
+	/* Scratch space for building the current record's modifications */
+	struct ropenldap_ldif_item *items;
+	long   items_cap;
+	LDAPMod **mods;
+	LDAPMod *modbuf;
+	struct berval **bvptrs;
+	long   mods_cap, bvptrs_cap;
+};
+
+/* An operation that's been sent by LDIF#load and not yet finished */
+struct ropenldap_ldif_pending {
+	int  msgid;
+	long lineno;
+	char *dn;
+	enum ropenldap_ldif_changetype changetype;
+};
+
+/* State for LDIF#load */
+struct ropenldap_ldif_load {
+	VALUE self;
+	VALUE connection;
+	VALUE errors;
+	long  window;
+	long  records, succeeded, failed;
+	struct ropenldap_ldif_pending *pending;
+	long  npending;
+	LDAPMessage *msg;
+};
+
+
+
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
+
+/*
+ * GC Mark function
+ */
+static void
+ropenldap_ldif_gc_mark( void *data )
+{
+	struct ropenldap_ldif *ptr = data;
+
+	if ( ptr ) {
+		rb_gc_mark( ptr->io );
+		rb_gc_mark( ptr->chunk );
+	}
+}
+
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_ldif_gc_free( void *data )
+{
+	struct ropenldap_ldif *ptr = data;
+
+	if ( ptr ) {
+		xfree( ptr->input );
+		xfree( ptr->rec );
+		xfree( ptr->lines );
+		xfree( ptr->items );
+		xfree( ptr->mods );
+		xfree( ptr->modbuf );
+		xfree( ptr->bvptrs );
+
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_ldif_gc_size( const void *data )
+{
+	const struct ropenldap_ldif *ptr = data;
+	size_t size = sizeof( struct ropenldap_ldif );
+
+	if ( ptr ) {
+		size += ptr->input_cap + ptr->rec_cap;
+		size += ptr->lines_cap * sizeof( size_t );
+		size += ptr->items_cap * sizeof( struct ropenldap_ldif_item );
+		size += ptr->mods_cap * ( sizeof(LDAPMod *) + sizeof(LDAPMod) );
+		size += ptr->bvptrs_cap * sizeof( struct berval * );
+	}
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_ldif_type = {
+	"OpenLDAP::LDIF",
+	{
+		ropenldap_ldif_gc_mark,
+		ropenldap_ldif_gc_free,
+		ropenldap_ldif_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_ldif *
+check_ldif( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_ldif_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_ldif *
+ropenldap_get_ldif( VALUE self )
+{
+	struct ropenldap_ldif *ptr = check_ldif( self );
+
+	if ( NIL_P(ptr->io) ) rb_fatal( "Use of uninitialized OpenLDAP::LDIF" );
+
+	return ptr;
+}
+
+
+/*
+ * Raise an OpenLDAP::LDIF::ParseError for the current record of +ldif+.
+ */
+static void
+ropenldap_ldif_parse_error( struct ropenldap_ldif *ldif, const char *message )
+{
+	rb_raise( ropenldap_eOpenLDAPLDIFParseError, "record at line %ld: %s",
+	          ldif->rec_lineno, message );
+}
+
+
+/*
+ * Decode the NUL-terminated base64 +str+ in place, returning the length of the
+ * decoded data, or -1 if it isn't valid base64.
+ */
+static long
+ropenldap_ldif_b64_decode( char *str )
+{
+	unsigned char *in = (unsigned char *)str, *out = (unsigned char *)str;
+	unsigned long acc = 0;
+	int bits = 0, val;
+
+	for ( ; *in && *in != '='; in++ ) {
+		if ( *in == ' ' ) continue;
+		if ( (val = ropenldap_b64_table[*in]) < 0 ) return -1;
+
+		acc = ( (acc << 6) | (unsigned long)val ) & 0xffffff;
+		bits += 6;
+
+		if ( bits >= 8 ) {
+			bits -= 8;
+			*out++ = (unsigned char)( (acc >> bits) & 0xff );
+		}
+	}
+
+	*out = '\0';
+	return (long)( out - (unsigned char *)str );
+}
+
+
+/*
+ * Read the next chunk of the IO into the input buffer, first discarding the
+ * input that's already been consumed.
+ */
+static void
+ropenldap_ldif_fill( struct ropenldap_ldif *ldif )
+{
+	VALUE chunk;
+	size_t remaining = ldif->input_len - ldif->input_pos;
+
+	if ( ldif->input_pos ) {
+		memmove( ldif->input, ldif->input + ldif->input_pos, remaining );
+		ldif->input_len = remaining;
+		ldif->input_pos = 0;
+	}
+
+	/* Leave room for a NUL after an unterminated last line */
+	if ( ldif->input_cap < remaining + ROPENLDAP_LDIF_CHUNK + 1 ) {
+		ldif->input_cap = remaining + ROPENLDAP_LDIF_CHUNK + 1;
+		REALLOC_N( ldif->input, char, ldif->input_cap );
+	}
+
+	chunk = rb_funcall( ldif->io, id_read, 2, INT2FIX(ROPENLDAP_LDIF_CHUNK), ldif->chunk );
+	if ( NIL_P(chunk) ) {
+		ldif->eof = 1;
+		return;
+	}
+
+	StringValue( chunk );
+	if ( (size_t)RSTRING_LEN(chunk) > ROPENLDAP_LDIF_CHUNK )
+		rb_raise( rb_eIOError, "read more than was asked for" );
+
+	memcpy( ldif->input + ldif->input_len, RSTRING_PTR(chunk), RSTRING_LEN(chunk) );
+	ldif->input_len += RSTRING_LEN( chunk );
+	if ( RSTRING_LEN(chunk) == 0 ) ldif->eof = 1;
+}
+
+
+/*
+ * Fetch the next physical line of input into +line+ (NUL-terminated in place,
+ * without its line ending) and its length into +len+. The line is only valid
+ * until the next call. Returns 0 at the end of the input.
+ */
+static int
+ropenldap_ldif_next_line( struct ropenldap_ldif *ldif, char **line, size_t *len )
+{
+	char *start, *end, *nl = NULL;
+
+	for ( ;; ) {
+		nl = memchr( ldif->input + ldif->input_pos, '\n', ldif->input_len - ldif->input_pos );
+		if ( nl || ldif->eof ) break;
+		ropenldap_ldif_fill( ldif );
+	}
+
+	if ( ldif->input_pos >= ldif->input_len ) return 0;
+
+	start = ldif->input + ldif->input_pos;
+	end = nl ? nl : ldif->input + ldif->input_len;
+	ldif->input_pos = ( end - ldif->input ) + ( nl ? 1 : 0 );
+
+	if ( end > start && end[-1] == '\r' ) end--;
+	*end = '\0';
+
+	*line = start;
+	*len = end - start;
+	ldif->lineno++;
+
+	return 1;
+}
+
+
+/*
+ * Append +len+ bytes of +data+ followed by a NUL to the current record.
+ */
+static void
+ropenldap_ldif_append( struct ropenldap_ldif *ldif, const char *data, size_t len )
+{
+	if ( ldif->rec_cap < ldif->rec_len + len + 1 ) {
+		ldif->rec_cap = ( ldif->rec_len + len + 1 ) * 2;
+		REALLOC_N( ldif->rec, char, ldif->rec_cap );
+	}
+
+	memcpy( ldif->rec + ldif->rec_len, data, len );
+	ldif->rec_len += len;
+	ldif->rec[ ldif->rec_len++ ] = '\0';
+}
+
+
+/*
+ * Read the unfolded lines of the next record, skipping comments. Returns 0 if
+ * there are no more records.
+ */
+static int
+ropenldap_ldif_read_record( struct ropenldap_ldif *ldif )
+{
+	char *line;
+	size_t len;
+	int in_comment = 0;
+
+	ldif->rec_len = 0;
+	ldif->nlines = 0;
+
+	while ( ropenldap_ldif_next_line(ldif, &line, &len) ) {
+		if ( len == 0 ) {
+			if ( ldif->nlines ) return 1;
+			in_comment = 0;
+			continue;
+		}
+
+		/* Continuation of the previous line */
+		if ( line[0] == ' ' ) {
+			if ( in_comment ) continue;
+			if ( !ldif->nlines ) {
+				ldif->rec_lineno = ldif->lineno;
+				ropenldap_ldif_parse_error( ldif, "continuation without a line to continue" );
+			}
+
+			ldif->rec_len--;
+			ropenldap_ldif_append( ldif, line + 1, len - 1 );
+			continue;
+		}
+
+		if ( (in_comment = (line[0] == '#')) ) continue;
+
+		if ( !ldif->nlines ) ldif->rec_lineno = ldif->lineno;
+		if ( ldif->nlines == ldif->lines_cap ) {
+			ldif->lines_cap = ldif->lines_cap ? ldif->lines_cap * 2 : 64;
+			REALLOC_N( ldif->lines, size_t, ldif->lines_cap );
+		}
+
+		ldif->lines[ ldif->nlines++ ] = ldif->rec_len;
+		ropenldap_ldif_append( ldif, line, len );
+	}
+
+	return ldif->nlines > 0;
+}
+
+
+/*
+ * Split the line +i+ of the current record into the +item+'s type and value,
+ * decoding base64 values in place.
+ */
+static void
+ropenldap_ldif_split_line( struct ropenldap_ldif *ldif, long i, struct ropenldap_ldif_item *item )
+{
+	char *line = ldif->rec + ldif->lines[i];
+	char *colon, *value;
+	long len;
+
+	item->op = 0;
+	item->group = -1;
+
+	if ( line[0] == '-' && line[1] == '\0' ) {
+		item->type = line;
+		item->value.bv_val = line + 1;
+		item->value.bv_len = 0;
+		return;
+	}
+
+	if ( !(colon = strchr(line, ':')) || colon == line )
+		ropenldap_ldif_parse_error( ldif, "expected an 'attribute: value' line" );
+
+	*colon = '\0';
+	item->type = line;
+	value = colon + 1;
+
+	if ( *value == ':' ) {
+		for ( value++; *value == ' '; value++ ) ;
+		if ( (len = ropenldap_ldif_b64_decode(value)) < 0 )
+			ropenldap_ldif_parse_error( ldif, "invalid base64 value" );
+		item->value.bv_val = value;
+		item->value.bv_len = (ber_len_t)len;
+	}
+	else if ( *value == '<' ) {
+		ropenldap_ldif_parse_error( ldif, "URL values aren't supported" );
+	}
+	else {
+		for ( ; *value == ' '; value++ ) ;
+		item->value.bv_val = value;
+		item->value.bv_len = strlen( value );
+	}
+}
+
+
+/*
+ * Return the LDAP_MOD_* operation for the modify section name +name+, or -1 if
+ * it isn't one.
+ */
+static int
+ropenldap_ldif_mod_op( const char *name )
+{
+	if ( strcasecmp(name, "add") == 0 ) return LDAP_MOD_ADD;
+	if ( strcasecmp(name, "delete") == 0 ) return LDAP_MOD_DELETE;
+	if ( strcasecmp(name, "replace") == 0 ) return LDAP_MOD_REPLACE;
+	if ( strcasecmp(name, "increment") == 0 ) return LDAP_MOD_INCREMENT;
+	return -1;
+}
+
+
+/*
+ * Build the NULL-terminated LDAPMod array for the first +nitems+ items of the
+ * current record, which have been assigned to +ngroups+ groups; each group
+ * becomes one LDAPMod. Items with a NULL value only contribute their group's
+ * type and operation.
+ */
+static LDAPMod **
+ropenldap_ldif_build_mods( struct ropenldap_ldif *ldif, long nitems, long ngroups )
+{
+	struct berval **bvptr;
+	long i, g;
+
+	if ( ldif->mods_cap < ngroups + 1 ) {
+		ldif->mods_cap = ngroups + 1;
+		REALLOC_N( ldif->mods, LDAPMod *, ldif->mods_cap );
+		REALLOC_N( ldif->modbuf, LDAPMod, ldif->mods_cap );
+	}
+	if ( ldif->bvptrs_cap < nitems + ngroups ) {
+		ldif->bvptrs_cap = nitems + ngroups;
+		REALLOC_N( ldif->bvptrs, struct berval *, ldif->bvptrs_cap );
+	}
+
+	/* Lay the groups' value arrays out one after the other */
+	bvptr = ldif->bvptrs;
+	for ( g = 0; g < ngroups; g++ ) {
+		ldif->modbuf[g].mod_type = NULL;
+		ldif->modbuf[g].mod_bvalues = bvptr;
+
+		for ( i = 0; i < nitems; i++ ) {
+			if ( ldif->items[i].group != g ) continue;
+			if ( !ldif->modbuf[g].mod_type ) {
+				ldif->modbuf[g].mod_op = ldif->items[i].op | LDAP_MOD_BVALUES;
+				ldif->modbuf[g].mod_type = ldif->items[i].type;
+			}
+			if ( ldif->items[i].value.bv_val ) *bvptr++ = &ldif->items[i].value;
+		}
+
+		*bvptr++ = NULL;
+		ldif->mods[g] = &ldif->modbuf[g];
+	}
+	ldif->mods[ ngroups ] = NULL;
+
+	return ldif->mods;
+}
+
+
+/*
+ * Returns non-zero if the value +spec+ of a control line (RFC 2849) is for a
+ * critical control, leaving just the control's OID in +spec+ if it is.
+ */
+static int
+ropenldap_ldif_control_is_critical( char *spec )
+{
+	char *end = spec + strcspn( spec, " :" ), *crit;
+
+	for ( crit = end; *crit == ' '; crit++ ) ;
+	if ( strncasecmp(crit, "true", 4) != 0 || (crit[4] && crit[4] != ' ' && crit[4] != ':') )
+		return 0;
+
+	*end = '\0';
+	return 1;
+}
+
+
+/*
+ * Parse the current record of +ldif+ into +record+.
+ */
+static void
+ropenldap_ldif_parse_record( struct ropenldap_ldif *ldif, struct ropenldap_ldif_record *record )
+{
+	struct ropenldap_ldif_item *items;
+	long i, j, header, first = 0, nitems = 0, ngroups = 0;
+	const char *changetype = NULL;
+	int op;
+
+	if ( ldif->items_cap < ldif->nlines ) {
+		ldif->items_cap = ldif->nlines;
+		REALLOC_N( ldif->items, struct ropenldap_ldif_item, ldif->items_cap );
+	}
+	items = ldif->items;
+
+	for ( i = 0; i < ldif->nlines; i++ )
+		ropenldap_ldif_split_line( ldif, i, &items[i] );
+
+	memset( record, 0, sizeof(*record) );
+	record->lineno = ldif->rec_lineno;
+	record->deleteoldrdn = 1;
+
+	/* The version line can precede the first record without a blank line */
+	if ( strcasecmp(items[0].type, "version") == 0 ) first = 1;
+	if ( first >= ldif->nlines ) return;
+
+	if ( strcasecmp(items[first].type, "dn") != 0 )
+		ropenldap_ldif_parse_error( ldif, "expected a dn" );
+	record->dn = items[ first++ ].value.bv_val;
+
+	/* Controls aren't sent, which is only allowed for ones that aren't critical */
+	while ( first < ldif->nlines && strcasecmp(items[first].type, "control") == 0 ) {
+		if ( ropenldap_ldif_control_is_critical(items[first].value.bv_val) ) {
+			if ( !record->critical_control ) record->critical_control = items[ first ].value.bv_val;
+		} else {
+			ropenldap_log( "info", "Ignoring control in LDIF record at line %ld", ldif->rec_lineno );
+		}
+		first++;
+	}
+
+	if ( first < ldif->nlines && strcasecmp(items[first].type, "changetype") == 0 )
+		changetype = items[ first++ ].value.bv_val;
+
+	/* Add records: one LDAPMod per distinct attribute type */
+	if ( !changetype || strcasecmp(changetype, "add") == 0 ) {
+		record->changetype = ROPENLDAP_LDIF_ADD;
+
+		for ( i = first; i < ldif->nlines; i++ ) {
+			items[ nitems ] = items[ i ];
+			items[ nitems ].op = LDAP_MOD_ADD;
+
+			for ( j = 0; j < nitems; j++ ) {
+				if ( strcasecmp(items[j].type, items[nitems].type) == 0 ) {
+					items[ nitems ].group = items[ j ].group;
+					break;
+				}
+			}
+			if ( j == nitems ) items[ nitems ].group = ngroups++;
+			nitems++;
+		}
+
+		if ( !ngroups ) ropenldap_ldif_parse_error( ldif, "add record without attributes" );
+		record->mods = ropenldap_ldif_build_mods( ldif, nitems, ngroups );
+	}
+
+	/* Modify records: one LDAPMod per section */
+	else if ( strcasecmp(changetype, "modify") == 0 ) {
+		record->changetype = ROPENLDAP_LDIF_MODIFY;
+
+		for ( i = first; i < ldif->nlines; i++ ) {
+			if ( (op = ropenldap_ldif_mod_op(items[i].type)) < 0 )
+				ropenldap_ldif_parse_error( ldif, "expected add, delete, replace, or increment" );
+
+			/* The section's header carries its type and operation, but no value */
+			header = nitems;
+			items[ nitems ].type = items[ i ].value.bv_val;
+			items[ nitems ].value.bv_val = NULL;
+			items[ nitems ].value.bv_len = 0;
+			items[ nitems ].op = op;
+			items[ nitems ].group = ngroups;
+			nitems++;
+
+			for ( i++; i < ldif->nlines && strcmp(items[i].type, "-") != 0; i++ ) {
+				if ( strcasecmp(items[i].type, items[header].type) != 0 )
+					ropenldap_ldif_parse_error( ldif, "value for the wrong attribute" );
+
+				items[ nitems ] = items[ i ];
+				items[ nitems ].op = op;
+				items[ nitems ].group = ngroups;
+				nitems++;
+			}
+
+			ngroups++;
+		}
+
+		if ( !ngroups ) ropenldap_ldif_parse_error( ldif, "modify record without changes" );
+		record->mods = ropenldap_ldif_build_mods( ldif, nitems, ngroups );
+	}
+
+	else if ( strcasecmp(changetype, "delete") == 0 ) {
+		record->changetype = ROPENLDAP_LDIF_DELETE;
+	}
+
+	else if ( strcasecmp(changetype, "modrdn") == 0 || strcasecmp(changetype, "moddn") == 0 ) {
+		record->changetype = ROPENLDAP_LDIF_MODRDN;
+
+		for ( i = first; i < ldif->nlines; i++ ) {
+			if ( strcasecmp(items[i].type, "newrdn") == 0 )
+				record->newrdn = items[i].value.bv_val;
+			else if ( strcasecmp(items[i].type, "deleteoldrdn") == 0 )
+				record->deleteoldrdn = ( items[i].value.bv_val[0] == '1' );
+			else if ( strcasecmp(items[i].type, "newsuperior") == 0 )
+				record->newsuperior = items[i].value.bv_val;
+			else
+				ropenldap_ldif_parse_error( ldif, "unexpected line in a modrdn record" );
+		}
+
+		if ( !record->newrdn ) ropenldap_ldif_parse_error( ldif, "modrdn record without a newrdn" );
+	}
+
+	else {
+		ropenldap_ldif_parse_error( ldif, "unknown changetype" );
+	}
+}
+
+
+/*
+ * Return a new Ruby String for the +len+ bytes at +ptr+, tagged as UTF-8 if
+ * they're valid UTF-8 and as binary otherwise.
+ */
+static VALUE
+ropenldap_ldif_rb_value( const char *ptr, long len )
+{
+	VALUE str = rb_enc_str_new( ptr, len, rb_utf8_encoding() );
+
+	if ( rb_enc_str_coderange(str) == ENC_CODERANGE_BROKEN )
+		rb_enc_associate( str, rb_ascii8bit_encoding() );
+
+	return str;
+}
+
+
+/*
+ * Return a new Ruby Array of the values of the NULL-terminated +values+.
+ */
+static VALUE
+ropenldap_ldif_rb_values( struct berval **values )
+{
+	VALUE ary = rb_ary_new();
+
+	for ( ; *values; values++ )
+		rb_ary_push( ary, ropenldap_ldif_rb_value((*values)->bv_val, (long)(*values)->bv_len) );
+
+	return ary;
+}
+
+
+/*
+ * Return the Symbol for the LDAP_MOD_* operation +op+.
+ */
+static VALUE
+ropenldap_ldif_rb_mod_op( int op )
+{
+	switch ( op & ~LDAP_MOD_BVALUES ) {
+		case LDAP_MOD_ADD:       return ID2SYM( id_add );
+		case LDAP_MOD_DELETE:    return ID2SYM( id_delete );
+		case LDAP_MOD_REPLACE:   return ID2SYM( id_replace );
+		case LDAP_MOD_INCREMENT: return ID2SYM( id_increment );
+		default:                 return Qnil;
+	}
+}
+
+
+/*
+ * Return the Ruby form of the data of the parsed +record+ for LDIF#each_record.
+ */
+static VALUE
+ropenldap_ldif_rb_record_data( struct ropenldap_ldif_record *record )
+{
+	VALUE data = Qnil;
+	LDAPMod **mod;
+
+	switch ( record->changetype ) {
+		case ROPENLDAP_LDIF_ADD:
+			data = rb_hash_new();
+			for ( mod = record->mods; *mod; mod++ )
+				rb_hash_aset( data, ropenldap_attr_name((*mod)->mod_type, strlen((*mod)->mod_type), NULL),
+				              ropenldap_ldif_rb_values((*mod)->mod_bvalues) );
+			break;
+
+		case ROPENLDAP_LDIF_MODIFY:
+			data = rb_ary_new();
+			for ( mod = record->mods; *mod; mod++ )
+				rb_ary_push( data, rb_ary_new3(3, ropenldap_ldif_rb_mod_op((*mod)->mod_op),
+				                               ropenldap_attr_name((*mod)->mod_type,
+				                                                   strlen((*mod)->mod_type), NULL),
+				                               ropenldap_ldif_rb_values((*mod)->mod_bvalues)) );
+			break;
+
+		case ROPENLDAP_LDIF_DELETE:
+			break;
+
+		case ROPENLDAP_LDIF_MODRDN:
+			data = rb_hash_new();
+			rb_hash_aset( data, sym_newrdn,
+			              ropenldap_ldif_rb_value(record->newrdn, (long)strlen(record->newrdn)) );
+			rb_hash_aset( data, sym_delete_old_rdn, record->deleteoldrdn ? Qtrue : Qfalse );
+			rb_hash_aset( data, sym_newsuperior, record->newsuperior ?
+			              ropenldap_ldif_rb_value(record->newsuperior,
+			                                      (long)strlen(record->newsuperior)) :
+			              Qnil );
+			break;
+	}
+
+	return data;
+}
+
+
+/*
+ * Return the Symbol for the changetype of the parsed +record+.
+ */
+static VALUE
+ropenldap_ldif_rb_changetype( struct ropenldap_ldif_record *record )
+{
+	switch ( record->changetype ) {
+		case ROPENLDAP_LDIF_ADD:    return ID2SYM( id_add );
+		case ROPENLDAP_LDIF_MODIFY: return ID2SYM( id_modify );
+		case ROPENLDAP_LDIF_DELETE: return ID2SYM( id_delete );
+		case ROPENLDAP_LDIF_MODRDN: return ID2SYM( id_modrdn );
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * Return the name of the operation for the given +changetype+.
+ */
+static const char *
+ropenldap_ldif_op_name( enum ropenldap_ldif_changetype changetype )
+{
+	switch ( changetype ) {
+		case ROPENLDAP_LDIF_ADD:    return "add";
+		case ROPENLDAP_LDIF_MODIFY: return "modify";
+		case ROPENLDAP_LDIF_DELETE: return "delete";
+		case ROPENLDAP_LDIF_MODRDN: return "modrdn";
+	}
+
+	return "unknown";
+}
+
+
+
+/* --------------------------------------------------------------
+ * Loading
+ * -------------------------------------------------------------- */
+
+/*
+ * Record the failure of the operation for the record at +lineno+ with the given
+ * +dn+, with the LDAP result code +err+ and +message+.
+ */
+static void
+ropenldap_ldif_load_failed( struct ropenldap_ldif_load *load, const char *dn, long lineno,
+                            int err, const char *message )
+{
+	VALUE exception_class, error, rb_dn;
+
+	load->failed++;
+
+	exception_class =
+		rb_funcall( ropenldap_eOpenLDAPError, id_subclass_for, 1, INT2FIX(err) );
+	error = rb_exc_new_cstr( exception_class, message );
+	rb_dn = ropenldap_ldif_rb_value( dn, (long)strlen(dn) );
+
+	ropenldap_log_obj( load->self, "debug", "Record at line %ld (%s) failed: %s",
+	                   lineno, dn, message );
+
+	if ( rb_block_given_p() ) {
+		rb_yield_values( 3, rb_dn, error, LONG2NUM(lineno) );
+	} else {
+		rb_ary_push( load->errors, rb_ary_new3(3, rb_dn, error, LONG2NUM(lineno)) );
+	}
+}
+
+
+/*
+ * Wait for the next outstanding operation of the load to finish, and record its
+ * outcome.
+ */
+static void
+ropenldap_ldif_load_reap( struct ropenldap_ldif_load *load )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( load->connection );
+	struct ropenldap_ldif_pending pending;
+	char errmsg[ BUFSIZ ], *diagnostic = NULL;
+	int res, msgid, err = LDAP_SUCCESS;
+	VALUE dn;
+	long i;
+
+	for ( ;; ) {
+		res = ropenldap_wait_for_result( load->connection, LDAP_RES_ANY, LDAP_MSG_ONE, NULL,
+		                                 &load->msg );
+		if ( res <= 0 )
+			ropenldap_check_result( res ? res : LDAP_TIMEOUT, "ldap_result(%p, ANY, ...)", ldap );
+
+		msgid = ldap_msgid( load->msg );
+		for ( i = 0; i < load->npending; i++ )
+			if ( load->pending[i].msgid == msgid ) break;
+
+		if ( i < load->npending ) break;
+
+		ldap_msgfree( load->msg );
+		load->msg = NULL;
+		ropenldap_check_foreign_message( load->connection, msgid, res, "load" );
+	}
+
+	/* Keep the pending array dense by moving the last entry into the hole */
+	pending = load->pending[ i ];
+	load->pending[ i ] = load->pending[ --load->npending ];
+
+	res = ldap_parse_result( ldap, load->msg, &err, NULL, &diagnostic, NULL, NULL, 1 );
+	load->msg = NULL;
+	if ( res != LDAP_SUCCESS ) err = res;
+
+	if ( err == LDAP_SUCCESS ) {
+		load->succeeded++;
+		xfree( pending.dn );
+	} else {
+		snprintf( errmsg, BUFSIZ, "%s: %s", ropenldap_ldif_op_name(pending.changetype),
+		          diagnostic && *diagnostic ? diagnostic : ldap_err2string(err) );
+		if ( diagnostic ) ldap_memfree( diagnostic );
+
+		/* Copy the DN so it isn't leaked if the error handler raises */
+		dn = rb_str_new_cstr( pending.dn );
+		xfree( pending.dn );
+		ropenldap_ldif_load_failed( load, RSTRING_PTR(dn), pending.lineno, err, errmsg );
+		RB_GC_GUARD( dn );
+		return;
+	}
+
+	if ( diagnostic ) ldap_memfree( diagnostic );
+}
+
+
+/*
+ * Send the operation for the parsed +record+, waiting for earlier ones to finish
+ * first if the window is full.
+ */
+static void
+ropenldap_ldif_load_send( struct ropenldap_ldif_load *load, struct ropenldap_ldif_record *record )
+{
+	LDAP *ldap = ropenldap_conn_get_ldap( load->connection );
+	struct ropenldap_ldif_pending *pending;
+	int res = LDAP_SUCCESS, msgid = 0;
+
+	while ( load->npending >= load->window )
+		ropenldap_ldif_load_reap( load );
+
+	load->records++;
+
+	if ( record->critical_control ) {
+		char errmsg[ BUFSIZ ];
+		snprintf( errmsg, BUFSIZ, "%s: unsupported critical control %s",
+		          ropenldap_ldif_op_name(record->changetype), record->critical_control );
+		ropenldap_ldif_load_failed( load, record->dn, record->lineno,
+		                            LDAP_UNAVAILABLE_CRITICAL_EXTENSION, errmsg );
+		return;
+	}
+
+	switch ( record->changetype ) {
+		case ROPENLDAP_LDIF_ADD:
+			res = ldap_add_ext( ldap, record->dn, record->mods, NULL, NULL, &msgid );
+			break;
+		case ROPENLDAP_LDIF_MODIFY:
+			res = ldap_modify_ext( ldap, record->dn, record->mods, NULL, NULL, &msgid );
+			break;
+		case ROPENLDAP_LDIF_DELETE:
+			res = ldap_delete_ext( ldap, record->dn, NULL, NULL, &msgid );
+			break;
+		case ROPENLDAP_LDIF_MODRDN:
+			res = ldap_rename( ldap, record->dn, record->newrdn, record->newsuperior,
+			                   record->deleteoldrdn, NULL, NULL, &msgid );
+			break;
+	}
+
+	if ( res == LDAP_SERVER_DOWN || res == LDAP_CONNECT_ERROR )
+		ropenldap_check_result( res, "ldif %s( %s )",
+		                        ropenldap_ldif_op_name(record->changetype), record->dn );
+
+	/* Requests which can't even be sent are reported like ones the server refused */
+	if ( res != LDAP_SUCCESS ) {
+		char errmsg[ BUFSIZ ];
+		snprintf( errmsg, BUFSIZ, "%s: %s", ropenldap_ldif_op_name(record->changetype),
+		          ldap_err2string(res) );
+		ropenldap_ldif_load_failed( load, record->dn, record->lineno, res, errmsg );
+		return;
+	}
+
+	pending = &load->pending[ load->npending++ ];
+	pending->msgid      = msgid;
+	pending->lineno     = record->lineno;
+	pending->changetype = record->changetype;
+	pending->dn         = ALLOC_N( char, strlen(record->dn) + 1 );
+	strcpy( pending->dn, record->dn );
+}
+
+
+/*
+ * Read each record and send it on the connection; the body of LDIF#load.
+ */
+static VALUE
+ropenldap_ldif_load_body( VALUE arg )
+{
+	struct ropenldap_ldif_load *load = (struct ropenldap_ldif_load *)arg;
+	struct ropenldap_ldif *ldif = ropenldap_get_ldif( load->self );
+	struct ropenldap_ldif_record record;
+
+	while ( ropenldap_ldif_read_record(ldif) ) {
+		ropenldap_ldif_parse_record( ldif, &record );
+		if ( record.dn ) ropenldap_ldif_load_send( load, &record );
+	}
+
+	while ( load->npending )
+		ropenldap_ldif_load_reap( load );
+
+	return Qnil;
+}
+
+
+/*
+ * Free the state of LDIF#load, abandoning any operations that are still
+ * outstanding if it stopped early.
+ */
+static VALUE
+ropenldap_ldif_load_ensure( VALUE arg )
+{
+	struct ropenldap_ldif_load *load = (struct ropenldap_ldif_load *)arg;
+	LDAP *ldap = ropenldap_conn_get_ldap( load->connection );
+	long i;
+
+	if ( load->msg ) ldap_msgfree( load->msg );
+
+	for ( i = 0; i < load->npending; i++ ) {
+		ropenldap_log_obj( load->self, "debug", "Abandoning unfinished operation %d",
+		                   load->pending[i].msgid );
+		ldap_abandon_ext( ldap, load->pending[i].msgid, NULL, NULL );
+		xfree( load->pending[i].dn );
+	}
+
+	xfree( load->pending );
+
+	return Qnil;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Class methods
+ * -------------------------------------------------------------- */
+
+/*
+ * Allocation function
+ */
+static VALUE
+ropenldap_ldif_s_allocate( VALUE klass )
+{
+	struct ropenldap_ldif *ptr;
+	VALUE self = TypedData_Make_Struct( klass, struct ropenldap_ldif, &ropenldap_ldif_type, ptr );
+
+	ptr->io = Qnil;
+	ptr->chunk = Qnil;
+
+	return self;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::LDIF.new( io )   -> ldif
+ *
+ * Create a new LDIF reader that will read records from the given +io+, which can
+ * be any object that responds to #read( length, buffer ) like IO and StringIO.
+ *
+ */
+static VALUE
+ropenldap_ldif_initialize( VALUE self, VALUE io )
+{
+	struct ropenldap_ldif *ptr = check_ldif( self );
+
+	if ( !NIL_P(ptr->io) )
+		rb_raise( ropenldap_eOpenLDAPError, "Cannot re-initialize a LDIF object." );
+	if ( !rb_respond_to(io, id_read) )
+		rb_raise( rb_eTypeError, "can't read LDIF from %"PRIsVALUE, rb_obj_class(io) );
+
+	ptr->io = io;
+	ptr->chunk = rb_str_buf_new( ROPENLDAP_LDIF_CHUNK );
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    ldif.io   -> io
+ *
+ * Return the IO the records are being read from.
+ *
+ */
+static VALUE
+ropenldap_ldif_io( VALUE self )
+{
+	return ropenldap_get_ldif( self )->io;
+}
+
+
+/*
+ * call-seq:
+ *    ldif.lineno   -> integer
+ *
+ * Return the number of lines that have been read so far.
+ *
+ */
+static VALUE
+ropenldap_ldif_lineno( VALUE self )
+{
+	return LONG2NUM( ropenldap_get_ldif(self)->lineno );
+}
+
+
+/*
+ * call-seq:
+ *    ldif.each_record {|changetype, dn, data| ... }   -> ldif
+ *
+ * Read the records that are left in the LDIF one at a time, yielding the
+ * +changetype+ (one of :add, :modify, :delete, or :modrdn), the +dn+, and the
+ * record's +data+, which is:
+ *
+ * [:add]     a Hash of attribute names to Arrays of values
+ * [:modify]  an Array of [ op, attribute, [values] ] triples, where +op+ is one of
+ *            :add, :delete, :replace, or :increment
+ * [:delete]  +nil+
+ * [:modrdn]  a Hash with the :newrdn, :delete_old_rdn, and :newsuperior of the
+ *            record
+ *
+ * Values are UTF-8 Strings, unless they aren't valid UTF-8, in which case they're
+ * binary (ASCII-8BIT). The records' controls aren't included. Raises an OpenLDAP::LDIF::ParseError if a record is
+ * malformed.
+ *
+ */
+static VALUE
+ropenldap_ldif_each_record( VALUE self )
+{
+	struct ropenldap_ldif *ptr = ropenldap_get_ldif( self );
+	struct ropenldap_ldif_record record;
+
+	RETURN_ENUMERATOR( self, 0, 0 );
+
+	while ( ropenldap_ldif_read_record(ptr) ) {
+		ropenldap_ldif_parse_record( ptr, &record );
+		if ( !record.dn ) continue;
+
+		rb_yield_values( 3, ropenldap_ldif_rb_changetype(&record),
+		                 ropenldap_ldif_rb_value(record.dn, (long)strlen(record.dn)),
+		                 ropenldap_ldif_rb_record_data(&record) );
+	}
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    ldif.load( connection, window=32 )                          -> stats
+ *    ldif.load( connection, window=32 ) {|dn, error, lineno| ... }  -> stats
+ *
+ * Send the records that are left in the LDIF as write operations on the
+ * +connection+, keeping up to +window+ of them outstanding at once. Records are
+ * sent straight from the reader's buffers, so no Ruby objects are created for
+ * records that succeed. If a block is given, it's called with the +dn+, exception,
+ * and starting line number of each record that fails; otherwise they're returned
+ * as the :errors of the resulting Hash of counts.
+ *
+ * The controls of records aren't sent: records with a critical one fail with an
+ * OpenLDAP::UnavailableCriticalExtension (RFC 2849), and any others are ignored.
+ *
+ * Loading stops with an OpenLDAP::LDIF::ParseError at the first malformed record,
+ * after any operations that are outstanding have been abandoned. No other
+ * operations can be outstanding on the +connection+ during the load, since the
+ * responses are read as they arrive: if one to another operation arrives, an
+ * OpenLDAP::Error is raised.
+ *
+ */
+static VALUE
+ropenldap_ldif_load( int argc, VALUE *argv, VALUE self )
+{
+	struct ropenldap_ldif_load load;
+	VALUE connection, window = Qnil, stats;
+
+	rb_scan_args( argc, argv, "11", &connection, &window );
+	ropenldap_get_ldif( self );
+	ropenldap_conn_get_ldap( connection );
+
+	memset( &load, 0, sizeof(load) );
+	load.self       = self;
+	load.connection = connection;
+	load.window     = NIL_P( window ) ? ROPENLDAP_LDIF_WINDOW : NUM2LONG( window );
+	load.errors     = rb_ary_new();
+
+	if ( load.window < 1 ) rb_raise( rb_eArgError, "window must be at least 1" );
+	load.pending = ALLOC_N( struct ropenldap_ldif_pending, load.window );
+
+	rb_ensure( ropenldap_ldif_load_body, (VALUE)&load, ropenldap_ldif_load_ensure, (VALUE)&load );
+
+	stats = rb_hash_new();
+	rb_hash_aset( stats, sym_records, LONG2NUM(load.records) );
+	rb_hash_aset( stats, sym_succeeded, LONG2NUM(load.succeeded) );
+	rb_hash_aset( stats, sym_failed, LONG2NUM(load.failed) );
+	if ( !rb_block_given_p() ) rb_hash_aset( stats, sym_errors, load.errors );
+
+	return stats;
+}
+
+
+
+/*
+ * document-class: OpenLDAP::LDIF
+ */
+void
+ropenldap_init_ldif( void )
+{
+	const char *b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	int i;
+
+	ropenldap_log( "debug", "Initializing OpenLDAP::LDIF" );
+
+	memset( ropenldap_b64_table, -1, sizeof(ropenldap_b64_table) );
+	for ( i = 0; b64[i]; i++ )
+		ropenldap_b64_table[ (unsigned char)b64[i] ] = (signed char)i;
+
+	id_read      = rb_intern( "read" );
+	id_subclass_for = rb_intern( "subclass_for" );
+	id_add       = rb_intern( "add" );
+	id_modify    = rb_intern( "modify" );
+	id_delete    = rb_intern( "delete" );
+	id_modrdn    = rb_intern( "modrdn" );
+	id_replace   = rb_intern( "replace" );
+	id_increment = rb_intern( "increment" );
+
+	sym_newrdn         = ID2SYM( rb_intern("newrdn") );
+	sym_delete_old_rdn = ID2SYM( rb_intern("delete_old_rdn") );
+	sym_newsuperior    = ID2SYM( rb_intern("newsuperior") );
+	sym_records        = ID2SYM( rb_intern("records") );
+	sym_succeeded      = ID2SYM( rb_intern("succeeded") );
+	sym_failed         = ID2SYM( rb_intern("failed") );
+	sym_errors         = ID2SYM( rb_intern("errors") );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::LDIF */
+	ropenldap_cOpenLDAPLDIF = rb_define_class_under( ropenldap_mOpenLDAP, "LDIF", rb_cObject );
+	rb_define_alloc_func( ropenldap_cOpenLDAPLDIF, ropenldap_ldif_s_allocate );
+
+	/* Exception raised for malformed LDIF */
+	ropenldap_eOpenLDAPLDIFParseError =
+		rb_define_class_under( ropenldap_cOpenLDAPLDIF, "ParseError", ropenldap_eOpenLDAPError );
+
+	rb_define_method( ropenldap_cOpenLDAPLDIF, "initialize", ropenldap_ldif_initialize, 1 );
+	rb_define_method( ropenldap_cOpenLDAPLDIF, "io", ropenldap_ldif_io, 0 );
+	rb_define_method( ropenldap_cOpenLDAPLDIF, "lineno", ropenldap_ldif_lineno, 0 );
+	rb_define_method( ropenldap_cOpenLDAPLDIF, "each_record", ropenldap_ldif_each_record, 0 );
+	rb_define_method( ropenldap_cOpenLDAPLDIF, "load", ropenldap_ldif_load, -1 );
+
+	rb_require( "openldap/ldif" );
+}
+
@@ -50,47 +50,34 @@
 VALUE ropenldap_cOpenLDAPMessage;
 
 
+/* The number of attribute/values pairs to buffer on the stack before inserting
+ * them into an entry's Hash */
+#define ROPENLDAP_ATTR_PAIRS 32
 
-/* --------------------------------------------------------------
- * Global functions
- * -------------------------------------------------------------- */
+/* State for decoding a single entry */
+struct ropenldap_entry_decoder {
+	LDAP        *ldap;
+	LDAPMessage *entry;
+	BerElement  *ber;
+	VALUE       schema;
+	long        size_hint;
+	VALUE       dn;
+	VALUE       attrs;
+};
 
-static void ropenldap_message_gc_mark( struct ropenldap_message * );
-static void ropenldap_message_gc_free( struct ropenldap_message * );
 
-/*
- * Message constructor
- */
-VALUE
-ropenldap_new_message( VALUE conn, LDAPMessage *msg )
-{
-	struct ropenldap_message *ptr = ALLOC( struct ropenldap_message );
-	LDAP *ldap = ropenldap_conn_get_ldap( conn );
-	LDAPMessage *msg_iter = ldap_first_message( ldap, msg );
 
-	while ( msg_iter != NULL ) {
-		ropenldap_log( "debug", "Message ptr of type %x: %p", ldap_msgtype(msg_iter), msg_iter );
-		msg_iter = ldap_next_message( ldap, msg_iter );
-	}
-
-	ptr->connection = conn;
-	ptr->msg        = msg;
-
-	return Data_Wrap_Struct( ropenldap_cOpenLDAPMessage, ropenldap_message_gc_free,
-	                         ropenldap_message_gc_mark, ptr );
-}
-
-
-/* --------------------------------------------------
- *	Memory-management functions
- * -------------------------------------------------- */
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
 
 /*
  * GC Mark function
  */
 static void
-ropenldap_message_gc_mark( struct ropenldap_message *ptr )
+ropenldap_message_gc_mark( void *data )
 {
+	struct ropenldap_message *ptr = data;
 	if ( ptr ) rb_gc_mark( ptr->connection );
 }
 
@@ -100,9 +87,18 @@ ropenldap_message_gc_mark( struct ropenldap_message *ptr )
  * GC Free function
  */
 static void
-ropenldap_message_gc_free( struct ropenldap_message *ptr )
+ropenldap_message_gc_free( void *data )
 {
+	struct ropenldap_message *ptr = data;
+
 	if ( ptr ) {
+		if ( ptr->msg ) {
+			ldap_msgfree( ptr->msg );
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+			rb_gc_adjust_memory_usage( -(ssize_t)ptr->size );
+#endif
+		}
+
 		ptr->connection = Qnil;
 		ptr->msg        = NULL;
 
@@ -112,20 +108,92 @@ ropenldap_message_gc_free( struct ropenldap_message *ptr )
 }
 
 
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_message_gc_size( const void *data )
+{
+	const struct ropenldap_message *ptr = data;
+	return sizeof( struct ropenldap_message ) + ( ptr ? ptr->size : 0 );
+}
+
+
+static const rb_data_type_t ropenldap_message_type = {
+	"OpenLDAP::Message",
+	{
+		ropenldap_message_gc_mark,
+		ropenldap_message_gc_free,
+		ropenldap_message_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Return the number of bytes of BER data in the message chain +msg+.
+ */
+static size_t
+ropenldap_message_ber_size( LDAP *ldap, LDAPMessage *msg )
+{
+	LDAPMessage *msg_iter;
+	BerElement *ber;
+	ber_len_t len;
+	size_t size = 0;
+
+	for ( msg_iter = ldap_first_message( ldap, msg );
+	      msg_iter != NULL;
+	      msg_iter = ldap_next_message( ldap, msg_iter ) )
+	{
+		ropenldap_log( "debug", "Message ptr of type %x: %p", ldap_msgtype(msg_iter), msg_iter );
+
+		len = 0;
+		ber = ldap_get_message_ber( msg_iter );
+		if ( ber && ber_get_option(ber, LBER_OPT_TOTAL_BYTES, &len) == LBER_OPT_SUCCESS )
+			size += len;
+	}
+
+	return size;
+}
+
+
+/*
+ * Message constructor; the message takes ownership of +msg+, and frees it when
+ * it's garbage-collected.
+ */
+VALUE
+ropenldap_new_message( VALUE conn, LDAPMessage *msg )
+{
+	struct ropenldap_message *ptr;
+	LDAP *ldap = ropenldap_conn_get_ldap( conn );
+	VALUE message = TypedData_Make_Struct( ropenldap_cOpenLDAPMessage, struct ropenldap_message,
+	                                       &ropenldap_message_type, ptr );
+
+	ptr->connection = conn;
+	ptr->msg        = msg;
+	ptr->size       = ropenldap_message_ber_size( ldap, msg );
+
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+	rb_gc_adjust_memory_usage( (ssize_t)ptr->size );
+#endif
+
+	return message;
+}
+
+
 /*
  * Object validity checker. Returns the data pointer.
  */
 static struct ropenldap_message *
 check_message( VALUE self )
 {
-	Check_Type( self, T_DATA );
-
-    if ( !IsMessage(self) ) {
-		rb_raise( rb_eTypeError, "wrong argument type %s (expected an OpenLDAP::Message)",
-				  rb_obj_classname( self ) );
-    }
-
-	return DATA_PTR( self );
+	return rb_check_typeddata( self, &ropenldap_message_type );
 }
 
 
@@ -144,6 +212,31 @@ ropenldap_get_message( VALUE self )
 
 
 
+/*
+ * Fetch the LDAP handle of the connection the OpenLDAP::Message +message+ was
+ * received on.
+ */
+LDAP *
+ropenldap_message_get_ldap( VALUE message )
+{
+	struct ropenldap_message *ptr = ropenldap_get_message( message );
+	return ropenldap_conn_get_ldap( ptr->connection );
+}
+
+
+/*
+ * Fetch the OpenLDAP::Schema values are decoded with for the connection the
+ * OpenLDAP::Message +message+ was received on, or +nil+ if they aren't.
+ */
+VALUE
+ropenldap_message_get_schema( VALUE message )
+{
+	struct ropenldap_message *ptr = ropenldap_get_message( message );
+	return ropenldap_conn_get_schema( ptr->connection );
+}
+
+
+
 /* --------------------------------------------------------------
  * Instance methods
  * -------------------------------------------------------------- */
@@ -163,6 +256,212 @@ ropenldap_message_count( VALUE self )
 }
 
 
+/*
+ * Create a new Array of values from the given NULL-terminated array of +values+
+ * of an attribute with the ROPENLDAP_ATTR_* +flags+, decoded as the
+ * ropenldap_value_type +type+.
+ */
+static VALUE
+ropenldap_rb_berval_array( struct berval *values, int flags, int type )
+{
+	VALUE ary;
+	long count = 0, i;
+
+	if ( !values ) return rb_ary_new();
+
+	while ( values[count].bv_val ) count++;
+	ary = rb_ary_new_capa( count );
+
+	for ( i = 0; i < count; i++ )
+		rb_ary_push( ary, ropenldap_typed_value(type, values[i].bv_val, values[i].bv_len, flags) );
+
+	return ary;
+}
+
+
+/*
+ * Insert the +count+ attribute/values pairs in +pairs+ into the given +hash+.
+ */
+static void
+ropenldap_hash_insert_pairs( VALUE hash, VALUE *pairs, long count )
+{
+#ifdef HAVE_RB_HASH_BULK_INSERT
+	rb_hash_bulk_insert( count, pairs, hash );
+#else
+	long i;
+
+	for ( i = 0; i < count; i += 2 )
+		rb_hash_aset( hash, pairs[i], pairs[i + 1] );
+#endif
+}
+
+
+/*
+ * Decode the DN and attributes of the entry in the given +decoder+ (cast to a
+ * VALUE for rb_ensure).
+ */
+static VALUE
+ropenldap_message_decode_entry_body( VALUE ptr )
+{
+	struct ropenldap_entry_decoder *decoder = (struct ropenldap_entry_decoder *)ptr;
+	rb_encoding *utf8 = rb_utf8_encoding();
+	struct berval dn = BER_BVNULL, attr = BER_BVNULL;
+	struct berval *values = NULL;
+	VALUE pairs[ ROPENLDAP_ATTR_PAIRS * 2 ];
+	long count = 0, total = 0;
+	int res, flags = 0, type;
+
+	res = ldap_get_dn_ber( decoder->ldap, decoder->entry, &decoder->ber, &dn );
+	ropenldap_check_result( res, "ldap_get_dn_ber" );
+	decoder->dn = rb_enc_str_new( dn.bv_val, dn.bv_len, utf8 );
+
+#ifdef HAVE_RB_HASH_NEW_CAPA
+	decoder->attrs = rb_hash_new_capa( decoder->size_hint );
+#else
+	decoder->attrs = rb_hash_new();
+#endif
+
+	for ( res = ldap_get_attribute_ber(decoder->ldap, decoder->entry, decoder->ber, &attr, &values);
+	      res == LDAP_SUCCESS && attr.bv_val != NULL;
+	      res = ldap_get_attribute_ber(decoder->ldap, decoder->entry, decoder->ber, &attr, &values) )
+	{
+		pairs[ count++ ] = ropenldap_attr_name( attr.bv_val, attr.bv_len, &flags );
+		type = NIL_P( decoder->schema ) ? ROPENLDAP_VALUE_STRING :
+			ropenldap_schema_value_type( decoder->schema, attr.bv_val, attr.bv_len );
+		pairs[ count++ ] = ropenldap_rb_berval_array( values, flags, type );
+		ber_memfree( values );
+		values = NULL;
+		total++;
+
+		if ( count == ROPENLDAP_ATTR_PAIRS * 2 ) {
+			ropenldap_hash_insert_pairs( decoder->attrs, pairs, count );
+			count = 0;
+		}
+	}
+
+	ropenldap_check_result( res, "ldap_get_attribute_ber" );
+	ropenldap_hash_insert_pairs( decoder->attrs, pairs, count );
+	decoder->size_hint = total;
+
+	return Qnil;
+}
+
+
+/*
+ * Release the BerElement used for decoding the entry in the given +decoder+.
+ */
+static VALUE
+ropenldap_message_decode_entry_ensure( VALUE ptr )
+{
+	struct ropenldap_entry_decoder *decoder = (struct ropenldap_entry_decoder *)ptr;
+
+	if ( decoder->ber ) {
+		ber_free( decoder->ber, 0 );
+		decoder->ber = NULL;
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * Decode the DN and attributes of the given +entry+ into +dn+ and +attrs+, decoding
+ * values with the OpenLDAP::Schema +schema+ unless it's +nil+.
+ * +size_hint+ is the number of attributes to size the Hash for; it's updated
+ * with the number of attributes the entry had, so it can be passed back in for
+ * the next entry of a search.
+ */
+void
+ropenldap_decode_entry( LDAP *ldap, LDAPMessage *entry, VALUE schema, long *size_hint,
+                        VALUE *dn, VALUE *attrs )
+{
+	struct ropenldap_entry_decoder decoder;
+
+	decoder.ldap      = ldap;
+	decoder.entry     = entry;
+	decoder.schema    = schema;
+	decoder.ber       = NULL;
+	decoder.size_hint = *size_hint;
+	decoder.dn        = Qnil;
+	decoder.attrs     = Qnil;
+
+	rb_ensure( ropenldap_message_decode_entry_body, (VALUE)&decoder,
+	           ropenldap_message_decode_entry_ensure, (VALUE)&decoder );
+
+	*size_hint = decoder.size_hint;
+	*dn        = decoder.dn;
+	*attrs     = decoder.attrs;
+}
+
+
+/*
+ * call-seq:
+ *    message.each_entry {|dn, attributes| ... }   -> message
+ *    message.each_entry                            -> enumerator
+ *
+ * Call the block once for each entry in the message with its DN and a Hash of its
+ * attributes, keyed by attribute name, with Arrays of the attribute's values.
+ *
+ *    message.each_entry do |dn, attrs|
+ *      puts "%s: %p" % [ dn, attrs['cn'] ]
+ *    end
+ */
+static VALUE
+ropenldap_message_each_entry( VALUE self )
+{
+	struct ropenldap_message *ptr = ropenldap_get_message( self );
+	LDAP *ldap;
+	LDAPMessage *entry;
+	long size_hint = 0;
+	VALUE dn, attrs;
+
+	RETURN_ENUMERATOR( self, 0, 0 );
+
+	ldap = ropenldap_conn_get_ldap( ptr->connection );
+	for ( entry = ldap_first_entry( ldap, ptr->msg );
+	      entry != NULL;
+	      entry = ldap_next_entry( ldap, entry ) )
+	{
+		ropenldap_decode_entry( ldap, entry, ropenldap_conn_get_schema(ptr->connection),
+		                        &size_hint, &dn, &attrs );
+		rb_yield_values( 2, dn, attrs );
+	}
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    message.entries   -> array
+ *
+ * Return the entries in the message as an Array of OpenLDAP::Entry objects. The
+ * entries' attributes are decoded when they're read, and each entry keeps the
+ * message alive.
+ *
+ *    message.entries.map( &:dn )
+ *    # => ["dc=example,dc=com", "cn=admin,dc=example,dc=com"]
+ */
+static VALUE
+ropenldap_message_entries( VALUE self )
+{
+	struct ropenldap_message *ptr = ropenldap_get_message( self );
+	LDAP *ldap = ropenldap_conn_get_ldap( ptr->connection );
+	int count = ldap_count_entries( ldap, ptr->msg );
+	VALUE entries = rb_ary_new_capa( count > 0 ? count : 0 );
+	LDAPMessage *entry;
+
+	for ( entry = ldap_first_entry( ldap, ptr->msg );
+	      entry != NULL;
+	      entry = ldap_next_entry( ldap, entry ) )
+	{
+		rb_ary_push( entries, ropenldap_new_entry(self, entry) );
+	}
+
+	return entries;
+}
+
+
 /*
  * document-class: OpenLDAP::Message
  */
@@ -179,7 +478,11 @@ ropenldap_init_message( void )
 	ropenldap_cOpenLDAPMessage =
 		rb_define_class_under( ropenldap_mOpenLDAP, "Message", rb_cObject );
 
+	rb_undef_alloc_func( ropenldap_cOpenLDAPMessage );
+
 	rb_define_method( ropenldap_cOpenLDAPMessage, "count", ropenldap_message_count, 0 );
+	rb_define_method( ropenldap_cOpenLDAPMessage, "each_entry", ropenldap_message_each_entry, 0 );
+	rb_define_method( ropenldap_cOpenLDAPMessage, "entries", ropenldap_message_entries, 0 );
 
 	rb_require( "openldap/message" );
 }
@@ -47,19 +47,27 @@ VALUE ropenldap_eOpenLDAPError;
 
 VALUE ropenldap_rbmURI;
 
+/* The level of the OpenLDAP logger, cached so log calls below it can be skipped
+ * before doing any work */
+int ropenldap_log_level = ROPENLDAP_LOG_DEBUG;
+
+static ID id_log, id_logger, id_level;
+static ID ropenldap_log_level_ids[ ROPENLDAP_LOG_FATAL + 1 ];
+
 
 /* --------------------------------------------------------------
  * Logging Functions
  * -------------------------------------------------------------- */
 
 /*
- * Log a message to the given +context+ object's logger.
+ * Log a message to the given +context+ object's logger. This is called via the
+ * ropenldap_log_obj() macro, which skips it if +level+ isn't enabled.
  */
 void
 #ifdef HAVE_STDARG_PROTOTYPES
-ropenldap_log_obj( VALUE context, const char *level, const char *fmt, ... )
+ropenldap_do_log_obj( VALUE context, const char *level, const char *fmt, ... )
 #else
-ropenldap_log_obj( VALUE context, const char *level, const char *fmt, va_dcl )
+ropenldap_do_log_obj( VALUE context, const char *level, const char *fmt, va_dcl )
 #endif
 {
 	char buf[BUFSIZ];
@@ -67,25 +75,26 @@ ropenldap_log_obj( VALUE context, const char *level, const char *fmt, va_dcl )
 	VALUE logger = Qnil;
 	VALUE message = Qnil;
 
-	va_start( args, fmt );
+	va_init_list( args, fmt );
 	vsnprintf( buf, BUFSIZ, fmt, args );
 	message = rb_str_new2( buf );
 
-	logger = rb_funcall( context, rb_intern("log"), 0, 0 );
-	rb_funcall( logger, rb_intern(level), 1, message );
+	logger = rb_funcall( context, id_log, 0, 0 );
+	rb_funcall( logger, ropenldap_log_level_ids[ropenldap_log_level_for(level)], 1, message );
 
 	va_end( args );
 }
 
 
 /*
- * Log a message to the global logger.
+ * Log a message to the global logger. This is called via the ropenldap_log()
+ * macro, which skips it if +level+ isn't enabled.
  */
 void
 #ifdef HAVE_STDARG_PROTOTYPES
-ropenldap_log( const char *level, const char *fmt, ... )
+ropenldap_do_log( const char *level, const char *fmt, ... )
 #else
-ropenldap_log( const char *level, const char *fmt, va_dcl )
+ropenldap_do_log( const char *level, const char *fmt, va_dcl )
 #endif
 {
 	char buf[BUFSIZ];
@@ -97,13 +106,42 @@ ropenldap_log( const char *level, const char *fmt, va_dcl )
 	vsnprintf( buf, BUFSIZ, fmt, args );
 	message = rb_str_new2( buf );
 
-	logger = rb_funcall( ropenldap_mOpenLDAP, rb_intern("logger"), 0, 0 );
-	rb_funcall( logger, rb_intern(level), 1, message );
+	logger = rb_funcall( ropenldap_mOpenLDAP, id_logger, 0, 0 );
+	rb_funcall( logger, ropenldap_log_level_ids[ropenldap_log_level_for(level)], 1, message );
 
 	va_end( args );
 }
 
 
+/*
+ * call-seq:
+ *    OpenLDAP.cache_log_level   -> symbol
+ *
+ * Cache the level of the OpenLDAP logger in the extension so that log messages
+ * below it are skipped without being formatted. This is called automatically
+ * when the logger or its level is changed, and returns the cached level.
+ *
+ *    OpenLDAP.logger.level = :info
+ *    OpenLDAP.cache_log_level
+ *    # => :info
+ */
+static VALUE
+ropenldap_s_cache_log_level( VALUE module )
+{
+	VALUE logger = rb_funcall( module, id_logger, 0 );
+	VALUE level = rb_funcall( logger, id_level, 0 );
+
+	if ( FIXNUM_P(level) ) {
+		ropenldap_log_level = FIX2INT( level );
+	} else {
+		VALUE levelname = rb_obj_as_string( level );
+		ropenldap_log_level = ropenldap_log_level_for( StringValueCStr(levelname) );
+	}
+
+	return level;
+}
+
+
 /*
  * Raise an appropriate exception with an appropriate message for the given
  * resultcode.
@@ -153,6 +191,409 @@ ropenldap_rb_string_array( char **strings )
 
 
 
+/*
+ * Convert a NULL-terminated array of berval pointers (e.g., from ldap_get_values_len)
+ * to a Ruby Array of values for an attribute with the given ROPENLDAP_ATTR_* +flags+,
+ * decoded as the ropenldap_value_type +type+.
+ */
+VALUE
+ropenldap_rb_values_array( struct berval **values, int flags, int type )
+{
+	VALUE ary;
+	struct berval **iter;
+
+	/* If there aren't any values, just return the empty Array */
+	if ( !values ) return rb_ary_new();
+
+	ary = rb_ary_new_capa( ldap_count_values_len(values) );
+	for ( iter = values ; *iter != NULL ; iter++ ) {
+		rb_ary_push( ary, ropenldap_typed_value(type, (*iter)->bv_val, (*iter)->bv_len, flags) );
+	}
+
+	return ary;
+}
+
+
+/*
+ * The (lowercased) names of attributes whose values are octet strings or
+ * certificates rather than text, from RFCs 2798, 4517, 4519, and 4523 plus a few
+ * common extensions. Sorted for bsearch().
+ */
+static const char *ropenldap_binary_attributes[] = {
+	"audio",
+	"authorityrevocationlist",
+	"cacertificate",
+	"certificaterevocationlist",
+	"crosscertificatepair",
+	"deltarevocationlist",
+	"jpegphoto",
+	"krbprincipalkey",
+	"objectguid",
+	"objectsid",
+	"photo",
+	"supportedalgorithms",
+	"thumbnailphoto",
+	"usercertificate",
+	"userpassword",
+	"userpkcs12",
+	"usersmimecertificate",
+};
+
+/* bsearch() comparison function for looking up an attribute name */
+static int
+ropenldap_attr_key_cmp( const void *keyptr, const void *entryptr )
+{
+	const struct ropenldap_attr_key *key = keyptr;
+	const char *entry = *(const char **)entryptr;
+	size_t len = strlen( entry );
+	int cmp = strncasecmp( key->name, entry, key->len < len ? key->len : len );
+
+	if ( cmp == 0 && key->len != len ) return key->len < len ? -1 : 1;
+	return cmp;
+}
+
+
+/*
+ * Return the encoding values of the attribute +name+ (which is +len+ bytes long)
+ * should be tagged with: ASCII-8BIT for known binary attributes or any that were
+ * requested with the ";binary" option, and UTF-8 for everything else. Values are
+ * only tagged, never transcoded.
+ */
+rb_encoding *
+ropenldap_attr_encoding( const char *name, size_t len )
+{
+	struct ropenldap_attr_key key = { name, len };
+	const char *option = memchr( name, ';', len );
+
+	if ( option ) {
+		key.len = option - name;
+
+		while ( option ) {
+			const char *end = memchr( option + 1, ';', len - (option + 1 - name) );
+			size_t optlen = ( end ? end : name + len ) - option - 1;
+
+			if ( optlen == 6 && strncasecmp(option + 1, "binary", 6) == 0 )
+				return rb_ascii8bit_encoding();
+			option = end;
+		}
+	}
+
+	if ( bsearch(&key, ropenldap_binary_attributes,
+	             sizeof(ropenldap_binary_attributes) / sizeof(ropenldap_binary_attributes[0]),
+	             sizeof(ropenldap_binary_attributes[0]), ropenldap_attr_key_cmp) )
+		return rb_ascii8bit_encoding();
+
+	return rb_utf8_encoding();
+}
+
+
+/* --------------------------------------------------------------
+ * Attribute name table
+ * -------------------------------------------------------------- */
+
+/* The most attribute names the table will hold; names past this are still
+ * interned, just not remembered */
+#define ROPENLDAP_ATTR_NAMES_MAX 4096
+
+/* An attribute name the table knows about */
+struct ropenldap_attr_name {
+	struct ropenldap_attr_key key;   /* the name's bytes, for lookups */
+	VALUE name;                      /* the interned, frozen name */
+	int flags;                       /* ROPENLDAP_ATTR_* flags for its values */
+	char bytes[ 1 ];
+};
+
+/* Attribute names by name, matched case-insensitively */
+static st_table *ropenldap_attr_names;
+static VALUE ropenldap_attr_names_holder = Qnil;
+
+/* The names of the attributes whose values are interned */
+static VALUE ropenldap_interned_attributes = Qnil;
+
+static ID id_uminus;
+
+
+/* Hash the +key+ of an attribute name, ignoring ASCII case */
+static st_index_t
+ropenldap_attr_key_hash( st_data_t keyptr )
+{
+	const struct ropenldap_attr_key *key = (const struct ropenldap_attr_key *)keyptr;
+	st_index_t hash = 2166136261U;
+	size_t i;
+
+	for ( i = 0; i < key->len; i++ ) {
+		unsigned char c = (unsigned char)key->name[i];
+		if ( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+		hash = ( hash ^ c ) * 16777619U;
+	}
+
+	return hash;
+}
+
+
+/* Compare the keys of two attribute names, ignoring ASCII case */
+static int
+ropenldap_attr_key_eq( st_data_t a, st_data_t b )
+{
+	const struct ropenldap_attr_key *key1 = (const struct ropenldap_attr_key *)a,
+	                                *key2 = (const struct ropenldap_attr_key *)b;
+
+	if ( key1->len != key2->len ) return 1;
+	return strncasecmp( key1->name, key2->name, key1->len ) != 0;
+}
+
+
+const struct st_hash_type ropenldap_attr_key_type = {
+	ropenldap_attr_key_eq,
+	ropenldap_attr_key_hash,
+};
+
+
+/* st_foreach() callback for marking the names in the table; they're pinned so
+ * the table's references to them stay valid */
+static int
+ropenldap_attr_names_mark_i( st_data_t UNUSED(key), st_data_t value, st_data_t UNUSED(arg) )
+{
+	rb_gc_mark( ((struct ropenldap_attr_name *)value)->name );
+	return ST_CONTINUE;
+}
+
+
+static void
+ropenldap_attr_names_gc_mark( void *UNUSED(ptr) )
+{
+	if ( ropenldap_attr_names )
+		st_foreach( ropenldap_attr_names, ropenldap_attr_names_mark_i, 0 );
+}
+
+
+static const rb_data_type_t ropenldap_attr_names_type = {
+	"OpenLDAP::AttributeNames",
+	{
+		ropenldap_attr_names_gc_mark,
+		NULL,
+		NULL,
+	},
+	0, 0,
+	0,
+};
+
+
+/* Return a frozen String for the +len+ bytes at +ptr+ tagged with +enc+, shared with
+ * any other String with the same contents. */
+static VALUE
+ropenldap_interned_str( const char *ptr, size_t len, rb_encoding *enc )
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+	return rb_enc_interned_str( ptr, len, enc );
+#else
+	return rb_funcall( rb_enc_str_new(ptr, len, enc), id_uminus, 0 );
+#endif
+}
+
+
+/* Return the ROPENLDAP_ATTR_* flags for the attribute +name+ which is +len+ bytes
+ * long. */
+static int
+ropenldap_attr_flags( const char *name, size_t len )
+{
+	const char *option = memchr( name, ';', len );
+	size_t namelen = option ? (size_t)( option - name ) : len;
+	int flags = 0;
+	long i;
+
+	if ( ropenldap_attr_encoding(name, len) == rb_ascii8bit_encoding() )
+		flags |= ROPENLDAP_ATTR_BINARY;
+
+	for ( i = 0; i < RARRAY_LEN(ropenldap_interned_attributes); i++ ) {
+		VALUE interned = RARRAY_AREF( ropenldap_interned_attributes, i );
+		if ( (size_t)RSTRING_LEN(interned) == namelen &&
+		     strncasecmp(RSTRING_PTR(interned), name, namelen) == 0 )
+		{
+			flags |= ROPENLDAP_ATTR_INTERN_VALUES;
+			break;
+		}
+	}
+
+	return flags;
+}
+
+
+/* Look up the table's entry for the attribute +name+, adding it if it isn't
+ * there yet and the table isn't full. Returns NULL if it couldn't be added. */
+static struct ropenldap_attr_name *
+ropenldap_attr_name_entry( const char *name, size_t len )
+{
+	struct ropenldap_attr_key key = { name, len };
+	struct ropenldap_attr_name *entry = NULL;
+	st_data_t value;
+
+	if ( st_lookup(ropenldap_attr_names, (st_data_t)&key, &value) )
+		return (struct ropenldap_attr_name *)value;
+	if ( ropenldap_attr_names->num_entries >= ROPENLDAP_ATTR_NAMES_MAX )
+		return NULL;
+
+	entry = (struct ropenldap_attr_name *)xmalloc( sizeof(struct ropenldap_attr_name) + len );
+	memcpy( entry->bytes, name, len );
+	entry->bytes[ len ] = '\0';
+	entry->key.name = entry->bytes;
+	entry->key.len = len;
+	entry->flags = ropenldap_attr_flags( name, len );
+	entry->name = ropenldap_interned_str( name, len, rb_utf8_encoding() );
+	st_insert( ropenldap_attr_names, (st_data_t)&entry->key, (st_data_t)entry );
+
+	return entry;
+}
+
+
+/*
+ * Return the attribute name that's +len+ bytes at +name+ as an interned, frozen
+ * String, and set +flags+ (if it's not NULL) to the ROPENLDAP_ATTR_* flags for
+ * its values. Every entry with the same attribute shares the same String.
+ */
+VALUE
+ropenldap_attr_name( const char *name, size_t len, int *flags )
+{
+	struct ropenldap_attr_name *entry = ropenldap_attr_name_entry( name, len );
+
+	if ( !entry ) {
+		if ( flags ) *flags = ropenldap_attr_flags( name, len );
+		return ropenldap_interned_str( name, len, rb_utf8_encoding() );
+	}
+
+	if ( flags ) *flags = entry->flags;
+
+	/* The same attribute spelled with different case (e.g., as it was asked for)
+	 * keeps its own spelling */
+	if ( memcmp(entry->bytes, name, len) != 0 )
+		return ropenldap_interned_str( name, len, rb_utf8_encoding() );
+
+	return entry->name;
+}
+
+
+/*
+ * Return the interned name of the attribute +name+ to use as a key for looking it
+ * up; it's the same String for every spelling that only differs in case. Sets
+ * +flags+ like ropenldap_attr_name().
+ */
+VALUE
+ropenldap_attr_key( VALUE name, int *flags )
+{
+	struct ropenldap_attr_name *entry;
+
+	name = rb_obj_as_string( name );
+	entry = ropenldap_attr_name_entry( RSTRING_PTR(name), RSTRING_LEN(name) );
+
+	if ( !entry ) {
+		if ( flags ) *flags = ropenldap_attr_flags( RSTRING_PTR(name), RSTRING_LEN(name) );
+		return ropenldap_interned_str( RSTRING_PTR(name), RSTRING_LEN(name), rb_utf8_encoding() );
+	}
+
+	if ( flags ) *flags = entry->flags;
+	return entry->name;
+}
+
+
+/*
+ * Return a String for the +len+ bytes of an attribute value at +ptr+ for an
+ * attribute with the given ROPENLDAP_ATTR_* +flags+.
+ */
+VALUE
+ropenldap_attr_value( const char *ptr, size_t len, int flags )
+{
+	rb_encoding *enc = ( flags & ROPENLDAP_ATTR_BINARY ) ? rb_ascii8bit_encoding() : rb_utf8_encoding();
+
+	if ( flags & ROPENLDAP_ATTR_INTERN_VALUES )
+		return ropenldap_interned_str( ptr, len, enc );
+
+	return rb_enc_str_new( ptr, len, enc );
+}
+
+
+/* st_foreach() callback for updating the flags of the names in the table after
+ * the list of interned attributes changes */
+static int
+ropenldap_attr_names_reflag_i( st_data_t UNUSED(key), st_data_t value, st_data_t UNUSED(arg) )
+{
+	struct ropenldap_attr_name *entry = (struct ropenldap_attr_name *)value;
+
+	entry->flags = ropenldap_attr_flags( entry->bytes, entry->key.len );
+	return ST_CONTINUE;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP.interned_attributes   -> array
+ *
+ * Return the names of the attributes whose values are returned as interned,
+ * frozen Strings.
+ *
+ *    OpenLDAP.interned_attributes
+ *    # => ["objectClass"]
+ */
+static VALUE
+ropenldap_s_interned_attributes( VALUE UNUSED(module) )
+{
+	return ropenldap_interned_attributes;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP.interned_attributes = names
+ *
+ * Set the names of the attributes whose values are returned as interned, frozen
+ * Strings. Values of these attributes are shared by every entry that has them,
+ * so it's only worth doing for attributes with a small number of distinct values
+ * that appear in most entries, like +objectClass+.
+ *
+ *    OpenLDAP.interned_attributes = %w[objectClass employeeType departmentNumber]
+ */
+static VALUE
+ropenldap_s_interned_attributes_eq( VALUE UNUSED(module), VALUE names )
+{
+	VALUE ary = rb_ary_new();
+	long i;
+
+	names = rb_Array( names );
+	for ( i = 0; i < RARRAY_LEN(names); i++ ) {
+		VALUE name = rb_obj_as_string( RARRAY_AREF(names, i) );
+		rb_ary_push( ary, ropenldap_interned_str(RSTRING_PTR(name), RSTRING_LEN(name),
+		                                         rb_utf8_encoding()) );
+	}
+
+	ropenldap_interned_attributes = rb_obj_freeze( ary );
+	st_foreach( ropenldap_attr_names, ropenldap_attr_names_reflag_i, 0 );
+
+	return names;
+}
+
+
+/*
+ * Return +str+ as a String libldap can be handed as UTF-8. Strings which are
+ * already UTF-8, only contain ASCII, or are binary (and so assumed to hold bytes
+ * the caller already encoded) are returned as-is without being copied; anything
+ * else is transcoded.
+ */
+VALUE
+ropenldap_str_utf8( VALUE str )
+{
+	rb_encoding *enc;
+
+	StringValue( str );
+	enc = rb_enc_get( str );
+
+	if ( enc == rb_utf8_encoding() || enc == rb_ascii8bit_encoding() ||
+	     rb_enc_str_asciionly_p(str) )
+		return str;
+
+	return rb_str_encode( str, rb_enc_from_encoding(rb_utf8_encoding()), 0, Qnil );
+}
+
+
+
 /*
  * call-seq:
  *    OpenLDAP.split_url( str )   -> array
@@ -254,6 +695,29 @@ ropenldap_s_err2string( VALUE UNUSED(module), VALUE resultcode )
 }
 
 
+/*
+ * call-seq:
+ *    OpenLDAP.binary_attribute?( name )   -> true or false
+ *
+ * Returns +true+ if values of the attribute +name+ are returned as binary
+ * (ASCII-8BIT) Strings rather than UTF-8 ones, either because it's a known binary
+ * attribute or because it has the ";binary" option.
+ *
+ *    OpenLDAP.binary_attribute?( 'jpegPhoto' )           # => true
+ *    OpenLDAP.binary_attribute?( 'cn' )                  # => false
+ *    OpenLDAP.binary_attribute?( 'userSMIMECertificate;binary' )  # => true
+ */
+static VALUE
+ropenldap_s_binary_attribute_p( VALUE UNUSED(module), VALUE name )
+{
+	name = rb_obj_as_string( name );
+
+	if ( ropenldap_attr_encoding(RSTRING_PTR(name), RSTRING_LEN(name)) == rb_ascii8bit_encoding() )
+		return Qtrue;
+	return Qfalse;
+}
+
+
 /* Check to be sure the library that's dynamically-linked is the same
  * one it was compiled against. */
 static void
@@ -431,9 +895,30 @@ Init_openldap_ext( void )
 	rb_require( "uri" );
 	ropenldap_rbmURI = rb_const_get( rb_cObject, rb_intern("URI") );
 
+	id_log    = rb_intern_const( "log" );
+	id_logger = rb_intern_const( "logger" );
+	id_level  = rb_intern_const( "level" );
+	id_uminus = rb_intern_const( "-@" );
+
+	ropenldap_attr_names = st_init_table( &ropenldap_attr_key_type );
+	ropenldap_attr_names_holder = TypedData_Wrap_Struct( 0, &ropenldap_attr_names_type, NULL );
+	rb_gc_register_address( &ropenldap_attr_names_holder );
+	ropenldap_interned_attributes = rb_obj_freeze( rb_ary_new3(1, rb_str_new_cstr("objectClass")) );
+	rb_gc_register_address( &ropenldap_interned_attributes );
+
+	ropenldap_log_level_ids[ ROPENLDAP_LOG_DEBUG ] = rb_intern_const( "debug" );
+	ropenldap_log_level_ids[ ROPENLDAP_LOG_INFO ]  = rb_intern_const( "info" );
+	ropenldap_log_level_ids[ ROPENLDAP_LOG_WARN ]  = rb_intern_const( "warn" );
+	ropenldap_log_level_ids[ ROPENLDAP_LOG_ERROR ] = rb_intern_const( "error" );
+	ropenldap_log_level_ids[ ROPENLDAP_LOG_FATAL ] = rb_intern_const( "fatal" );
+
 	rb_require( "openldap" );
 	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
 
+	rb_define_singleton_method( ropenldap_mOpenLDAP, "cache_log_level",
+	                            ropenldap_s_cache_log_level, 0 );
+	ropenldap_s_cache_log_level( ropenldap_mOpenLDAP );
+
 	rb_require( "openldap/mixins" );
 
 	ropenldap_eOpenLDAPError =
@@ -459,6 +944,12 @@ Init_openldap_ext( void )
 	/* RFC4511 maxInt */
 	rb_define_const( ropenldap_mOpenLDAP, "LDAP_MAXINT", INT2NUM(LDAP_MAXINT) );
 
+	/* modification operations */
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_MOD_ADD", INT2FIX(LDAP_MOD_ADD) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_MOD_DELETE", INT2FIX(LDAP_MOD_DELETE) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_MOD_REPLACE", INT2FIX(LDAP_MOD_REPLACE) );
+	rb_define_const( ropenldap_mOpenLDAP, "LDAP_MOD_INCREMENT", INT2FIX(LDAP_MOD_INCREMENT) );
+
 	/* search scopes */
 	rb_define_const( ropenldap_mOpenLDAP, "LDAP_SCOPE_BASE", INT2FIX(LDAP_SCOPE_BASE) );
 	rb_define_const( ropenldap_mOpenLDAP, "LDAP_SCOPE_BASEOBJECT", INT2FIX(LDAP_SCOPE_BASEOBJECT) );
@@ -564,6 +1055,12 @@ Init_openldap_ext( void )
 	/* Module functions */
 	rb_define_singleton_method( ropenldap_mOpenLDAP, "split_url", ropenldap_s_split_url, 1 );
 	rb_define_singleton_method( ropenldap_mOpenLDAP, "err2string", ropenldap_s_err2string, 1 );
+	rb_define_singleton_method( ropenldap_mOpenLDAP, "binary_attribute?",
+	                            ropenldap_s_binary_attribute_p, 1 );
+	rb_define_singleton_method( ropenldap_mOpenLDAP, "interned_attributes",
+	                            ropenldap_s_interned_attributes, 0 );
+	rb_define_singleton_method( ropenldap_mOpenLDAP, "interned_attributes=",
+	                            ropenldap_s_interned_attributes_eq, 1 );
 	rb_define_singleton_method( ropenldap_mOpenLDAP, "api_info", ropenldap_s_api_info, 0 );
 	rb_define_singleton_method( ropenldap_mOpenLDAP, "api_feature_info",
 	                            ropenldap_s_api_feature_info, 0 );
@@ -574,6 +1071,12 @@ Init_openldap_ext( void )
 	ropenldap_init_connection();
 	ropenldap_init_result();
 	ropenldap_init_message();
+	ropenldap_init_entry();
+	ropenldap_init_control();
+	ropenldap_init_ldif();
+	ropenldap_init_schema();
+	ropenldap_init_filter();
+	ropenldap_init_dn();
 
 	/* Detect mismatched linking */
 	ropenldap_check_link();
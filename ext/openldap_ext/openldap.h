@@ -8,18 +8,28 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <strings.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <ldap.h>
+#include <ldap_schema.h>
 
 #include <ruby.h>
 #include <ruby/thread.h>
 #include <ruby/encoding.h>
 #include <ruby/intern.h>
+#include <ruby/util.h>
 
 #include "extconf.h"
 
+#ifdef HAVE_RUBY_FIBER_SCHEDULER_H
+#include <ruby/io.h>
+#include <ruby/fiber/scheduler.h>
+#endif
+
 /* --------------------------------------------------------------
  * Globals
  * -------------------------------------------------------------- */
@@ -32,8 +42,17 @@ extern VALUE ropenldap_mOpenLDAP;
 extern VALUE ropenldap_cOpenLDAPConnection;
 extern VALUE ropenldap_cOpenLDAPResult;
 extern VALUE ropenldap_cOpenLDAPMessage;
+extern VALUE ropenldap_cOpenLDAPEntry;
+extern VALUE ropenldap_cOpenLDAPControl;
+extern VALUE ropenldap_cOpenLDAPLDIF;
+extern VALUE ropenldap_cOpenLDAPSchema;
+extern VALUE ropenldap_cOpenLDAPFilter;
+extern VALUE ropenldap_cOpenLDAPDN;
 
 extern VALUE ropenldap_eOpenLDAPError;
+extern VALUE ropenldap_eOpenLDAPLDIFParseError;
+
+extern int ropenldap_log_level;
 
 
 /* --------------------------------------------------------------
@@ -43,6 +62,11 @@ extern VALUE ropenldap_eOpenLDAPError;
 /* OpenLDAP::Connection struct */
 struct ropenldap_connection {
     LDAP *ldap;
+    VALUE schema;
+    VALUE bind_dn;
+    VALUE pending_bind_dn;  /* the DN of the bind in flight, if any */
+    int bind_msgid;
+    int waiters;    /* threads and fibers waiting for results on the session */
 };
 
 /* OpenLDAP::Result struct */
@@ -50,11 +74,50 @@ struct ropenldap_result {
 	int   msgid;
 	VALUE connection;
 	VALUE abandoned;
+	VALUE search_args;
+	VALUE paged_cookie;
+	VALUE target_position;
+	VALUE content_count;
+	VALUE vlv_context;
+	VALUE controls;
+	VALUE completed;
+	VALUE compare_result;
 };
 
+/* OpenLDAP::Message struct */
 struct ropenldap_message {
 	LDAPMessage *msg;
 	VALUE       connection;
+	size_t      size;
+};
+
+/* OpenLDAP::Control struct */
+struct ropenldap_control {
+	LDAPControl ctrl;
+};
+
+/* OpenLDAP::Entry struct */
+struct ropenldap_entry {
+	LDAPMessage *entry;
+	VALUE       message;
+	VALUE       dn;
+	VALUE       attributes;
+};
+
+/* An attribute name (possibly not NUL-terminated) to look up in a table keyed
+ * with ropenldap_attr_key_type */
+struct ropenldap_attr_key {
+	const char *name;
+	size_t len;
+};
+
+/* How the values of an attribute are decoded, from the syntax of its type */
+enum ropenldap_value_type {
+	ROPENLDAP_VALUE_STRING = 0,
+	ROPENLDAP_VALUE_BINARY,
+	ROPENLDAP_VALUE_INTEGER,
+	ROPENLDAP_VALUE_BOOLEAN,
+	ROPENLDAP_VALUE_TIME,
 };
 
 
@@ -64,6 +127,8 @@ struct ropenldap_message {
 #define IsConnection( obj ) rb_obj_is_kind_of( (obj), ropenldap_cOpenLDAPConnection )
 #define IsResult( obj ) rb_obj_is_kind_of( (obj), ropenldap_cOpenLDAPResult )
 #define IsMessage( obj ) rb_obj_is_kind_of( (obj), ropenldap_cOpenLDAPMessage )
+#define IsEntry( obj ) rb_obj_is_kind_of( (obj), ropenldap_cOpenLDAPEntry )
+#define IsSchema( obj ) rb_obj_is_kind_of( (obj), ropenldap_cOpenLDAPSchema )
 
 #ifdef UNUSED
 #elif defined(__GNUC__)
@@ -91,9 +156,52 @@ struct ropenldap_message {
 #define BER_BVISNULL(bv)	((bv)->bv_val == NULL)
 #define BER_BVISEMPTY(bv)	((bv)->bv_len == 0)
 
+/* Log levels, in the same order as Logger's severities */
+#define ROPENLDAP_LOG_DEBUG 0
+#define ROPENLDAP_LOG_INFO  1
+#define ROPENLDAP_LOG_WARN  2
+#define ROPENLDAP_LOG_ERROR 3
+#define ROPENLDAP_LOG_FATAL 4
+
+/* Map a level name ("debug", "info", etc.) to its numeric level. The first letters
+ * are unique, so this folds to a constant when +level+ is a literal. */
+#define ropenldap_log_level_for( level ) \
+	( (level)[0] == 'd' ? ROPENLDAP_LOG_DEBUG : \
+	  (level)[0] == 'i' ? ROPENLDAP_LOG_INFO :  \
+	  (level)[0] == 'w' ? ROPENLDAP_LOG_WARN :  \
+	  (level)[0] == 'e' ? ROPENLDAP_LOG_ERROR : ROPENLDAP_LOG_FATAL )
+
+/* Debug logging can be compiled out entirely with --disable-debug-logging */
+#ifdef ROPENLDAP_NO_DEBUG_LOGGING
+# define ropenldap_log_compiled( level ) \
+	( ropenldap_log_level_for(level) > ROPENLDAP_LOG_DEBUG )
+#else
+# define ropenldap_log_compiled( level ) 1
+#endif
+
+#define ropenldap_log_enabled( level ) \
+	( ropenldap_log_compiled(level) && ropenldap_log_level_for(level) >= ropenldap_log_level )
+
+/* Log a message to the logger of +context+ or the global logger, respectively, only
+ * evaluating the arguments if +level+ is enabled. */
+#define ropenldap_log_obj( context, level, ... ) \
+	do { \
+		if ( ropenldap_log_enabled(level) ) \
+			ropenldap_do_log_obj( (context), (level), __VA_ARGS__ ); \
+	} while (0)
+#define ropenldap_log( level, ... ) \
+	do { \
+		if ( ropenldap_log_enabled(level) ) \
+			ropenldap_do_log( (level), __VA_ARGS__ ); \
+	} while (0)
+
 // Convert decimal seconds to milliseconds
 #define MILLION_F 1000000.0
 
+// Flags for how the values of an attribute are converted to Ruby Strings
+#define ROPENLDAP_ATTR_BINARY         (1 << 0)   /* tagged ASCII-8BIT instead of UTF-8 */
+#define ROPENLDAP_ATTR_INTERN_VALUES  (1 << 1)   /* interned and frozen */
+
 
 
 
@@ -104,18 +212,25 @@ struct ropenldap_message {
 #ifdef HAVE_STDARG_PROTOTYPES
 #include <stdarg.h>
 #define va_init_list(a,b) va_start(a,b)
-void ropenldap_log_obj( VALUE, const char *, const char *, ... );
-void ropenldap_log( const char *, const char *, ... );
+void ropenldap_do_log_obj( VALUE, const char *, const char *, ... );
+void ropenldap_do_log( const char *, const char *, ... );
 void ropenldap_check_result( int, const char *, ... );
 #else
 #include <varargs.h>
 #define va_init_list(a,b) va_start(a)
-void ropenldap_log_obj( VALUE, const char *, const char *, va_dcl );
-void ropenldap_log( const char *, const char *, va_dcl );
+void ropenldap_do_log_obj( VALUE, const char *, const char *, va_dcl );
+void ropenldap_do_log( const char *, const char *, va_dcl );
 void ropenldap_check_result( int, va_dcl );
 #endif
 
 VALUE ropenldap_rb_string_array         _(( char ** ));
+VALUE ropenldap_rb_values_array         _(( struct berval **, int, int ));
+rb_encoding *ropenldap_attr_encoding    _(( const char *, size_t ));
+VALUE ropenldap_attr_name               _(( const char *, size_t, int * ));
+VALUE ropenldap_attr_key                _(( VALUE, int * ));
+VALUE ropenldap_attr_value              _(( const char *, size_t, int ));
+extern const struct st_hash_type ropenldap_attr_key_type;
+VALUE ropenldap_str_utf8                _(( VALUE ));
 
 
 /* --------------------------------------------------------------
@@ -126,9 +241,32 @@ void Init_openldap_ext                  _(( void ));
 void ropenldap_init_connection          _(( void ));
 void ropenldap_init_result              _(( void ));
 void ropenldap_init_message             _(( void ));
+void ropenldap_init_entry               _(( void ));
+void ropenldap_init_control             _(( void ));
+void ropenldap_init_ldif                _(( void ));
+void ropenldap_init_schema              _(( void ));
+void ropenldap_init_filter              _(( void ));
+void ropenldap_init_dn                  _(( void ));
 
 LDAP *ropenldap_conn_get_ldap           _(( VALUE ));
+void ropenldap_conn_begin_wait          _(( VALUE ));
+void ropenldap_conn_end_wait            _(( VALUE ));
+void ropenldap_conn_finish_bind         _(( VALUE, int, int ));
+VALUE ropenldap_conn_get_schema         _(( VALUE ));
 VALUE ropenldap_new_message             _(( VALUE, LDAPMessage * ));
+LDAP *ropenldap_message_get_ldap        _(( VALUE ));
+VALUE ropenldap_message_get_schema      _(( VALUE ));
+void ropenldap_decode_entry             _(( LDAP *, LDAPMessage *, VALUE, long *, VALUE *, VALUE * ));
+VALUE ropenldap_new_entry               _(( VALUE, LDAPMessage * ));
+int ropenldap_wait_for_result           _(( VALUE, int, int, struct timeval *, LDAPMessage ** ));
+void ropenldap_check_foreign_message    _(( VALUE, int, int, const char * ));
+VALUE ropenldap_new_control             _(( LDAPControl * ));
+VALUE ropenldap_rb_controls             _(( LDAPControl ** ));
+long ropenldap_control_count            _(( VALUE ));
+LDAPControl **ropenldap_fill_controls   _(( VALUE, LDAPControl **, LDAPControl ** ));
+int ropenldap_schema_value_type         _(( VALUE, const char *, size_t ));
+int ropenldap_schema_is_stale           _(( VALUE ));
+VALUE ropenldap_typed_value             _(( int, const char *, size_t, int ));
 
 
 #endif /* __OPENLDAP_H__ */
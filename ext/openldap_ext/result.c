@@ -49,6 +49,90 @@
 VALUE ropenldap_cOpenLDAPResult;
 
 
+/* The longest a GVL-free ldap_result() call will wait before checking to see if
+ * it's been interrupted. */
+#define ROPENLDAP_WAIT_SLICE_USEC 100000
+
+/* Zero timeout, for polling ldap_result() */
+static struct timeval ropenldap_zero_timeout = { 0, 0 };
+
+static ID id_socket;
+
+/* State for iterating over the entries of a search */
+struct ropenldap_result_iter {
+	VALUE       self;
+	LDAPMessage *msg;
+	int         done;
+};
+
+/* The number of bytes to collect before writing an export to its IO */
+#define ROPENLDAP_EXPORT_CHUNK ( 256 * 1024 )
+
+/* The default column to fold LDIF lines at */
+#define ROPENLDAP_EXPORT_LDIF_WRAP 76
+
+/* Export formats */
+enum ropenldap_export_format {
+	ROPENLDAP_EXPORT_LDIF,
+	ROPENLDAP_EXPORT_NDJSON,
+};
+
+/* State for writing the entries of a search to an IO */
+struct ropenldap_result_export {
+	struct ropenldap_result_iter iter;
+	enum ropenldap_export_format format;
+	VALUE        io;
+	VALUE        buffer;
+	long         wrap;
+	long         count;
+	long         complete;
+	int          writing;
+	BerElement   *ber;
+	struct berval *values;
+};
+
+/* Bytes that can't appear in an LDIF SAFE-STRING; the second table adds the ones
+ * that also can't start one */
+static char ropenldap_ldif_unsafe[ 256 ];
+static char ropenldap_ldif_unsafe_init[ 256 ];
+
+/* The short escape for bytes that must be escaped in a JSON string, or 'u' for ones
+ * that need a \u escape */
+static char ropenldap_json_escape[ 256 ];
+
+static const char ropenldap_b64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char ropenldap_hex_chars[] = "0123456789abcdef";
+
+/* State for collecting the messages of a batch of searches */
+struct ropenldap_result_batch {
+	VALUE       connection;
+	VALUE       results;
+	VALUE       pending;
+	VALUE       entries;
+	LDAPMessage *msg;
+};
+
+/* Arguments for checking the search result of a batched search under rb_protect() */
+struct ropenldap_result_finish {
+	LDAP        *ldap;
+	VALUE       result;
+	LDAPMessage *msg;
+};
+
+/* Arguments/return values for a GVL-free call to ldap_result() */
+struct ropenldap_wait {
+	VALUE          connection;
+	LDAP           *ldap;
+	int            msgid;
+	int            all;
+	struct timeval *deadline;
+	LDAPMessage    *msg;
+	int            interrupted;
+	int            res;
+};
+
+
 /* --------------------------------------------------
  *	Memory-management functions
  * -------------------------------------------------- */
@@ -64,6 +148,14 @@ ropenldap_result_alloc( VALUE connection, int msgid )
 	ptr->msgid      = msgid;
 	ptr->connection = connection;
 	ptr->abandoned  = Qfalse;
+	ptr->search_args     = Qnil;
+	ptr->paged_cookie    = Qnil;
+	ptr->target_position = Qnil;
+	ptr->content_count   = Qnil;
+	ptr->vlv_context     = Qnil;
+	ptr->controls        = Qnil;
+	ptr->completed       = Qfalse;
+	ptr->compare_result  = Qnil;
 
 	return ptr;
 }
@@ -77,6 +169,12 @@ ropenldap_result_gc_mark( struct ropenldap_result *ptr )
 {
 	if ( ptr ) {
 		rb_gc_mark( ptr->connection );
+		rb_gc_mark( ptr->search_args );
+		rb_gc_mark( ptr->paged_cookie );
+		rb_gc_mark( ptr->target_position );
+		rb_gc_mark( ptr->content_count );
+		rb_gc_mark( ptr->vlv_context );
+		rb_gc_mark( ptr->controls );
 	}
 }
 
@@ -92,6 +190,14 @@ ropenldap_result_gc_free( struct ropenldap_result *ptr )
 		ptr->msgid      = 0;
 		ptr->connection = Qnil;
 		ptr->abandoned  = Qfalse;
+		ptr->search_args     = Qnil;
+		ptr->paged_cookie    = Qnil;
+		ptr->target_position = Qnil;
+		ptr->content_count   = Qnil;
+		ptr->vlv_context     = Qnil;
+		ptr->controls        = Qnil;
+		ptr->completed       = Qfalse;
+		ptr->compare_result  = Qnil;
 
 		xfree( ptr );
 		ptr = NULL;
@@ -131,6 +237,222 @@ ropenldap_get_result( VALUE self )
 
 
 
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Set +now+ to the current time on a monotonic clock.
+ */
+static void
+ropenldap_monotonic_now( struct timeval *now )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	now->tv_sec = ts.tv_sec;
+	now->tv_usec = ts.tv_nsec / 1000;
+}
+
+
+/*
+ * Wait for results in slices of ROPENLDAP_WAIT_SLICE_USEC so that the unblocking
+ * function can interrupt the wait; called from ropenldap_wait_for_result after the
+ * GVL is released.
+ */
+static void *
+ropenldap_wait_for_result_blocking( void *ptr )
+{
+	struct ropenldap_wait *wait = ptr;
+	struct timeval slice, now;
+	int res = 0, expired = 0;
+
+	while ( !wait->interrupted ) {
+		slice.tv_sec = 0;
+		slice.tv_usec = ROPENLDAP_WAIT_SLICE_USEC;
+
+		/* Once the deadline has passed, poll one last time for a result that's
+		 * already arrived */
+		if ( wait->deadline ) {
+			ropenldap_monotonic_now( &now );
+			if ( !timercmp(&now, wait->deadline, <) ) {
+				timerclear( &slice );
+				expired = 1;
+			} else {
+				timersub( wait->deadline, &now, &now );
+				if ( timercmp(&now, &slice, <) ) slice = now;
+			}
+		}
+
+		res = ldap_result( wait->ldap, wait->msgid, wait->all, &slice, &wait->msg );
+		if ( res != 0 || expired ) return (void *)(VALUE)res;
+	}
+
+	return (void *)(VALUE)0;
+}
+
+
+/*
+ * Unblocking function for ropenldap_wait_for_result_blocking; flags the wait as
+ * interrupted so it returns after the current slice.
+ */
+static void
+ropenldap_wait_for_result_ubf( void *ptr )
+{
+	struct ropenldap_wait *wait = ptr;
+	wait->interrupted = 1;
+}
+
+
+#ifdef HAVE_RB_FIBER_SCHEDULER_CURRENT
+/*
+ * Wait for the results described by +wait+ by polling ldap_result() and yielding
+ * to the Fiber +scheduler+ until the connection's socket is readable. Returns -2
+ * if the connection doesn't have a socket to wait on yet.
+ */
+static int
+ropenldap_wait_for_result_nonblocking( VALUE scheduler, struct ropenldap_wait *wait )
+{
+	VALUE socket = rb_funcall( wait->connection, id_socket, 0 );
+	VALUE timeout = Qnil;
+	struct timeval now;
+	int res = 0;
+
+	if ( NIL_P(socket) ) return -2;
+
+	for ( ;; ) {
+		/* Fetch the handle again after each yield, since other fibers run then */
+		wait->ldap = ropenldap_conn_get_ldap( wait->connection );
+		res = ldap_result( wait->ldap, wait->msgid, wait->all, &ropenldap_zero_timeout,
+		                   &wait->msg );
+		if ( res != 0 ) return res;
+
+		if ( wait->deadline ) {
+			ropenldap_monotonic_now( &now );
+			if ( !timercmp(&now, wait->deadline, <) ) return 0;
+
+			timersub( wait->deadline, &now, &now );
+			timeout = rb_float_new( ((double) now.tv_sec) + now.tv_usec / MILLION_F );
+		}
+
+		rb_fiber_scheduler_io_wait( scheduler, socket, INT2FIX(RUBY_IO_READABLE), timeout );
+	}
+}
+#endif /* HAVE_RB_FIBER_SCHEDULER_CURRENT */
+
+
+/*
+ * Wait for the results described by the ropenldap_wait struct +arg+, yielding to
+ * the current Fiber scheduler if there is one, or without the GVL if not.
+ */
+static VALUE
+ropenldap_wait_for_result_body( VALUE arg )
+{
+	struct ropenldap_wait *wait = (struct ropenldap_wait *)arg;
+#ifdef HAVE_RB_FIBER_SCHEDULER_CURRENT
+	VALUE scheduler = rb_fiber_scheduler_current();
+
+	if ( !NIL_P(scheduler) ) {
+		wait->res = ropenldap_wait_for_result_nonblocking( scheduler, wait );
+		if ( wait->res != -2 ) return Qnil;
+	}
+#endif /* HAVE_RB_FIBER_SCHEDULER_CURRENT */
+
+	do {
+		/* Fetch the handle again after running interrupts, since other threads run
+		 * then */
+		wait->ldap = ropenldap_conn_get_ldap( wait->connection );
+		wait->interrupted = 0;
+		wait->res = (int)(VALUE)rb_thread_call_without_gvl( ropenldap_wait_for_result_blocking, wait,
+		                                                    ropenldap_wait_for_result_ubf, wait );
+
+		/* Run any pending interrupts, which may raise, then resume waiting if they don't */
+		if ( wait->res == 0 && wait->interrupted ) rb_thread_check_ints();
+	} while ( wait->res == 0 && wait->interrupted );
+
+	return Qnil;
+}
+
+
+/*
+ * Mark the wait described by the ropenldap_wait struct +arg+ as finished, so its
+ * connection can be unbound again.
+ */
+static VALUE
+ropenldap_wait_for_result_ensure( VALUE arg )
+{
+	struct ropenldap_wait *wait = (struct ropenldap_wait *)arg;
+
+	ropenldap_conn_end_wait( wait->connection );
+	return Qnil;
+}
+
+
+/*
+ * Wait up to +timeout+ (forever if NULL) for the results of the operation +msgid+
+ * on the given +connection+ without holding the GVL, setting +msg+ to the results
+ * if any arrive. Returns the return value of ldap_result(). Other threads may
+ * interrupt the wait (e.g., via Thread#raise or Timeout), in which case any pending
+ * exception is raised. If the current thread has a Fiber scheduler, the wait
+ * yields to it until the connection's socket is readable instead. The connection
+ * can't be unbound while the wait is in progress.
+ */
+int
+ropenldap_wait_for_result( VALUE connection, int msgid, int all, struct timeval *timeout,
+                           LDAPMessage **msg )
+{
+	struct ropenldap_wait wait;
+	struct timeval deadline;
+
+	wait.connection  = connection;
+	wait.ldap        = NULL;
+	wait.msgid       = msgid;
+	wait.all         = all;
+	wait.deadline    = NULL;
+	wait.msg         = NULL;
+	wait.interrupted = 0;
+	wait.res         = 0;
+
+	if ( timeout ) {
+		ropenldap_monotonic_now( &deadline );
+		timeradd( &deadline, timeout, &deadline );
+		wait.deadline = &deadline;
+	}
+
+	ropenldap_conn_begin_wait( connection );
+	rb_ensure( ropenldap_wait_for_result_body, (VALUE)&wait,
+	           ropenldap_wait_for_result_ensure, (VALUE)&wait );
+
+	*msg = wait.msg;
+	return wait.res;
+}
+
+
+/*
+ * Deal with the message +msgid+ of type +msgtype+ that a wait for LDAP_RES_ANY on
+ * +connection+ returned while collecting the responses of the operations of a
+ * +what+, but which isn't for any of them. Reading it took it away from the
+ * operation it belongs to, so an OpenLDAP::Error is raised instead of letting that
+ * response go missing. Unsolicited notifications (message ID 0) aren't a response
+ * to anything, so they're only logged. The caller must free the message first.
+ */
+void
+ropenldap_check_foreign_message( VALUE connection, int msgid, int msgtype, const char *what )
+{
+	if ( msgid == 0 ) {
+		ropenldap_log_obj( connection, "info", "Ignoring unsolicited notification of type %x",
+		                   msgtype );
+		return;
+	}
+
+	rb_raise( ropenldap_eOpenLDAPError,
+	          "received message %d of type %x, which isn't part of the %s; other operations "
+	          "can't be outstanding on a connection while a %s is collected",
+	          msgid, msgtype, what, what );
+}
+
+
+
 /* --------------------------------------------------------------
  * Class methods
  * -------------------------------------------------------------- */
@@ -155,19 +477,24 @@ ropenldap_result_s_allocate( VALUE klass )
 
 /*
  * call-seq:
- *    OpenLDAP::Result.new( connection, msgid )    -> result
+ *    OpenLDAP::Result.new( connection, msgid, search_args=nil )    -> result
  *
  * Create a new OpenLDAP::Result object for the specified +msgid+ on the given
- * +connection+.
+ * +connection+. If the result is for a search, +search_args+ are the arguments
+ * it was started with.
  *
  */
 static VALUE
-ropenldap_result_initialize( VALUE self, VALUE connection, VALUE msgid )
+ropenldap_result_initialize( int argc, VALUE *argv, VALUE self )
 {
+	VALUE connection, msgid, search_args = Qnil;
+
 	ropenldap_log_obj( self, "debug", "Initializing 0x%x", self );
+	rb_scan_args( argc, argv, "21", &connection, &msgid, &search_args );
 
 	if ( !check_result(self) ) {
 		DATA_PTR( self ) = ropenldap_result_alloc( connection, NUM2INT(msgid) );
+		ropenldap_get_result( self )->search_args = search_args;
 	} else {
 		rb_raise( ropenldap_eOpenLDAPError,
 				  "Cannot re-initialize a result once it's been created." );
@@ -177,6 +504,153 @@ ropenldap_result_initialize( VALUE self, VALUE connection, VALUE msgid )
 }
 
 
+/*
+ * call-seq:
+ *    result.msgid   -> integer
+ *
+ * Return the message ID of the operation.
+ *
+ */
+static VALUE
+ropenldap_result_msgid( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return INT2FIX( ptr->msgid );
+}
+
+
+/*
+ * call-seq:
+ *    result.connection   -> connection
+ *
+ * Return the OpenLDAP::Connection the operation was sent on.
+ *
+ */
+static VALUE
+ropenldap_result_connection( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->connection;
+}
+
+
+/*
+ * call-seq:
+ *    result.search_args   -> array or nil
+ *
+ * Return the arguments the search was started with, or +nil+ if the result
+ * isn't for a plain search; sorted, VLV, and paged searches are sent with controls
+ * that aren't among their arguments, so they don't keep them.
+ *
+ */
+static VALUE
+ropenldap_result_search_args( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->search_args;
+}
+
+
+/*
+ * call-seq:
+ *    result.paged_cookie   -> string or nil
+ *
+ * Return the cookie from the paged results control (RFC 2696) the server sent
+ * with the result of a paged search, once the search has finished. The cookie
+ * is empty after the last page, and +nil+ if the server didn't send the control.
+ *
+ */
+static VALUE
+ropenldap_result_paged_cookie( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->paged_cookie;
+}
+
+
+/*
+ * call-seq:
+ *    result.target_position   -> integer or nil
+ *
+ * Return the position (1-based) of the target entry of a Virtual List View search
+ * in the sorted list of all of the entries that matched it, once the search has
+ * finished. Returns +nil+ if the server didn't send a VLV response.
+ *
+ */
+static VALUE
+ropenldap_result_target_position( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->target_position;
+}
+
+
+/*
+ * call-seq:
+ *    result.content_count   -> integer or nil
+ *
+ * Return the server's estimate of the number of entries that matched a Virtual List
+ * View search, once the search has finished. Returns +nil+ if the server didn't send
+ * a VLV response.
+ *
+ */
+static VALUE
+ropenldap_result_content_count( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->content_count;
+}
+
+
+/*
+ * call-seq:
+ *    result.vlv_context   -> string or nil
+ *
+ * Return the opaque context the server sent with the result of a Virtual List View
+ * search, which can be passed with the next request for the same list.
+ *
+ */
+static VALUE
+ropenldap_result_vlv_context( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->vlv_context;
+}
+
+
+/*
+ * call-seq:
+ *    result.controls   -> array or nil
+ *
+ * Return the OpenLDAP::Controls the server sent with the result of the operation,
+ * once it's finished, or +nil+ before then.
+ *
+ */
+static VALUE
+ropenldap_result_controls( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->controls;
+}
+
+
+/*
+ * call-seq:
+ *    result.compare_result   -> true, false, or nil
+ *
+ * Return +true+ if the result is for a compare that found the value in the entry,
+ * +false+ if it didn't, or +nil+ if the compare hasn't finished yet (or the result
+ * isn't for a compare).
+ *
+ */
+static VALUE
+ropenldap_result_compare_result( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->compare_result;
+}
+
+
 /*
  * call-seq:
  *    result.abandon   -> true
@@ -206,8 +680,9 @@ ropenldap_result_abandon( int argc, VALUE *argv, VALUE self )
  *    result.fetch              -> message or nil
  *    result.fetch( timeout )   -> message or nil
  *
- * Fetch the next result if it's ready. Raises a TimeoutError if the fetch
- * times out.
+ * Fetch the next result if it's ready. Raises an OpenLDAP::Timeout if the fetch
+ * times out. Other threads continue to run while the fetch is waiting, and the
+ * wait can be interrupted with Thread#raise (e.g., by Timeout).
  *
  */
 static VALUE
@@ -219,23 +694,22 @@ ropenldap_result_fetch( int argc, VALUE *argv, VALUE self )
 	VALUE message = Qnil;
 	LDAPMessage *msg = NULL;
 	struct timeval *c_timeout = NULL;
+	double seconds;
 	int res = 0;
 
 	rb_scan_args( argc, argv, "01", &timeout );
 
 	if ( !NIL_P(timeout) ) {
+		seconds = NUM2DBL( timeout );
 		c_timeout = ALLOCA_N( struct timeval, 1 );
-		double seconds = NUM2DBL( timeout );
 		c_timeout->tv_sec = (time_t)floor( seconds );
 		c_timeout->tv_usec = (suseconds_t)( fmod(seconds, 1.0) * MILLION_F );
 	}
 
-	// int ldap_result( LDAP *ld, int msgid, int all,
-	//             struct timeval *timeout, LDAPMessage **result );
-	res = ldap_result( ldap, ptr->msgid, 0, c_timeout, &msg );
+	res = ropenldap_wait_for_result( ptr->connection, ptr->msgid, 0, c_timeout, &msg );
 
 	if ( res == 0 ) {
-		rb_raise( rb_eRuntimeError, "timeout!" );
+		ropenldap_check_result( LDAP_TIMEOUT, "ldap_result(%p, %d, ...)", ldap, ptr->msgid );
 	}
 
 	else if ( res < 0 ) {
@@ -250,28 +724,1145 @@ ropenldap_result_fetch( int argc, VALUE *argv, VALUE self )
 
 
 /*
- * document-class: OpenLDAP::Result
+ * Save the values from the Virtual List View response control +ctrl+ in the result
+ * +ptr+, returning the VLV result code.
  */
-void
-ropenldap_init_result( void )
+static int
+ropenldap_result_parse_vlv_response( LDAP *ldap, struct ropenldap_result *ptr, LDAPControl *ctrl )
 {
-	ropenldap_log( "debug", "Initializing OpenLDAP::Result" );
+	ber_int_t target = 0, count = 0;
+	struct berval *context = NULL;
+	int err = LDAP_SUCCESS;
 
-#ifdef FOR_RDOC
-	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
-#endif
+	if ( ldap_parse_vlvresponse_control(ldap, ctrl, &target, &count, &context, &err) !=
+	     LDAP_SUCCESS )
+		return LDAP_SUCCESS;
 
-	/* OpenLDAP::Result */
-	ropenldap_cOpenLDAPResult =
-		rb_define_class_under( ropenldap_mOpenLDAP, "Result", rb_cObject );
+	ptr->target_position = INT2NUM( target );
+	ptr->content_count = INT2NUM( count );
 
-	rb_define_alloc_func( ropenldap_cOpenLDAPResult, ropenldap_result_s_allocate );
+	if ( context ) {
+		ptr->vlv_context = rb_str_new( context->bv_val, context->bv_len );
+		ber_bvfree( context );
+	}
 
-	rb_define_protected_method( ropenldap_cOpenLDAPResult, "initialize",
-	                            ropenldap_result_initialize, 2 );
+	return err;
+}
+
+
+/*
+ * Return the name of the operation the response message type +msgtype+ is for.
+ */
+static const char *
+ropenldap_result_op_name( int msgtype )
+{
+	switch ( msgtype ) {
+		case LDAP_RES_BIND:          return "bind";
+		case LDAP_RES_SEARCH_RESULT: return "search";
+		case LDAP_RES_MODIFY:        return "modify";
+		case LDAP_RES_ADD:           return "add";
+		case LDAP_RES_DELETE:        return "delete";
+		case LDAP_RES_MODDN:         return "rename";
+		case LDAP_RES_COMPARE:       return "compare";
+		case LDAP_RES_EXTENDED:      return "extended operation";
+		default:                     return "operation";
+	}
+}
+
+
+/*
+ * Mark the result +self+ as completed, and raise an appropriate exception if the
+ * final response +msg+ of its operation wasn't successful, saving the response
+ * controls the server sent with it and the values from any paged results, sort, or
+ * Virtual List View controls among them. The outcome of a compare is saved as its
+ * compare_result instead of being raised. Frees the message.
+ */
+static void
+ropenldap_result_check_result( LDAP *ldap, VALUE self, LDAPMessage *msg )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	char errmsg[BUFSIZ] = "";
+	char *diagnostic = NULL;
+	LDAPControl **ctrls = NULL, *ctrl = NULL;
+	struct berval cookie = { 0, NULL };
+	ber_int_t estimate = 0, sort_err = LDAP_SUCCESS;
+	int err = LDAP_SUCCESS, vlv_err = LDAP_SUCCESS;
+	int msgtype = ldap_msgtype( msg );
+	int res;
+
+	ptr->completed = Qtrue;
+	res = ldap_parse_result( ldap, msg, &err, NULL, &diagnostic, NULL, &ctrls, 1 );
+	ropenldap_check_result( res, "ldap_parse_result" );
+
+	if ( diagnostic ) {
+		strncpy( errmsg, diagnostic, BUFSIZ - 1 );
+		ldap_memfree( diagnostic );
+	}
+
+	ptr->controls = ropenldap_rb_controls( ctrls );
+
+	if ( ctrls ) {
+		ctrl = ldap_control_find( LDAP_CONTROL_PAGEDRESULTS, ctrls, NULL );
+		if ( ctrl &&
+		     ldap_parse_pageresponse_control(ldap, ctrl, &estimate, &cookie) == LDAP_SUCCESS )
+		{
+			ptr->paged_cookie = rb_str_new( cookie.bv_val, cookie.bv_len );
+			ber_memfree( cookie.bv_val );
+		}
+
+		if ( (ctrl = ldap_control_find(LDAP_CONTROL_SORTRESPONSE, ctrls, NULL)) )
+			ldap_parse_sortresponse_control( ldap, ctrl, &sort_err, NULL );
+
+		if ( (ctrl = ldap_control_find(LDAP_CONTROL_VLVRESPONSE, ctrls, NULL)) )
+			vlv_err = ropenldap_result_parse_vlv_response( ldap, ptr, ctrl );
+
+		ldap_controls_free( ctrls );
+	}
+
+	/* The outcome of a compare is its result code, so it doesn't count as a failure */
+	if ( msgtype == LDAP_RES_COMPARE && (err == LDAP_COMPARE_TRUE || err == LDAP_COMPARE_FALSE) ) {
+		ptr->compare_result = ( err == LDAP_COMPARE_TRUE ) ? Qtrue : Qfalse;
+		err = LDAP_SUCCESS;
+	}
+
+	if ( msgtype == LDAP_RES_BIND )
+		ropenldap_conn_finish_bind( ptr->connection, ptr->msgid, err == LDAP_SUCCESS );
+
+	ropenldap_check_result( err, "%s: %s", ropenldap_result_op_name(msgtype), errmsg );
+	ropenldap_check_result( sort_err, "server-side sort" );
+	ropenldap_check_result( vlv_err, "virtual list view" );
+}
+
+
+/*
+ * call-seq:
+ *    result.wait              -> result
+ *    result.wait( timeout )   -> result or nil
+ *
+ * Wait for the operation to finish, raising an appropriate exception if it
+ * wasn't successful. Returns +nil+ if it doesn't finish within +timeout+ seconds,
+ * so <tt>result.wait( 0 )</tt> checks for completion without blocking. Any search
+ * entries that arrive while waiting are discarded. Other threads (or fibers, if
+ * there's a Fiber scheduler) continue to run while the wait is blocked.
+ *
+ *    result = conn.bind_async( dn, password )
+ *    do_other_work until result.wait( 0 )
+ *
+ */
+static VALUE
+ropenldap_result_wait( int argc, VALUE *argv, VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	LDAP *ldap = ropenldap_conn_get_ldap( ptr->connection );
+	VALUE timeout = Qnil;
+	LDAPMessage *msg = NULL;
+	struct timeval *c_timeout = NULL;
+	double seconds;
+	int res = 0;
+
+	rb_scan_args( argc, argv, "01", &timeout );
+
+	if ( RTEST(ptr->completed) ) return self;
+
+	if ( !NIL_P(timeout) ) {
+		seconds = NUM2DBL( timeout );
+		c_timeout = ALLOCA_N( struct timeval, 1 );
+		c_timeout->tv_sec = (time_t)floor( seconds );
+		c_timeout->tv_usec = (suseconds_t)( fmod(seconds, 1.0) * MILLION_F );
+	}
+
+	for ( ;; ) {
+		res = ropenldap_wait_for_result( ptr->connection, ptr->msgid, LDAP_MSG_ONE, c_timeout,
+		                                 &msg );
+		if ( res == 0 ) return Qnil;
+		if ( res < 0 ) ropenldap_check_result( res, "ldap_result(%p, %d, ...)", ldap, ptr->msgid );
+
+		switch ( res ) {
+			case LDAP_RES_SEARCH_ENTRY:
+			case LDAP_RES_SEARCH_REFERENCE:
+			case LDAP_RES_INTERMEDIATE:
+				ldap_msgfree( msg );
+				msg = NULL;
+				break;
+
+			default:
+				ropenldap_result_check_result( ldap, self, msg );
+				return self;
+		}
+	}
+}
+
+
+/*
+ * call-seq:
+ *    result.completed?   -> true or false
+ *
+ * Returns +true+ if the final response of the operation has been read, e.g., by
+ * #wait or by iterating over the entries of a search.
+ *
+ */
+static VALUE
+ropenldap_result_completed_p( VALUE self )
+{
+	struct ropenldap_result *ptr = ropenldap_get_result( self );
+	return ptr->completed;
+}
+
+
+/*
+ * Fetch, decode, yield, and free the messages of a search until the search result
+ * arrives; the body of Result#each_entry.
+ */
+static VALUE
+ropenldap_result_each_entry_body( VALUE arg )
+{
+	struct ropenldap_result_iter *iter = (struct ropenldap_result_iter *)arg;
+	struct ropenldap_result *ptr = ropenldap_get_result( iter->self );
+	LDAP *ldap = ropenldap_conn_get_ldap( ptr->connection );
+	LDAPMessage *msg;
+	long size_hint = 0;
+	VALUE dn, attrs;
+	int res;
+
+	for ( ;; ) {
+		res = ropenldap_wait_for_result( ptr->connection, ptr->msgid, LDAP_MSG_ONE, NULL,
+		                                 &iter->msg );
+		if ( res <= 0 )
+			ropenldap_check_result( res ? res : LDAP_TIMEOUT, "ldap_result(%p, %d, ...)",
+			                        ldap, ptr->msgid );
+
+		switch ( res ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				ropenldap_decode_entry( ldap, iter->msg, ropenldap_conn_get_schema(ptr->connection),
+				                        &size_hint, &dn, &attrs );
+				ldap_msgfree( iter->msg );
+				iter->msg = NULL;
+				rb_yield_values( 2, dn, attrs );
+				break;
+
+			case LDAP_RES_SEARCH_RESULT:
+				iter->done = 1;
+				msg = iter->msg;
+				iter->msg = NULL;
+				ropenldap_result_check_result( ldap, iter->self, msg );
+				return iter->self;
+
+			default:
+				ropenldap_log_obj( iter->self, "debug", "Skipping message of type %x", res );
+				ldap_msgfree( iter->msg );
+				iter->msg = NULL;
+		}
+	}
+}
+
+
+/*
+ * Free any message left over from Result#each_entry, and abandon the search if
+ * iteration stopped before it was finished.
+ */
+static VALUE
+ropenldap_result_each_entry_ensure( VALUE arg )
+{
+	struct ropenldap_result_iter *iter = (struct ropenldap_result_iter *)arg;
+	struct ropenldap_result *ptr = ropenldap_get_result( iter->self );
+
+	if ( iter->msg ) {
+		ldap_msgfree( iter->msg );
+		iter->msg = NULL;
+	}
+
+	if ( !iter->done ) {
+		ropenldap_log_obj( iter->self, "debug", "Abandoning unfinished search %d", ptr->msgid );
+		ldap_abandon_ext( ropenldap_conn_get_ldap(ptr->connection), ptr->msgid, NULL, NULL );
+		ptr->abandoned = Qtrue;
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    result.each_entry {|dn, attributes| ... }   -> result
+ *    result.each_entry                            -> enumerator
+ *
+ * Fetch the entries of the search as they arrive, calling the block with the DN
+ * and a Hash of the attributes of each one. Each message is freed as soon as it's
+ * been decoded, so iterating over a search uses constant memory regardless of its
+ * size. Iteration stops at the end of the search, raising an appropriate exception
+ * if it wasn't successful; if iteration is stopped early, the search is abandoned.
+ *
+ *    conn.search( base, :subtree, '(objectClass=person)' ).each_entry do |dn, attrs|
+ *      puts "%s: %s" % [ dn, attrs['cn'].first ]
+ *    end
+ */
+static VALUE
+ropenldap_result_each_entry( VALUE self )
+{
+	struct ropenldap_result_iter iter;
+
+	RETURN_ENUMERATOR( self, 0, 0 );
+
+	iter.self = self;
+	iter.msg  = NULL;
+	iter.done = 0;
+
+	return rb_ensure( ropenldap_result_each_entry_body, (VALUE)&iter,
+	                  ropenldap_result_each_entry_ensure, (VALUE)&iter );
+}
+
+
+
+/* --------------------------------------------------------------
+ * Exporting
+ * -------------------------------------------------------------- */
+
+/* The length of the base64 encoding of +len+ bytes */
+#define ROPENLDAP_B64_LEN( len ) ( ((len) + 2) / 3 * 4 )
+
+static struct berval ropenldap_export_dn_type = BER_BVC( "dn" );
+
+
+/*
+ * Write the contents of the export's buffer to its IO and empty it.
+ */
+static void
+ropenldap_export_flush( struct ropenldap_result_export *export )
+{
+	if ( RSTRING_LEN(export->buffer) == 0 ) return;
+
+	export->writing = 1;
+	rb_io_write( export->io, export->buffer );
+	export->writing = 0;
+
+	rb_str_set_len( export->buffer, 0 );
+	export->complete = 0;
+}
+
+
+/*
+ * Return a pointer to room for +len+ more bytes at the end of the export's buffer,
+ * flushing it first if they'd take it past ROPENLDAP_EXPORT_CHUNK. The bytes that
+ * are used are added to the buffer with ropenldap_export_commit().
+ */
+static char *
+ropenldap_export_reserve( struct ropenldap_result_export *export, size_t len )
+{
+	long used = RSTRING_LEN( export->buffer );
+
+	if ( used && used + len > ROPENLDAP_EXPORT_CHUNK ) {
+		ropenldap_export_flush( export );
+		used = 0;
+	}
+
+	rb_str_modify_expand( export->buffer, (long)len );
+	return RSTRING_PTR( export->buffer ) + used;
+}
+
+
+/*
+ * Add +len+ bytes written after a call to ropenldap_export_reserve() to the buffer.
+ */
+static void
+ropenldap_export_commit( struct ropenldap_result_export *export, size_t len )
+{
+	rb_str_set_len( export->buffer, RSTRING_LEN(export->buffer) + (long)len );
+}
+
+
+/*
+ * Append the +len+ bytes at +data+ to the export's buffer.
+ */
+static void
+ropenldap_export_put( struct ropenldap_result_export *export, const char *data, size_t len )
+{
+	memcpy( ropenldap_export_reserve(export, len), data, len );
+	ropenldap_export_commit( export, len );
+}
+
+
+/*
+ * Write the base64 encoding of the +len+ bytes at +in+ to +out+, returning the
+ * number of bytes written.
+ */
+static size_t
+ropenldap_b64_encode( const unsigned char *in, size_t len, char *out )
+{
+	char *start = out;
+	size_t i;
+
+	for ( i = 0; i + 2 < len; i += 3 ) {
+		*out++ = ropenldap_b64_chars[ in[i] >> 2 ];
+		*out++ = ropenldap_b64_chars[ ((in[i] & 0x03) << 4) | (in[i + 1] >> 4) ];
+		*out++ = ropenldap_b64_chars[ ((in[i + 1] & 0x0f) << 2) | (in[i + 2] >> 6) ];
+		*out++ = ropenldap_b64_chars[ in[i + 2] & 0x3f ];
+	}
+
+	if ( i < len ) {
+		*out++ = ropenldap_b64_chars[ in[i] >> 2 ];
+		if ( i + 1 < len ) {
+			*out++ = ropenldap_b64_chars[ ((in[i] & 0x03) << 4) | (in[i + 1] >> 4) ];
+			*out++ = ropenldap_b64_chars[ (in[i + 1] & 0x0f) << 2 ];
+		} else {
+			*out++ = ropenldap_b64_chars[ (in[i] & 0x03) << 4 ];
+			*out++ = '=';
+		}
+		*out++ = '=';
+	}
+
+	return (size_t)( out - start );
+}
+
+
+/*
+ * Returns nonzero if +value+ can be written in LDIF as-is, i.e., if it's a
+ * SAFE-STRING (RFC 2849) that doesn't end with a space.
+ */
+static int
+ropenldap_ldif_is_safe( const struct berval *value )
+{
+	const unsigned char *p = (const unsigned char *)value->bv_val;
+	const unsigned char *end = p + value->bv_len;
+
+	if ( p == end ) return 1;
+	if ( ropenldap_ldif_unsafe_init[*p] || end[-1] == ' ' ) return 0;
+
+	for ( ; p < end; p++ )
+		if ( ropenldap_ldif_unsafe[*p] ) return 0;
+
+	return 1;
+}
+
+
+/*
+ * Returns nonzero if the +len+ bytes at +p+ are valid UTF-8.
+ */
+static int
+ropenldap_utf8_is_valid( const unsigned char *p, size_t len )
+{
+	const unsigned char *end = p + len;
+	long n, i;
+
+	while ( p < end ) {
+		if ( *p < 0x80 ) {
+			p++;
+			continue;
+		}
+
+		if ( *p >= 0xc2 && *p <= 0xdf )      n = 1;
+		else if ( *p >= 0xe0 && *p <= 0xef ) n = 2;
+		else if ( *p >= 0xf0 && *p <= 0xf4 ) n = 3;
+		else return 0;
+
+		if ( end - p <= n ) return 0;
+
+		/* Overlong forms, surrogates, and code points past U+10FFFF */
+		if ( (*p == 0xe0 && p[1] < 0xa0) || (*p == 0xed && p[1] > 0x9f) ||
+		     (*p == 0xf0 && p[1] < 0x90) || (*p == 0xf4 && p[1] > 0x8f) )
+			return 0;
+
+		for ( i = 1; i <= n; i++ )
+			if ( (p[i] & 0xc0) != 0x80 ) return 0;
+
+		p += n + 1;
+	}
+
+	return 1;
+}
+
+
+/*
+ * Write an LDIF line for the attribute +type+ with the given +value+, base64-encoding
+ * the value if it isn't safe and folding the line at the export's wrap column.
+ */
+static void
+ropenldap_export_ldif_line( struct ropenldap_result_export *export, const struct berval *type,
+                            const struct berval *value )
+{
+	int safe = ropenldap_ldif_is_safe( value );
+	size_t wrap = (size_t)export->wrap, folds = 0, len, start, seg, dst, i;
+	char *line, *p;
+
+	len = type->bv_len + ( safe ? 2 + value->bv_len : 3 + ROPENLDAP_B64_LEN(value->bv_len) );
+	if ( wrap && len > wrap ) folds = ( len - wrap + wrap - 2 ) / ( wrap - 1 );
+
+	line = p = ropenldap_export_reserve( export, len + folds * 2 + 1 );
+
+	memcpy( p, type->bv_val, type->bv_len );
+	p += type->bv_len;
+	*p++ = ':';
+
+	if ( safe ) {
+		*p++ = ' ';
+		memcpy( p, value->bv_val, value->bv_len );
+		p += value->bv_len;
+	} else {
+		*p++ = ':';
+		*p++ = ' ';
+		p += ropenldap_b64_encode( (const unsigned char *)value->bv_val, value->bv_len, p );
+	}
+
+	/* Fold in place, moving the continuations out from the last one back so nothing
+	 * is overwritten before it's moved */
+	if ( folds ) {
+		dst = len + folds * 2;
+		for ( i = folds; i > 0; i-- ) {
+			start = wrap + ( i - 1 ) * ( wrap - 1 );
+			seg = ( i == folds ? len : start + wrap - 1 ) - start;
+			dst -= seg;
+			memmove( line + dst, line + start, seg );
+			line[ --dst ] = ' ';
+			line[ --dst ] = '\n';
+		}
+		p = line + len + folds * 2;
+	}
+
+	*p++ = '\n';
+	ropenldap_export_commit( export, (size_t)(p - line) );
+}
+
+
+/*
+ * Write the +len+ bytes at +str+ as a JSON string.
+ */
+static void
+ropenldap_export_json_string( struct ropenldap_result_export *export, const char *str, size_t len )
+{
+	const unsigned char *in = (const unsigned char *)str, *end = in + len;
+	char *start, *p, esc;
+
+	start = p = ropenldap_export_reserve( export, len * 6 + 2 );
+	*p++ = '"';
+
+	for ( ; in < end; in++ ) {
+		if ( !(esc = ropenldap_json_escape[*in]) ) {
+			*p++ = (char)*in;
+			continue;
+		}
+
+		*p++ = '\\';
+		if ( esc == 'u' ) {
+			*p++ = 'u';
+			*p++ = '0';
+			*p++ = '0';
+			*p++ = ropenldap_hex_chars[ *in >> 4 ];
+			*p++ = ropenldap_hex_chars[ *in & 0x0f ];
+		} else {
+			*p++ = esc;
+		}
+	}
+
+	*p++ = '"';
+	ropenldap_export_commit( export, (size_t)(p - start) );
+}
+
+
+/*
+ * Write +value+ as a JSON string if it's valid UTF-8, or as a {"base64": "..."}
+ * object if it isn't.
+ */
+static void
+ropenldap_export_json_value( struct ropenldap_result_export *export, const struct berval *value )
+{
+	static const char prefix[] = "{\"base64\":\"";
+	char *start, *p;
+
+	if ( ropenldap_utf8_is_valid((const unsigned char *)value->bv_val, value->bv_len) ) {
+		ropenldap_export_json_string( export, value->bv_val, value->bv_len );
+		return;
+	}
+
+	start = p = ropenldap_export_reserve( export,
+		sizeof(prefix) - 1 + ROPENLDAP_B64_LEN(value->bv_len) + 2 );
+
+	memcpy( p, prefix, sizeof(prefix) - 1 );
+	p += sizeof( prefix ) - 1;
+	p += ropenldap_b64_encode( (const unsigned char *)value->bv_val, value->bv_len, p );
+	*p++ = '"';
+	*p++ = '}';
+
+	ropenldap_export_commit( export, (size_t)(p - start) );
+}
+
+
+/*
+ * Write the search +entry+ to the export's buffer, reading its DN and values in
+ * place from the message.
+ */
+static void
+ropenldap_export_entry( struct ropenldap_result_export *export, LDAP *ldap, LDAPMessage *entry )
+{
+	struct berval dn = BER_BVNULL, attr = BER_BVNULL, *value;
+	int ldif = ( export->format == ROPENLDAP_EXPORT_LDIF );
+	int res;
+
+	res = ldap_get_dn_ber( ldap, entry, &export->ber, &dn );
+	ropenldap_check_result( res, "ldap_get_dn_ber" );
+
+	if ( ldif ) {
+		ropenldap_export_ldif_line( export, &ropenldap_export_dn_type, &dn );
+	} else {
+		ropenldap_export_put( export, "{\"dn\":", 6 );
+		ropenldap_export_json_value( export, &dn );
+	}
+
+	for ( res = ldap_get_attribute_ber(ldap, entry, export->ber, &attr, &export->values);
+	      res == LDAP_SUCCESS && attr.bv_val != NULL;
+	      res = ldap_get_attribute_ber(ldap, entry, export->ber, &attr, &export->values) )
+	{
+		if ( ldif ) {
+			for ( value = export->values; value && value->bv_val; value++ )
+				ropenldap_export_ldif_line( export, &attr, value );
+		} else {
+			ropenldap_export_put( export, ",", 1 );
+			ropenldap_export_json_string( export, attr.bv_val, attr.bv_len );
+			ropenldap_export_put( export, ":[", 2 );
+			for ( value = export->values; value && value->bv_val; value++ ) {
+				if ( value != export->values ) ropenldap_export_put( export, ",", 1 );
+				ropenldap_export_json_value( export, value );
+			}
+			ropenldap_export_put( export, "]", 1 );
+		}
+
+		ber_memfree( export->values );
+		export->values = NULL;
+	}
+
+	ropenldap_check_result( res, "ldap_get_attribute_ber" );
+	ber_free( export->ber, 0 );
+	export->ber = NULL;
+
+	if ( ldif ) {
+		ropenldap_export_put( export, "\n", 1 );
+	} else {
+		ropenldap_export_put( export, "}\n", 2 );
+	}
+
+	export->count++;
+	export->complete = RSTRING_LEN( export->buffer );
+}
+
+
+/*
+ * Fetch, write, and free the messages of a search until the search result arrives;
+ * the body of Result#write_ldif and #write_ndjson.
+ */
+static VALUE
+ropenldap_result_export_body( VALUE arg )
+{
+	struct ropenldap_result_export *export = (struct ropenldap_result_export *)arg;
+	struct ropenldap_result_iter *iter = &export->iter;
+	struct ropenldap_result *ptr = ropenldap_get_result( iter->self );
+	LDAP *ldap = ropenldap_conn_get_ldap( ptr->connection );
+	LDAPMessage *msg;
+	int res;
+
+	if ( export->format == ROPENLDAP_EXPORT_LDIF ) {
+		ropenldap_export_put( export, "version: 1\n\n", 12 );
+		export->complete = RSTRING_LEN( export->buffer );
+	}
+
+	for ( ;; ) {
+		res = ropenldap_wait_for_result( ptr->connection, ptr->msgid, LDAP_MSG_ONE, NULL,
+		                                 &iter->msg );
+		if ( res <= 0 )
+			ropenldap_check_result( res ? res : LDAP_TIMEOUT, "ldap_result(%p, %d, ...)",
+			                        ldap, ptr->msgid );
+
+		switch ( res ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				ropenldap_export_entry( export, ldap, iter->msg );
+				ldap_msgfree( iter->msg );
+				iter->msg = NULL;
+				break;
+
+			case LDAP_RES_SEARCH_RESULT:
+				iter->done = 1;
+				ropenldap_export_flush( export );
+				msg = iter->msg;
+				iter->msg = NULL;
+				ropenldap_result_check_result( ldap, iter->self, msg );
+				return LONG2NUM( export->count );
+
+			default:
+				ropenldap_log_obj( iter->self, "debug", "Skipping message of type %x", res );
+				ldap_msgfree( iter->msg );
+				iter->msg = NULL;
+		}
+	}
+}
+
+
+/*
+ * Write the entries that were buffered before an export stopped early; called via
+ * rb_protect() so a failure to write them doesn't replace the exception that
+ * stopped it.
+ */
+static VALUE
+ropenldap_result_export_flush_complete( VALUE arg )
+{
+	struct ropenldap_result_export *export = (struct ropenldap_result_export *)arg;
+
+	rb_str_set_len( export->buffer, export->complete );
+	ropenldap_export_flush( export );
+
+	return Qnil;
+}
+
+
+/*
+ * Write out the entries buffered before an export stopped early and free its
+ * decoding state, then clean up as for Result#each_entry.
+ */
+static VALUE
+ropenldap_result_export_ensure( VALUE arg )
+{
+	struct ropenldap_result_export *export = (struct ropenldap_result_export *)arg;
+	int state = 0;
+
+	/* Unless it was writing to the IO that failed, write the entries that were
+	 * finished; a partly-buffered one is dropped */
+	if ( !export->writing && export->complete ) {
+		rb_protect( ropenldap_result_export_flush_complete, arg, &state );
+		if ( state ) rb_set_errinfo( Qnil );
+	}
+
+	if ( export->values ) {
+		ber_memfree( export->values );
+		export->values = NULL;
+	}
+
+	if ( export->ber ) {
+		ber_free( export->ber, 0 );
+		export->ber = NULL;
+	}
+
+	return ropenldap_result_each_entry_ensure( (VALUE)&export->iter );
+}
+
+
+/*
+ * Write the entries of the search +self+ to +io+ in the given +format+.
+ */
+static VALUE
+ropenldap_result_export( VALUE self, VALUE io, enum ropenldap_export_format format, long wrap )
+{
+	struct ropenldap_result_export export;
+	VALUE count;
+
+	memset( &export, 0, sizeof(export) );
+	export.iter.self = self;
+	export.format    = format;
+	export.io        = io;
+	export.wrap      = wrap;
+	export.buffer    = rb_str_buf_new( ROPENLDAP_EXPORT_CHUNK );
+	rb_enc_associate( export.buffer, rb_utf8_encoding() );
+
+	count = rb_ensure( ropenldap_result_export_body, (VALUE)&export,
+	                   ropenldap_result_export_ensure, (VALUE)&export );
+
+	RB_GC_GUARD( export.io );
+	RB_GC_GUARD( export.buffer );
+
+	return count;
+}
+
+
+/*
+ * call-seq:
+ *    result.write_ldif( io, wrap=76 )   -> integer
+ *
+ * Write the entries of the search to +io+ as LDIF as they arrive, returning the
+ * number of entries written. Entries are serialized straight from the messages
+ * into a buffer that's written to +io+ in 256k chunks, so exporting a search uses
+ * constant memory regardless of its size; the buffer is re-used, so +io+ mustn't
+ * hold on to the Strings it's given to #write.
+ *
+ * Values that aren't safe to write as-is are base64-encoded, and lines longer
+ * than +wrap+ columns are folded (pass 0 to disable folding). The output starts
+ * with a <tt>version: 1</tt> line, as RFC 2849 requires of LDIF files that
+ * contain entries. As with #each_entry, an appropriate exception is raised if the
+ * search wasn't successful, and the search is abandoned if the export stops
+ * early; the entries received before it stopped are still written to +io+.
+ *
+ *    File.open( 'people.ldif', 'w' ) do |io|
+ *      conn.search( base, :subtree, '(objectClass=person)' ).write_ldif( io )
+ *    end
+ */
+static VALUE
+ropenldap_result_write_ldif( int argc, VALUE *argv, VALUE self )
+{
+	VALUE io, wrap = Qnil;
+	long c_wrap = ROPENLDAP_EXPORT_LDIF_WRAP;
+
+	rb_scan_args( argc, argv, "11", &io, &wrap );
+
+	if ( !NIL_P(wrap) ) c_wrap = NUM2LONG( wrap );
+	if ( c_wrap < 0 || c_wrap == 1 )
+		rb_raise( rb_eArgError, "wrap must be 0 or at least 2" );
+
+	return ropenldap_result_export( self, io, ROPENLDAP_EXPORT_LDIF, c_wrap );
+}
+
+
+/*
+ * call-seq:
+ *    result.write_ndjson( io )   -> integer
+ *
+ * Write the entries of the search to +io+ as newline-delimited JSON as they
+ * arrive, one object per line with the entry's "dn" and an Array of the values of
+ * each of its attributes, returning the number of entries written. Values that
+ * aren't valid UTF-8 are written as <tt>{"base64": "..."}</tt> objects instead of
+ * Strings. The output is buffered and the search is consumed as for #write_ldif.
+ *
+ *    conn.search( base, :subtree ).write_ndjson( $stdout )
+ *    # {"dn":"dc=example,dc=com","objectClass":["top","dcObject"],"dc":["example"]}
+ */
+static VALUE
+ropenldap_result_write_ndjson( VALUE self, VALUE io )
+{
+	return ropenldap_result_export( self, io, ROPENLDAP_EXPORT_NDJSON, 0 );
+}
+
+
+
+/*
+ * Check the search result of a batched search; called via rb_protect() so a failed
+ * search doesn't stop the rest of the batch.
+ */
+static VALUE
+ropenldap_result_finish_batched( VALUE arg )
+{
+	struct ropenldap_result_finish *finish = (struct ropenldap_result_finish *)arg;
+	LDAPMessage *msg = finish->msg;
+
+	finish->msg = NULL;
+	ropenldap_result_check_result( finish->ldap, finish->result, msg );
+
+	return Qnil;
+}
+
+
+/*
+ * Collect the messages of all of the searches in a batch as they arrive, routing
+ * each one to its search by message ID; the body of Result.each_completed.
+ */
+static VALUE
+ropenldap_result_each_completed_body( VALUE arg )
+{
+	struct ropenldap_result_batch *batch = (struct ropenldap_result_batch *)arg;
+	LDAP *ldap = ropenldap_conn_get_ldap( batch->connection );
+	struct ropenldap_result_finish finish;
+	long size_hint = 0;
+	VALUE index, dn, attrs, result, entries, error;
+	int res, msgid, state;
+
+	while ( RHASH_SIZE(batch->pending) > 0 ) {
+		res = ropenldap_wait_for_result( batch->connection, LDAP_RES_ANY, LDAP_MSG_ONE, NULL,
+		                                 &batch->msg );
+		if ( res <= 0 )
+			ropenldap_check_result( res ? res : LDAP_TIMEOUT, "ldap_result(%p, ANY, ...)", ldap );
+
+		msgid = ldap_msgid( batch->msg );
+		index = rb_hash_lookup2( batch->pending, INT2FIX(msgid), Qnil );
+		if ( NIL_P(index) ) {
+			ldap_msgfree( batch->msg );
+			batch->msg = NULL;
+			ropenldap_check_foreign_message( batch->connection, msgid, res, "batch" );
+			continue;
+		}
+
+		switch ( res ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				ropenldap_decode_entry( ldap, batch->msg, ropenldap_conn_get_schema(batch->connection),
+				                        &size_hint, &dn, &attrs );
+				ldap_msgfree( batch->msg );
+				batch->msg = NULL;
+				rb_ary_push( rb_ary_entry(batch->entries, FIX2LONG(index)),
+				             rb_assoc_new(dn, attrs) );
+				break;
+
+			case LDAP_RES_SEARCH_RESULT:
+				rb_hash_delete( batch->pending, INT2FIX(ldap_msgid(batch->msg)) );
+				result = rb_ary_entry( batch->results, FIX2LONG(index) );
+				entries = rb_ary_entry( batch->entries, FIX2LONG(index) );
+				rb_ary_store( batch->entries, FIX2LONG(index), Qnil );
+
+				finish.ldap   = ldap;
+				finish.result = result;
+				finish.msg    = batch->msg;
+				batch->msg    = NULL;
+
+				state = 0;
+				rb_protect( ropenldap_result_finish_batched, (VALUE)&finish, &state );
+				if ( finish.msg ) ldap_msgfree( finish.msg );
+
+				error = Qnil;
+				if ( state ) {
+					error = rb_errinfo();
+					rb_set_errinfo( Qnil );
+					if ( !rb_obj_is_kind_of(error, rb_eStandardError) ) rb_jump_tag( state );
+				}
+
+				rb_yield_values( 4, index, result, entries, error );
+				break;
+
+			default:
+				ropenldap_log_obj( batch->connection, "debug", "Skipping message of type %x", res );
+				ldap_msgfree( batch->msg );
+				batch->msg = NULL;
+		}
+	}
+
+	return Qnil;
+}
+
+
+/*
+ * Abandon one of the searches left in a batch; rb_hash_foreach() callback.
+ */
+static int
+ropenldap_result_abandon_pending( VALUE msgid, VALUE index, VALUE arg )
+{
+	struct ropenldap_result_batch *batch = (struct ropenldap_result_batch *)arg;
+	VALUE result = rb_ary_entry( batch->results, FIX2LONG(index) );
+
+	ropenldap_log_obj( result, "debug", "Abandoning unfinished search %d", FIX2INT(msgid) );
+	ldap_abandon_ext( ropenldap_conn_get_ldap(batch->connection), FIX2INT(msgid), NULL, NULL );
+	ropenldap_get_result( result )->abandoned = Qtrue;
+
+	return ST_CONTINUE;
+}
+
+
+/*
+ * Free any message left over from Result.each_completed, and abandon the searches
+ * that hadn't finished if collection stopped early.
+ */
+static VALUE
+ropenldap_result_each_completed_ensure( VALUE arg )
+{
+	struct ropenldap_result_batch *batch = (struct ropenldap_result_batch *)arg;
+
+	if ( batch->msg ) {
+		ldap_msgfree( batch->msg );
+		batch->msg = NULL;
+	}
+
+	rb_hash_foreach( batch->pending, ropenldap_result_abandon_pending, arg );
+
+	return Qnil;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Result.each_completed( results ) {|index, result, entries, error| ... }
+ *
+ * Collect the entries of several +results+ of searches that were all sent on the
+ * same connection, reading messages for any of them as they arrive with
+ * ldap_result( LDAP_RES_ANY ) and routing each to its search by message ID. When
+ * a search finishes, the block is called with its index in +results+, the result,
+ * an Array of [dn, attributes] pairs for its entries, and the exception the search
+ * failed with (or +nil+ if it succeeded). If the block breaks, the searches that
+ * haven't finished are abandoned.
+ *
+ * Because it reads any message from the connection, no other operations can be
+ * outstanding on it while the batch is being collected: if a response to one
+ * arrives, an OpenLDAP::Error is raised and the unfinished searches are abandoned.
+ *
+ */
+static VALUE
+ropenldap_result_s_each_completed( VALUE klass, VALUE results )
+{
+	struct ropenldap_result_batch batch;
+	struct ropenldap_result *ptr;
+	long i;
+
+	Check_Type( results, T_ARRAY );
+	if ( RARRAY_LEN(results) == 0 ) return results;
+
+	batch.connection = ropenldap_get_result( RARRAY_AREF(results, 0) )->connection;
+	batch.results    = results;
+	batch.pending    = rb_hash_new();
+	batch.entries    = rb_ary_new2( RARRAY_LEN(results) );
+	batch.msg        = NULL;
+
+	for ( i = 0; i < RARRAY_LEN(results); i++ ) {
+		ptr = ropenldap_get_result( RARRAY_AREF(results, i) );
+		if ( ptr->connection != batch.connection )
+			rb_raise( rb_eArgError, "all results in a batch must be from the same connection" );
+
+		rb_hash_aset( batch.pending, INT2FIX(ptr->msgid), LONG2FIX(i) );
+		rb_ary_store( batch.entries, i, rb_ary_new() );
+	}
+
+	rb_ensure( ropenldap_result_each_completed_body, (VALUE)&batch,
+	           ropenldap_result_each_completed_ensure, (VALUE)&batch );
+
+	return results;
+}
+
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Result.next_completed( connection, pending, timeout=nil )   -> [result, error]
+ *
+ * Wait for the next of the operations in +pending+, a Hash of OpenLDAP::Results
+ * keyed by their message IDs, to finish on the +connection+. The finished result
+ * is removed from +pending+ and returned along with the exception it failed with
+ * (or +nil+ if it succeeded). Returns +nil+ if none finish within +timeout+
+ * seconds in all. Any search entries are discarded. Because it reads any message
+ * from the connection, only the operations in +pending+ can be outstanding on it;
+ * if a response to another one arrives, an OpenLDAP::Error is raised.
+ *
+ */
+static VALUE
+ropenldap_result_s_next_completed( int argc, VALUE *argv, VALUE klass )
+{
+	VALUE connection, pending, timeout = Qnil, result, error = Qnil;
+	LDAP *ldap;
+	struct ropenldap_result_finish finish;
+	struct timeval deadline, now, *c_timeout = NULL;
+	LDAPMessage *msg = NULL;
+	double seconds;
+	int res, msgid, state = 0;
+
+	rb_scan_args( argc, argv, "21", &connection, &pending, &timeout );
+	Check_Type( pending, T_HASH );
+	ldap = ropenldap_conn_get_ldap( connection );
+
+	if ( RHASH_SIZE(pending) == 0 ) return Qnil;
+
+	/* The timeout is for the whole call, so each wait gets what's left of it */
+	if ( !NIL_P(timeout) ) {
+		seconds = NUM2DBL( timeout );
+		c_timeout = ALLOCA_N( struct timeval, 1 );
+		c_timeout->tv_sec = (time_t)floor( seconds );
+		c_timeout->tv_usec = (suseconds_t)( fmod(seconds, 1.0) * MILLION_F );
+
+		ropenldap_monotonic_now( &deadline );
+		timeradd( &deadline, c_timeout, &deadline );
+	}
+
+	for ( ;; ) {
+		if ( c_timeout ) {
+			ropenldap_monotonic_now( &now );
+			if ( timercmp(&now, &deadline, <) ) {
+				timersub( &deadline, &now, c_timeout );
+			} else {
+				timerclear( c_timeout );
+			}
+		}
+
+		res = ropenldap_wait_for_result( connection, LDAP_RES_ANY, LDAP_MSG_ONE, c_timeout, &msg );
+		if ( res == 0 ) return Qnil;
+		if ( res < 0 ) ropenldap_check_result( res, "ldap_result(%p, ANY, ...)", ldap );
+
+		msgid = ldap_msgid( msg );
+		result = rb_hash_lookup2( pending, INT2FIX(msgid), Qnil );
+		if ( NIL_P(result) ) {
+			ldap_msgfree( msg );
+			msg = NULL;
+			ropenldap_check_foreign_message( connection, msgid, res, "pending operations" );
+			continue;
+		}
+
+		if ( res == LDAP_RES_SEARCH_ENTRY || res == LDAP_RES_SEARCH_REFERENCE ||
+		     res == LDAP_RES_INTERMEDIATE )
+		{
+			ropenldap_log_obj( connection, "debug", "Discarding message %d of type %x",
+			                   msgid, res );
+			ldap_msgfree( msg );
+			msg = NULL;
+			continue;
+		}
+
+		rb_hash_delete( pending, INT2FIX(msgid) );
+		break;
+	}
+
+	finish.ldap   = ldap;
+	finish.result = result;
+	finish.msg    = msg;
+
+	rb_protect( ropenldap_result_finish_batched, (VALUE)&finish, &state );
+	if ( finish.msg ) ldap_msgfree( finish.msg );
+
+	if ( state ) {
+		error = rb_errinfo();
+		rb_set_errinfo( Qnil );
+		if ( !rb_obj_is_kind_of(error, rb_eStandardError) ) rb_jump_tag( state );
+	}
+
+	return rb_assoc_new( result, error );
+}
+
+
+/*
+ * document-class: OpenLDAP::Result
+ */
+void
+ropenldap_init_result( void )
+{
+	int i;
+
+	ropenldap_log( "debug", "Initializing OpenLDAP::Result" );
+
+	id_socket = rb_intern_const( "socket" );
+
+	for ( i = 0; i < 256; i++ ) {
+		ropenldap_ldif_unsafe[i] = ( i == '\0' || i == '\n' || i == '\r' || i > 127 );
+		ropenldap_ldif_unsafe_init[i] =
+			( ropenldap_ldif_unsafe[i] || i == ' ' || i == ':' || i == '<' );
+		ropenldap_json_escape[i] = ( i < 0x20 ) ? 'u' : 0;
+	}
+	ropenldap_json_escape[ '"' ]  = '"';
+	ropenldap_json_escape[ '\\' ] = '\\';
+	ropenldap_json_escape[ '\b' ] = 'b';
+	ropenldap_json_escape[ '\f' ] = 'f';
+	ropenldap_json_escape[ '\n' ] = 'n';
+	ropenldap_json_escape[ '\r' ] = 'r';
+	ropenldap_json_escape[ '\t' ] = 't';
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::Result */
+	ropenldap_cOpenLDAPResult =
+		rb_define_class_under( ropenldap_mOpenLDAP, "Result", rb_cObject );
+
+	rb_define_alloc_func( ropenldap_cOpenLDAPResult, ropenldap_result_s_allocate );
+	rb_define_singleton_method( ropenldap_cOpenLDAPResult, "each_completed",
+	                            ropenldap_result_s_each_completed, 1 );
+	rb_define_singleton_method( ropenldap_cOpenLDAPResult, "next_completed",
+	                            ropenldap_result_s_next_completed, -1 );
+
+	rb_define_protected_method( ropenldap_cOpenLDAPResult, "initialize",
+	                            ropenldap_result_initialize, -1 );
+
+	rb_define_method( ropenldap_cOpenLDAPResult, "msgid", ropenldap_result_msgid, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "connection", ropenldap_result_connection, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "search_args", ropenldap_result_search_args, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "paged_cookie", ropenldap_result_paged_cookie, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "target_position",
+	                  ropenldap_result_target_position, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "content_count",
+	                  ropenldap_result_content_count, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "vlv_context", ropenldap_result_vlv_context, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "controls", ropenldap_result_controls, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "compare_result",
+	                  ropenldap_result_compare_result, 0 );
 
 	rb_define_method( ropenldap_cOpenLDAPResult, "abandon", ropenldap_result_abandon, -1 );
 	rb_define_method( ropenldap_cOpenLDAPResult, "fetch", ropenldap_result_fetch, -1 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "wait", ropenldap_result_wait, -1 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "completed?", ropenldap_result_completed_p, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "each_entry", ropenldap_result_each_entry, 0 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "write_ldif", ropenldap_result_write_ldif, -1 );
+	rb_define_method( ropenldap_cOpenLDAPResult, "write_ndjson", ropenldap_result_write_ndjson, 1 );
 
 	rb_require( "openldap/result" );
 }
@@ -0,0 +1,705 @@
+/*
+ * Ruby-OpenLDAP -- OpenLDAP::Schema class
+ * $Id$
+ *
+ * Authors
+ *
+ * - Michael Granger <ged@FaerieMUD.org>
+ * - Mahlon E. Smith <mahlon@martini.nu>
+ *
+ * Copyright (c) 2013 Michael Granger and Mahlon E. Smith
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice, this
+ *    list of conditions and the following disclaimer in the documentation and/or
+ *    other materials provided with the distribution.
+ *
+ *  * Neither the name of the authors, nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ */
+
+
+#include "openldap.h"
+
+
+
+
+/* --------------------------------------------------------------
+ * Declarations
+ * -------------------------------------------------------------- */
+VALUE ropenldap_cOpenLDAPSchema;
+
+static VALUE sym_string, sym_binary, sym_integer, sym_boolean, sym_time;
+
+/* The most superior types to follow when looking for an attribute's syntax */
+#define ROPENLDAP_SCHEMA_MAX_SUP 16
+
+/* The syntaxes (RFC 4517 and 4523) whose values aren't decoded as UTF-8 text */
+static const struct {
+	const char *oid;
+	int type;
+} ropenldap_schema_syntaxes[] = {
+	{ "1.3.6.1.4.1.1466.115.121.1.4",  ROPENLDAP_VALUE_BINARY },   /* Audio */
+	{ "1.3.6.1.4.1.1466.115.121.1.5",  ROPENLDAP_VALUE_BINARY },   /* Binary */
+	{ "1.3.6.1.4.1.1466.115.121.1.7",  ROPENLDAP_VALUE_BOOLEAN },  /* Boolean */
+	{ "1.3.6.1.4.1.1466.115.121.1.8",  ROPENLDAP_VALUE_BINARY },   /* Certificate */
+	{ "1.3.6.1.4.1.1466.115.121.1.9",  ROPENLDAP_VALUE_BINARY },   /* Certificate List */
+	{ "1.3.6.1.4.1.1466.115.121.1.10", ROPENLDAP_VALUE_BINARY },   /* Certificate Pair */
+	{ "1.3.6.1.4.1.1466.115.121.1.23", ROPENLDAP_VALUE_BINARY },   /* Fax */
+	{ "1.3.6.1.4.1.1466.115.121.1.24", ROPENLDAP_VALUE_TIME },     /* Generalized Time */
+	{ "1.3.6.1.4.1.1466.115.121.1.27", ROPENLDAP_VALUE_INTEGER },  /* INTEGER */
+	{ "1.3.6.1.4.1.1466.115.121.1.28", ROPENLDAP_VALUE_BINARY },   /* JPEG */
+	{ "1.3.6.1.4.1.1466.115.121.1.40", ROPENLDAP_VALUE_BINARY },   /* Octet String */
+	{ "1.3.6.1.4.1.1466.115.121.1.49", ROPENLDAP_VALUE_BINARY },   /* Supported Algorithm */
+};
+
+/* An attribute type in the schema, under one of its names or its OID */
+struct ropenldap_schema_attr {
+	struct ropenldap_attr_key key;   /* the name, for lookups */
+	char *syntax_oid;                /* the type's own SYNTAX, if it has one */
+	char *sup_oid;                   /* the type's SUP, if it has one */
+	const char *syntax;              /* the syntax, inherited from a SUP if need be */
+	int type;                        /* the ropenldap_value_type for the syntax */
+	char name[ 1 ];
+};
+
+/* OpenLDAP::Schema struct */
+struct ropenldap_schema {
+	st_table *attrs;
+	long count;
+	int stale;    /* superseded by a newer copy of the server's schema */
+};
+
+
+
+/* --------------------------------------------------------------
+ * Memory-management functions
+ * -------------------------------------------------------------- */
+
+/* st_foreach() callback for freeing an attribute type */
+static int
+ropenldap_schema_free_attr_i( st_data_t UNUSED(key), st_data_t value, st_data_t UNUSED(arg) )
+{
+	struct ropenldap_schema_attr *attr = (struct ropenldap_schema_attr *)value;
+
+	xfree( attr->syntax_oid );
+	xfree( attr->sup_oid );
+	xfree( attr );
+
+	return ST_CONTINUE;
+}
+
+
+/*
+ * Free the attribute types of the given +schema+.
+ */
+static void
+ropenldap_schema_clear( struct ropenldap_schema *ptr )
+{
+	if ( ptr->attrs ) {
+		st_foreach( ptr->attrs, ropenldap_schema_free_attr_i, 0 );
+		st_free_table( ptr->attrs );
+		ptr->attrs = NULL;
+	}
+	ptr->count = 0;
+}
+
+
+/*
+ * GC Free function
+ */
+static void
+ropenldap_schema_gc_free( void *data )
+{
+	struct ropenldap_schema *ptr = data;
+
+	if ( ptr ) {
+		ropenldap_schema_clear( ptr );
+		xfree( ptr );
+		ptr = NULL;
+	}
+}
+
+
+/*
+ * GC Size function
+ */
+static size_t
+ropenldap_schema_gc_size( const void *data )
+{
+	const struct ropenldap_schema *ptr = data;
+	size_t size = sizeof( struct ropenldap_schema );
+
+	if ( ptr && ptr->attrs ) {
+		size += st_memsize( ptr->attrs );
+		size += ptr->attrs->num_entries * sizeof( struct ropenldap_schema_attr );
+	}
+
+	return size;
+}
+
+
+static const rb_data_type_t ropenldap_schema_type = {
+	"OpenLDAP::Schema",
+	{
+		NULL,
+		ropenldap_schema_gc_free,
+		ropenldap_schema_gc_size,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+
+
+/* --------------------------------------------------------------
+ * Global functions
+ * -------------------------------------------------------------- */
+
+/*
+ * Object validity checker. Returns the data pointer.
+ */
+static struct ropenldap_schema *
+check_schema( VALUE self )
+{
+	return rb_check_typeddata( self, &ropenldap_schema_type );
+}
+
+
+/*
+ * Fetch the data pointer and check it for sanity.
+ */
+static struct ropenldap_schema *
+ropenldap_get_schema( VALUE self )
+{
+	struct ropenldap_schema *ptr = check_schema( self );
+
+	if ( !ptr->attrs ) rb_fatal( "Use of uninitialized OpenLDAP::Schema" );
+
+	return ptr;
+}
+
+
+/*
+ * Look up the attribute type +name+ (which is +len+ bytes long, and may have
+ * options) in the schema +ptr+, returning NULL if it isn't there.
+ */
+static struct ropenldap_schema_attr *
+ropenldap_schema_lookup( struct ropenldap_schema *ptr, const char *name, size_t len )
+{
+	const char *option = memchr( name, ';', len );
+	struct ropenldap_attr_key key = { name, option ? (size_t)(option - name) : len };
+	st_data_t value;
+
+	if ( st_lookup(ptr->attrs, (st_data_t)&key, &value) )
+		return (struct ropenldap_schema_attr *)value;
+
+	return NULL;
+}
+
+
+/*
+ * Return the ropenldap_value_type for values of the attribute +name+ (which is
+ * +len+ bytes long) in the OpenLDAP::Schema +schema+.
+ */
+int
+ropenldap_schema_value_type( VALUE schema, const char *name, size_t len )
+{
+	struct ropenldap_schema_attr *attr = ropenldap_schema_lookup( ropenldap_get_schema(schema),
+	                                                               name, len );
+
+	return attr ? attr->type : ROPENLDAP_VALUE_STRING;
+}
+
+
+/*
+ * Return the ropenldap_value_type for values with the syntax +oid+.
+ */
+static int
+ropenldap_schema_syntax_type( const char *oid )
+{
+	size_t i;
+
+	if ( !oid ) return ROPENLDAP_VALUE_STRING;
+
+	for ( i = 0; i < sizeof(ropenldap_schema_syntaxes) / sizeof(ropenldap_schema_syntaxes[0]); i++ )
+		if ( strcmp(oid, ropenldap_schema_syntaxes[i].oid) == 0 )
+			return ropenldap_schema_syntaxes[i].type;
+
+	return ROPENLDAP_VALUE_STRING;
+}
+
+
+/*
+ * Parse +len+ decimal digits at +ptr+ into +result+. Returns 0 if any of them
+ * aren't digits.
+ */
+static int
+ropenldap_parse_digits( const char *ptr, size_t len, int *result )
+{
+	size_t i;
+
+	*result = 0;
+	for ( i = 0; i < len; i++ ) {
+		if ( ptr[i] < '0' || ptr[i] > '9' ) return 0;
+		*result = *result * 10 + ( ptr[i] - '0' );
+	}
+
+	return 1;
+}
+
+
+/*
+ * Return the number of days from 1970-01-01 to the given civil date.
+ */
+static long
+ropenldap_days_from_civil( long year, int month, int day )
+{
+	long era, yoe, doy, doe;
+
+	year -= month <= 2;
+	era = ( year >= 0 ? year : year - 399 ) / 400;
+	yoe = year - era * 400;
+	doy = ( 153 * (month + (month > 2 ? -3 : 9)) + 2 ) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+
+/*
+ * Decode the GeneralizedTime (RFC 4517, 3.3.13) +len+ bytes at +ptr+ into a Time,
+ * or return Qundef if it isn't one.
+ */
+static VALUE
+ropenldap_decode_time( const char *ptr, size_t len )
+{
+	const char *end = ptr + len, *p = ptr;
+	int year, month, day, hour, minute = 0, second = 0, zhour = 0, zminute = 0;
+	int offset = INT_MAX - 1, unit = 3600;
+	long long nanos = 0, scale = 100000000LL;
+	struct timespec ts;
+
+	if ( len < 11 ||
+	     !ropenldap_parse_digits(p, 4, &year) || !ropenldap_parse_digits(p + 4, 2, &month) ||
+	     !ropenldap_parse_digits(p + 6, 2, &day) || !ropenldap_parse_digits(p + 8, 2, &hour) )
+		return Qundef;
+	p += 10;
+
+	if ( end - p >= 2 && ropenldap_parse_digits(p, 2, &minute) ) {
+		p += 2;
+		unit = 60;
+		if ( end - p >= 2 && ropenldap_parse_digits(p, 2, &second) ) {
+			p += 2;
+			unit = 1;
+		}
+	}
+
+	if ( p < end && (*p == '.' || *p == ',') ) {
+		if ( ++p == end || *p < '0' || *p > '9' ) return Qundef;
+		for ( ; p < end && *p >= '0' && *p <= '9'; p++ ) {
+			nanos += ( *p - '0' ) * scale;
+			scale /= 10;
+		}
+	}
+
+	if ( p == end ) return Qundef;
+	if ( *p == 'Z' ) {
+		p++;
+	} else if ( *p == '+' || *p == '-' ) {
+		if ( end - p < 3 || !ropenldap_parse_digits(p + 1, 2, &zhour) ) return Qundef;
+		if ( end - p >= 5 && !ropenldap_parse_digits(p + 3, 2, &zminute) ) return Qundef;
+		offset = ( zhour * 3600 + zminute * 60 ) * ( *p == '-' ? -1 : 1 );
+		p += end - p >= 5 ? 5 : 3;
+	} else {
+		return Qundef;
+	}
+
+	if ( p != end || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 ||
+	     minute > 59 || second > 60 || zhour > 23 || zminute > 59 )
+		return Qundef;
+
+	nanos *= unit;
+	ts.tv_sec = (time_t)( ropenldap_days_from_civil(year, month, day) * 86400L +
+	                      hour * 3600L + minute * 60L + second + nanos / 1000000000LL );
+	ts.tv_nsec = (long)( nanos % 1000000000LL );
+	if ( offset != INT_MAX - 1 ) ts.tv_sec -= offset;
+
+	return rb_time_timespec_new( &ts, offset );
+}
+
+
+/*
+ * Decode the INTEGER +len+ bytes at +ptr+ into an Integer, or return Qundef if it
+ * isn't one.
+ */
+static VALUE
+ropenldap_decode_integer( const char *ptr, size_t len )
+{
+	size_t i = ( len && ptr[0] == '-' ) ? 1 : 0, start = i;
+	long long value = 0;
+
+	if ( i == len ) return Qundef;
+	for ( ; i < len; i++ )
+		if ( ptr[i] < '0' || ptr[i] > '9' ) return Qundef;
+
+	if ( len - start > 18 )
+		return rb_str_to_inum( rb_usascii_str_new(ptr, len), 10, 1 );
+
+	for ( i = start; i < len; i++ )
+		value = value * 10 + ( ptr[i] - '0' );
+
+	return LL2NUM( start ? -value : value );
+}
+
+
+/*
+ * Return the value of the +len+ bytes at +ptr+ for an attribute with the given
+ * ROPENLDAP_ATTR_* +flags+, decoded as the ropenldap_value_type +type+. Values
+ * that aren't valid for their syntax are returned as Strings.
+ */
+VALUE
+ropenldap_typed_value( int type, const char *ptr, size_t len, int flags )
+{
+	VALUE value = Qundef;
+
+	switch ( type ) {
+		case ROPENLDAP_VALUE_BINARY:
+			flags |= ROPENLDAP_ATTR_BINARY;
+			break;
+
+		case ROPENLDAP_VALUE_INTEGER:
+			value = ropenldap_decode_integer( ptr, len );
+			break;
+
+		case ROPENLDAP_VALUE_BOOLEAN:
+			if ( len == 4 && memcmp(ptr, "TRUE", 4) == 0 ) value = Qtrue;
+			else if ( len == 5 && memcmp(ptr, "FALSE", 5) == 0 ) value = Qfalse;
+			break;
+
+		case ROPENLDAP_VALUE_TIME:
+			value = ropenldap_decode_time( ptr, len );
+			break;
+	}
+
+	if ( value != Qundef ) return value;
+	return ropenldap_attr_value( ptr, len, flags );
+}
+
+
+
+/* --------------------------------------------------------------
+ * Class methods
+ * -------------------------------------------------------------- */
+
+/*
+ * call-seq:
+ *    OpenLDAP::Schema.allocate   -> schema
+ *
+ * Allocate a new OpenLDAP::Schema object.
+ *
+ */
+static VALUE
+ropenldap_schema_s_allocate( VALUE klass )
+{
+	struct ropenldap_schema *ptr;
+	VALUE self = TypedData_Make_Struct( klass, struct ropenldap_schema, &ropenldap_schema_type, ptr );
+
+	ptr->attrs = NULL;
+	ptr->count = 0;
+	ptr->stale = 0;
+
+	return self;
+}
+
+
+
+/* --------------------------------------------------------------
+ * Instance methods
+ * -------------------------------------------------------------- */
+
+/*
+ * Add the attribute type +at+ to the schema +ptr+ under +name+.
+ */
+static void
+ropenldap_schema_add_attr( struct ropenldap_schema *ptr, const char *name, LDAPAttributeType *at )
+{
+	size_t len = strlen( name );
+	struct ropenldap_schema_attr *attr;
+	st_data_t key, old;
+
+	attr = (struct ropenldap_schema_attr *)xmalloc( sizeof(struct ropenldap_schema_attr) + len );
+	memcpy( attr->name, name, len + 1 );
+	attr->key.name   = attr->name;
+	attr->key.len    = len;
+	attr->syntax_oid = at->at_syntax_oid ? ruby_strdup( at->at_syntax_oid ) : NULL;
+	attr->sup_oid    = at->at_sup_oid ? ruby_strdup( at->at_sup_oid ) : NULL;
+	attr->syntax     = NULL;
+	attr->type       = ROPENLDAP_VALUE_STRING;
+
+	/* Later definitions of the same name replace earlier ones */
+	key = (st_data_t)&attr->key;
+	if ( st_delete(ptr->attrs, &key, &old) )
+		ropenldap_schema_free_attr_i( 0, old, 0 );
+	st_insert( ptr->attrs, (st_data_t)&attr->key, (st_data_t)attr );
+}
+
+
+/* st_foreach() callback for resolving the syntax of an attribute type,
+ * following its superior types if it doesn't have its own */
+static int
+ropenldap_schema_resolve_i( st_data_t UNUSED(key), st_data_t value, st_data_t arg )
+{
+	struct ropenldap_schema *ptr = (struct ropenldap_schema *)arg;
+	struct ropenldap_schema_attr *attr = (struct ropenldap_schema_attr *)value, *sup = attr;
+	int depth = 0;
+
+	while ( sup && !sup->syntax_oid && sup->sup_oid && depth++ < ROPENLDAP_SCHEMA_MAX_SUP )
+		sup = ropenldap_schema_lookup( ptr, sup->sup_oid, strlen(sup->sup_oid) );
+
+	attr->syntax = sup ? sup->syntax_oid : NULL;
+	attr->type = ropenldap_schema_syntax_type( attr->syntax );
+
+	return ST_CONTINUE;
+}
+
+
+/*
+ * call-seq:
+ *    OpenLDAP::Schema.new( attribute_types )   -> schema
+ *
+ * Create a new schema from the +attribute_types+ values of a subschema subentry
+ * (RFC 4512, 4.1.2). Definitions that can't be parsed are logged and skipped.
+ *
+ *    schema = OpenLDAP::Schema.new( subschema['attributeTypes'] )
+ */
+static VALUE
+ropenldap_schema_initialize( VALUE self, VALUE attribute_types )
+{
+	struct ropenldap_schema *ptr = check_schema( self );
+	LDAPAttributeType *at;
+	const char *errp;
+	char **name;
+	int code;
+	long i;
+
+	attribute_types = rb_Array( attribute_types );
+
+	ropenldap_schema_clear( ptr );
+	ptr->attrs = st_init_table( &ropenldap_attr_key_type );
+
+	for ( i = 0; i < RARRAY_LEN(attribute_types); i++ ) {
+		VALUE definition = rb_obj_as_string( RARRAY_AREF(attribute_types, i) );
+
+		at = ldap_str2attributetype( StringValueCStr(definition), &code, &errp,
+		                             LDAP_SCHEMA_ALLOW_ALL );
+		if ( !at ) {
+			ropenldap_log_obj( self, "warn", "Skipping attribute type %s: %s at %s",
+			                   RSTRING_PTR(definition), ldap_scherr2str(code), errp );
+			continue;
+		}
+
+		if ( at->at_oid ) ropenldap_schema_add_attr( ptr, at->at_oid, at );
+		for ( name = at->at_names; name && *name; name++ )
+			ropenldap_schema_add_attr( ptr, *name, at );
+
+		ldap_attributetype_free( at );
+		ptr->count++;
+	}
+
+	st_foreach( ptr->attrs, ropenldap_schema_resolve_i, (st_data_t)ptr );
+	ropenldap_log_obj( self, "debug", "Loaded %ld attribute types", ptr->count );
+
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    schema.expire   -> schema
+ *
+ * Mark the schema as stale: the server's schema has been fetched again (or is to
+ * be), so connections decoding values with this one switch to the current one the
+ * next time they decode an entry.
+ */
+static VALUE
+ropenldap_schema_expire( VALUE self )
+{
+	ropenldap_get_schema( self )->stale = 1;
+	return self;
+}
+
+
+/*
+ * call-seq:
+ *    schema.stale?   -> true or false
+ *
+ * Returns +true+ if the schema has been superseded (see #expire).
+ */
+static VALUE
+ropenldap_schema_stale_p( VALUE self )
+{
+	return ropenldap_get_schema( self )->stale ? Qtrue : Qfalse;
+}
+
+
+/*
+ * Returns non-zero if the OpenLDAP::Schema +schema+ has been superseded.
+ */
+int
+ropenldap_schema_is_stale( VALUE schema )
+{
+	return ropenldap_get_schema( schema )->stale;
+}
+
+
+/*
+ * call-seq:
+ *    schema.size   -> integer
+ *
+ * Return the number of attribute types in the schema.
+ */
+static VALUE
+ropenldap_schema_size( VALUE self )
+{
+	struct ropenldap_schema *ptr = ropenldap_get_schema( self );
+	return LONG2NUM( ptr->count );
+}
+
+
+/*
+ * call-seq:
+ *    schema.syntax( attribute )   -> string or nil
+ *
+ * Return the OID of the syntax of the given +attribute+ (following its superior
+ * types if need be), or +nil+ if the attribute isn't in the schema or has no
+ * syntax.
+ *
+ *    schema.syntax( 'uidNumber' )
+ *    # => "1.3.6.1.4.1.1466.115.121.1.27"
+ */
+static VALUE
+ropenldap_schema_syntax( VALUE self, VALUE attribute )
+{
+	struct ropenldap_schema *ptr = ropenldap_get_schema( self );
+	struct ropenldap_schema_attr *attr;
+
+	attribute = rb_obj_as_string( attribute );
+	attr = ropenldap_schema_lookup( ptr, RSTRING_PTR(attribute), RSTRING_LEN(attribute) );
+
+	if ( !attr || !attr->syntax ) return Qnil;
+	return rb_usascii_str_new_cstr( attr->syntax );
+}
+
+
+/*
+ * call-seq:
+ *    schema.value_type( attribute )   -> symbol or nil
+ *
+ * Return how the values of the given +attribute+ are decoded: one of +:string+,
+ * +:binary+, +:integer+, +:boolean+, or +:time+. Returns +nil+ if the attribute
+ * isn't in the schema.
+ *
+ *    schema.value_type( 'createTimestamp' )
+ *    # => :time
+ */
+static VALUE
+ropenldap_schema_value_type_m( VALUE self, VALUE attribute )
+{
+	struct ropenldap_schema *ptr = ropenldap_get_schema( self );
+	struct ropenldap_schema_attr *attr;
+
+	attribute = rb_obj_as_string( attribute );
+	attr = ropenldap_schema_lookup( ptr, RSTRING_PTR(attribute), RSTRING_LEN(attribute) );
+	if ( !attr ) return Qnil;
+
+	switch ( attr->type ) {
+		case ROPENLDAP_VALUE_BINARY:  return sym_binary;
+		case ROPENLDAP_VALUE_INTEGER: return sym_integer;
+		case ROPENLDAP_VALUE_BOOLEAN: return sym_boolean;
+		case ROPENLDAP_VALUE_TIME:    return sym_time;
+		default:                      return sym_string;
+	}
+}
+
+
+/*
+ * call-seq:
+ *    schema.decode( attribute, value )   -> object
+ *
+ * Decode the String +value+ of the given +attribute+ the same way values of
+ * entries are decoded for connections that use the schema.
+ *
+ *    schema.decode( 'uidNumber', '1000' )       # => 1000
+ *    schema.decode( 'modifyTimestamp', '20240102030405Z' )
+ *    # => 2024-01-02 03:04:05 UTC
+ */
+static VALUE
+ropenldap_schema_decode( VALUE self, VALUE attribute, VALUE value )
+{
+	int flags = 0, type;
+	VALUE name = ropenldap_attr_key( attribute, &flags );
+
+	StringValue( value );
+	type = ropenldap_schema_value_type( self, RSTRING_PTR(name), RSTRING_LEN(name) );
+
+	return ropenldap_typed_value( type, RSTRING_PTR(value), RSTRING_LEN(value), flags );
+}
+
+
+
+/*
+ * document-class: OpenLDAP::Schema
+ */
+void
+ropenldap_init_schema( void )
+{
+	ropenldap_log( "debug", "Initializing OpenLDAP::Schema" );
+
+	sym_string  = ID2SYM( rb_intern("string") );
+	sym_binary  = ID2SYM( rb_intern("binary") );
+	sym_integer = ID2SYM( rb_intern("integer") );
+	sym_boolean = ID2SYM( rb_intern("boolean") );
+	sym_time    = ID2SYM( rb_intern("time") );
+
+#ifdef FOR_RDOC
+	ropenldap_mOpenLDAP = rb_define_module( "OpenLDAP" );
+#endif
+
+	/* OpenLDAP::Schema */
+	ropenldap_cOpenLDAPSchema = rb_define_class_under( ropenldap_mOpenLDAP, "Schema", rb_cObject );
+	rb_define_alloc_func( ropenldap_cOpenLDAPSchema, ropenldap_schema_s_allocate );
+
+	rb_define_method( ropenldap_cOpenLDAPSchema, "initialize", ropenldap_schema_initialize, 1 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "size", ropenldap_schema_size, 0 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "syntax", ropenldap_schema_syntax, 1 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "value_type", ropenldap_schema_value_type_m, 1 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "decode", ropenldap_schema_decode, 2 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "expire", ropenldap_schema_expire, 0 );
+	rb_define_method( ropenldap_cOpenLDAPSchema, "stale?", ropenldap_schema_stale_p, 0 );
+
+	rb_require( "openldap/schema" );
+}
+
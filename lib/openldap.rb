@@ -70,6 +70,23 @@ module OpenLDAP
 
 	# Load the remaining Ruby parts of the library
 	require 'openldap/exceptions'
+	require 'openldap/connection_pool'
+	require 'openldap/bulk_writer'
+	require 'openldap/bind_verifier'
+	require 'openldap/search_cache'
+
+
+	# Keep the log level cached by the extension in sync with the logger's
+	self.logger.extend( OpenLDAP::LogLevelCaching )
+
+
+	### Set the logger used by the library to +newlogger+, keeping the log level cached
+	### by the extension in sync with it.
+	def self::logger=( newlogger )
+		super
+		self.logger.extend( OpenLDAP::LogLevelCaching )
+		self.cache_log_level
+	end
 
 
 	### Shortcut connection method: return a OpenLDAP::Connection object that will use
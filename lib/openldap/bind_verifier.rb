@@ -0,0 +1,265 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'thread'
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+require 'openldap/connection_pool'
+
+# A service that checks credentials with simple binds on a pool of connections
+# kept just for that purpose. Each check returns a status instead of raising, and
+# binds for a batch of checks are spread across the connections so they're in
+# flight at the same time.
+#
+# A bind replaces the identity of the connection it's sent on, so connections are
+# never re-bound between checks; each one is only re-opened and bound again when
+# the pool finds it's no longer usable.
+#
+#   verifier = OpenLDAP::BindVerifier.new( 'ldap://ldap.example.com',
+#       size: 16, start_tls: { tls_require_cert: :demand } )
+#
+#   case verifier.verify( user_dn, password )
+#   when :accepted then log_in( user_dn )
+#   when :locked   then show_locked_page
+#   else                show_login_form
+#   end
+#
+class OpenLDAP::BindVerifier
+	extend Loggability
+
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# Default options for new BindVerifiers; any others are passed on to the
+	# OpenLDAP::ConnectionPool
+	DEFAULT_OPTIONS = {
+		:size            => 8,
+		:timeout         => 5.0,
+		:password_policy => true,
+	}
+
+	# The statuses a check can return
+	STATUSES = [ :accepted, :rejected, :locked, :expired ]
+
+	# The exceptions which mean the server refused the credentials. Some servers also
+	# refuse binds for locked accounts or expired passwords with these, but only the
+	# password policy response control says which it was.
+	REJECTED_ERRORS = [
+		OpenLDAP::InvalidCredentials,
+		OpenLDAP::InappropriateAuth,
+		OpenLDAP::UnwillingToPerform,
+		OpenLDAP::ConstraintViolation,
+	]
+
+
+	### Create a new verifier that checks credentials on up to +:size+ connections to
+	### one of the specified +urls+. The last argument can be a Hash of options; any
+	### options not listed below are passed on to the OpenLDAP::ConnectionPool.
+	###
+	### [:timeout]          The number of seconds to wait for the response to a bind
+	###                     before raising an OpenLDAP::Timeout.
+	### [:password_policy]  If true, binds are sent with the password policy request
+	###                     control, so servers which support it can report locked
+	###                     and expired accounts.
+	def initialize( *urls )
+		options = if urls.last.is_a?( Hash ) then urls.pop else {} end
+		options = DEFAULT_OPTIONS.merge( options )
+
+		@timeout  = Float( options.delete(:timeout) )
+		@controls = nil
+		@controls = [ OpenLDAP::Control.new(OpenLDAP::LDAP_CONTROL_PASSWORDPOLICYREQUEST) ] if
+			options.delete( :password_policy )
+
+		@pool   = OpenLDAP::ConnectionPool.new( *urls, options )
+		@mutex  = Mutex.new
+		@counts = STATUSES.each_with_object( {} ) {|status, counts| counts[status] = 0 }
+	end
+
+
+	######
+	public
+	######
+
+	# The pool of connections the binds are sent on
+	attr_reader :pool
+
+	# The number of seconds to wait for the response to a bind
+	attr_reader :timeout
+
+
+	### Check the +password+ of the entry with the given +dn+, returning one of:
+	###
+	### [:accepted]  The credentials are valid.
+	### [:rejected]  The credentials are wrong, or either of them is empty.
+	### [:locked]    The account is locked, according to the server's password policy
+	###              response control.
+	### [:expired]   The password is right but has expired, according to the server's
+	###              password policy response control.
+	###
+	### Raises an appropriate exception only if the check itself couldn't be done.
+	def verify( dn, password )
+		return self.record( :rejected ) if blank?( dn ) || blank?( password )
+
+		@pool.with_connection do |conn|
+			result = self.start_bind( conn, dn, password )
+			return self.finish_bind( conn, result )
+		end
+	end
+
+
+	### Check a batch of +credentials+, each of which is a [dn, password] pair, and
+	### return their statuses in the same order (see #verify). The binds are spread
+	### across as many of the pool's connections as are free, so up to the size of the
+	### pool are in flight at once. If a check can't be done, the exception is raised
+	### once the connections with binds still in flight have been discarded, since a
+	### bind can't be abandoned.
+	def verify_many( credentials )
+		statuses = Array.new( credentials.length )
+		queue = []
+		credentials.each_with_index do |(dn, password), index|
+			if blank?( dn ) || blank?( password )
+				statuses[ index ] = self.record( :rejected )
+			else
+				queue << [ dn, password, index ]
+			end
+		end
+		return statuses if queue.empty?
+
+		conns = self.checkout_connections( queue.length )
+		inflight = []
+		conn = failed = nil
+
+		begin
+			conns.each do |pooled|
+				break if queue.empty?
+				conn = pooled
+				dn, password, index = queue.shift
+				inflight << [ conn, self.start_bind(conn, dn, password), index ]
+			end
+
+			until inflight.empty?
+				conn, result, index = inflight.first
+				statuses[ index ] = self.finish_bind( conn, result )
+				inflight.shift
+				next if queue.empty?
+
+				dn, password, index = queue.shift
+				inflight << [ conn, self.start_bind(conn, dn, password), index ]
+			end
+		rescue *OpenLDAP::ConnectionPool::CONNECTION_ERRORS
+			failed = conn
+			raise
+		ensure
+			unfinished = inflight.map( &:first )
+			conns.each do |pooled|
+				if pooled.equal?( failed ) || unfinished.any? {|busy| busy.equal?(pooled) }
+					@pool.discard( pooled )
+				else
+					@pool.checkin( pooled )
+				end
+			end
+		end
+
+		return statuses
+	end
+
+
+	### Return a Hash of the number of checks that have returned each status.
+	def stats
+		return @mutex.synchronize { @counts.dup }
+	end
+
+
+	### Unbind the verifier's connections.
+	def close
+		@pool.close
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %p %s>" % [
+			self.class,
+			self.object_id * 2,
+			@pool,
+			self.stats.map {|status, count| "#{status}: #{count}" }.join( ', ' ),
+		]
+	end
+
+
+	#########
+	protected
+	#########
+
+	### Send the bind for the +dn+ and +password+ on +conn+ and return its Result.
+	def start_bind( conn, dn, password )
+		return conn.bind_async( dn.to_s, password.to_s, @controls )
+	end
+
+
+	### Wait for the bind +result+ on +conn+ to finish and return its status.
+	def finish_bind( conn, result )
+		completed, error = OpenLDAP::Result.next_completed( conn, {result.msgid => result}, @timeout )
+		raise OpenLDAP::Timeout, "bind verification after %0.3fs" % [ @timeout ] unless completed
+
+		return self.record( self.status_for(completed, error) )
+	end
+
+
+	### Return the status for the finished bind +result+ which failed with +error+ (or
+	### succeeded, if +error+ is +nil+). Errors which aren't about the credentials are
+	### raised.
+	def status_for( result, error )
+		return :accepted unless error
+
+		policy_error = Array( result.controls ).map( &:password_policy_error ).compact.first
+		return :locked if policy_error == :account_locked
+		return :expired if policy_error == :password_expired
+
+		raise( error ) unless REJECTED_ERRORS.any? {|klass| error.is_a?(klass) }
+		return :rejected
+	end
+
+
+	### Check out the first connection in the pool to come free, and up to
+	### +count+ - 1 others if they're available without waiting.
+	def checkout_connections( count )
+		conns = [ @pool.checkout ]
+
+		while conns.length < count
+			begin
+				conns << @pool.checkout( 0 )
+			rescue OpenLDAP::CheckoutTimeout
+				break
+			end
+		end
+
+		return conns
+	rescue Exception
+		conns.each {|conn| @pool.checkin(conn) } if conns
+		raise
+	end
+
+
+	### Count a check that returned +status+, and return the +status+.
+	def record( status )
+		@mutex.synchronize { @counts[status] += 1 }
+		return status
+	end
+
+
+	#######
+	private
+	#######
+
+	### Returns +true+ if +value+ is nil or empty once it's converted to a String;
+	### binds with an empty password are unauthenticated binds, which many servers
+	### allow, so they're rejected without asking the server.
+	def blank?( value )
+		return value.nil? || value.to_s.empty?
+	end
+
+end # class OpenLDAP::BindVerifier
+
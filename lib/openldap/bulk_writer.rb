@@ -0,0 +1,198 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+
+# A pipeline of write operations on one OpenLDAP::Connection. Up to +window+
+# operations are kept outstanding at once, and their completions are collected by
+# message ID as they arrive, so a stream of writes costs about one round trip per
+# window instead of one per operation. Operations that fail are reported without
+# stopping the stream.
+#
+#   writer = conn.bulk_writer( window: 64 ) do |operation, error|
+#       $stderr.puts "%p failed: %s" % [ operation, error.message ]
+#   end
+#
+#   users.each do |dn, mail|
+#       writer.modify( dn, mail: mail )
+#   end
+#   writer.finish
+#
+class OpenLDAP::BulkWriter
+	extend Loggability
+
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# The default number of operations to keep outstanding
+	DEFAULT_WINDOW = 32
+
+	# The kinds of operations the writer can send
+	OPERATIONS = %i[ add modify delete rename ]
+
+
+	### Create a new BulkWriter that will send operations on the given +connection+,
+	### keeping up to +window+ of them outstanding at once. If an +error_handler+ block
+	### is given, it's called with the operation (an Array of the operation name and
+	### its arguments) and the exception of each one that fails; otherwise the failures
+	### are collected in #errors.
+	def initialize( connection, window: DEFAULT_WINDOW, &error_handler )
+		raise ArgumentError, "window must be at least 1" unless window >= 1
+
+		@connection    = connection
+		@window        = Integer( window )
+		@error_handler = error_handler
+		@pending       = {}
+		@operations    = {}
+		@errors        = []
+
+		@sent      = 0
+		@succeeded = 0
+		@failed    = 0
+	end
+
+
+	######
+	public
+	######
+
+	# The connection the operations are sent on
+	attr_reader :connection
+
+	# The maximum number of operations outstanding at once
+	attr_reader :window
+
+	# [operation, exception] pairs for failed operations, if there's no error handler
+	attr_reader :errors
+
+	# The number of operations sent so far
+	attr_reader :sent
+
+	# The number of operations that have finished successfully
+	attr_reader :succeeded
+
+	# The number of operations that have failed
+	attr_reader :failed
+
+
+	### Queue a request to add an entry; see Connection#add.
+	def add( dn, attributes, controls=nil )
+		return self.send_operation( :add, dn, attributes, controls )
+	end
+
+
+	### Queue a request to modify an entry; see Connection#modify.
+	def modify( dn, mods, controls=nil )
+		return self.send_operation( :modify, dn, mods, controls )
+	end
+
+
+	### Queue a request to delete an entry; see Connection#delete.
+	def delete( dn, controls=nil )
+		return self.send_operation( :delete, dn, controls )
+	end
+
+
+	### Queue a request to rename an entry; see Connection#rename.
+	def rename( dn, newrdn, newsuperior=nil, delete_old_rdn=true, controls=nil )
+		return self.send_operation( :rename, dn, newrdn, newsuperior, delete_old_rdn, controls )
+	end
+
+
+	### Queue an +operation+ given as an Array of an operation name (one of OPERATIONS)
+	### followed by its arguments.
+	###
+	###    writer << [ :delete, 'cn=old,dc=example,dc=com' ]
+	###
+	def <<( operation )
+		name, *args = operation
+		raise ArgumentError, "unknown operation %p" % [ name ] unless
+			OPERATIONS.include?( name )
+
+		self.send_operation( name, *args )
+		return self
+	end
+
+
+	### Return the number of operations that have been sent but haven't finished.
+	def outstanding
+		return @pending.length
+	end
+
+
+	### Wait for all of the outstanding operations to finish.
+	def finish
+		self.reap until @pending.empty?
+		return self
+	end
+
+
+	### Return a Hash of counts of the operations the writer has handled.
+	def stats
+		return {
+			sent:        @sent,
+			succeeded:   @succeeded,
+			failed:      @failed,
+			outstanding: @pending.length,
+		}
+	end
+
+
+	#########
+	protected
+	#########
+
+	### Send the operation +name+ with the given +args+, waiting for earlier ones to
+	### finish first if the window is full.
+	def send_operation( name, *args )
+		self.reap while @pending.length >= @window
+
+		begin
+			result = @connection.send( "#{name}_async", *args )
+		rescue OpenLDAP::ServerDown, OpenLDAP::ConnectError
+			raise
+		rescue OpenLDAP::Error => err
+			# Requests the library refuses to send are reported like ones the server
+			# refused; bad arguments are the caller's bug, so they're raised instead
+			self.handle_failure( [name, *args], err )
+			return nil
+		end
+
+		@pending[ result.msgid ] = result
+		@operations[ result.msgid ] = [ name, *args ]
+		@sent += 1
+
+		return result
+	end
+
+
+	### Wait for the next outstanding operation to finish and record its outcome.
+	def reap
+		result, error = OpenLDAP::Result.next_completed( @connection, @pending )
+		operation = @operations.delete( result.msgid )
+
+		if error
+			self.handle_failure( operation, error )
+		else
+			@succeeded += 1
+		end
+	end
+
+
+	### Record the failure of +operation+ with the given +error+.
+	def handle_failure( operation, error )
+		@failed += 1
+		self.log.debug "%p failed: %s" % [ operation, error.message ]
+
+		if @error_handler
+			@error_handler.call( operation, error )
+		else
+			@errors << [ operation, error ]
+		end
+	end
+
+end # class OpenLDAP::BulkWriter
+
@@ -21,6 +21,18 @@ class OpenLDAP::Connection
 	# Default TLS options to set before STARTTLS
 	DEFAULT_TLS_OPTIONS = {}
 
+	# The default number of entries to request per page in #search_paged
+	DEFAULT_PAGE_SIZE = 500
+
+	# Mapping of names of modification operations into the values used by the
+	# underlying library.
+	MODIFICATION_OPS = {
+		:add       => OpenLDAP::LDAP_MOD_ADD,
+		:delete    => OpenLDAP::LDAP_MOD_DELETE,
+		:replace   => OpenLDAP::LDAP_MOD_REPLACE,
+		:increment => OpenLDAP::LDAP_MOD_INCREMENT,
+	}
+
 	# Mapping of names of TLS peer certificate-checking strategies into Fixnum values used by
 	# the underlying library.
 	TLS_REQUIRE_CERT_STRATEGIES = {
@@ -75,6 +87,10 @@ class OpenLDAP::Connection
 	public
 	######
 
+	# The OpenLDAP::SearchCache used by #cached_search, if any
+	attr_accessor :search_cache
+
+
 	### Initiate TLS processing on the LDAP session. If called without a block, the call returns
 	### when TLS handlers have been installed. If called with the block, the call runs asyncronously
 	### and calls the block when TLS is installed. If there is an error, or TLS is already set up on
@@ -159,6 +175,330 @@ class OpenLDAP::Connection
 	end
 
 
+	### Search the directory under +base+ a page of +page_size+ entries at a time using
+	### the paged results control (RFC 2696), calling the block with the DN and a Hash
+	### of the attributes of each entry. Each page is requested with the cookie from
+	### the previous one until the server indicates the search is finished. Returns an
+	### Enumerator if called without a block. If the search is stopped before the last
+	### page (e.g., by breaking out of the block), the server is told to discard the
+	### rest of the pages.
+	###
+	###    conn.search_paged( base, :subtree, '(objectClass=person)', page_size: 1000 ) do |dn, attrs|
+	###        ...
+	###    end
+	###
+	def search_paged( base, scope=:subtree, filter='(objectClass=*)', attrs=nil,
+	                  page_size: DEFAULT_PAGE_SIZE, &block )
+		return enum_for( __method__, base, scope, filter, attrs, page_size: page_size ) unless block
+
+		cookie = nil
+		loop do
+			result = self._search_page( page_size, cookie, base, scope, filter, attrs )
+			result.each_entry( &block )
+
+			cookie = result.paged_cookie
+			break if cookie.nil? || cookie.empty?
+			self.log.debug "Fetching the next page of %d entries" % [ page_size ]
+		end
+
+		return self
+	ensure
+		self.release_paged_search( cookie, base, scope, filter, attrs ) unless
+			cookie.nil? || cookie.empty?
+	end
+
+
+	### Send a batch of +searches+ back-to-back and collect their entries as the responses
+	### arrive, so the whole batch takes about one round trip instead of one per search.
+	### Each of the +searches+ is an Array of arguments to #search.
+	###
+	### If called with a block, it's called with the index of each search in +searches+,
+	### an Array of [dn, attributes] pairs for its entries, and the exception it failed
+	### with (or +nil+) as each search completes. Otherwise the entries of each search are
+	### returned in the same order as the +searches+, and the first failed search's
+	### exception is raised once they've all finished.
+	###
+	###    groups, roles = conn.search_many([
+	###        [ 'ou=Groups,dc=example,dc=com', :one, "(member=#{user_dn})", ['cn'] ],
+	###        [ 'ou=Roles,dc=example,dc=com', :one, "(roleOccupant=#{user_dn})", ['cn'] ],
+	###    ])
+	###
+	def search_many( searches )
+		results = []
+		begin
+			searches.each {|args| results << self.search(*args) }
+		rescue
+			results.each( &:abandon )
+			raise
+		end
+
+		if block_given?
+			OpenLDAP::Result.each_completed( results ) do |index, _, entries, error|
+				yield( index, entries, error )
+			end
+			return nil
+		end
+
+		collected = Array.new( results.length )
+		errors = Array.new( results.length )
+		OpenLDAP::Result.each_completed( results ) do |index, _, entries, error|
+			collected[ index ] = entries
+			errors[ index ] = error
+		end
+
+		if ( error = errors.compact.first )
+			raise error
+		end
+
+		return collected
+	end
+
+
+	### Start a search of the directory under +base+ whose entries are sorted by the
+	### server (RFC 2891) by the +sort+ keys, and return its OpenLDAP::Result. Each key
+	### is an attribute name, optionally prefixed with '-' to reverse the order and
+	### suffixed with ':<matching rule OID>'; they can be given as an Array or a String
+	### of space-separated keys.
+	###
+	### If a +window+ is given, only that part of the sorted list is returned using the
+	### Virtual List View control, and the result's #target_position and #content_count
+	### are set once it's been read. The +window+ can be a Range of (1-based) positions,
+	### or a Hash with the keys:
+	###
+	### [:offset]         The position of the target entry.
+	### [:value]          Instead of an +:offset+, target the first entry whose first
+	###                   sort key is greater than or equal to this value.
+	### [:before]         The number of entries before the target to return.
+	### [:after]          The number of entries after the target to return.
+	### [:content_count]  The server's last estimate of the number of entries (from
+	###                   Result#content_count), or 0 if it isn't known yet.
+	### [:context]        The Result#vlv_context from the previous request, if any.
+	###
+	###    # Rows 5000-5050 of all people, sorted by surname
+	###    result = conn.search_sorted( base, :subtree, '(objectClass=person)', %w[cn sn],
+	###        sort: 'sn', window: 5000..5050 )
+	###    rows = result.to_a
+	###    total = result.content_count
+	###
+	def search_sorted( base, scope=:subtree, filter='(objectClass=*)', attrs=nil,
+	                   sort:, window: nil )
+		sort_keys = Array( sort ).map( &:to_s ).join( ' ' )
+		vlv = self.make_vlv_window( window ) if window
+
+		return self._search_sorted( sort_keys, vlv, base, scope, filter, attrs )
+	end
+
+
+	### Search the directory under +base+ and return an Array of the [dn, attributes]
+	### pairs of the entries found. If the connection has a #search_cache, the entries
+	### are returned from it if the same search was done recently (by any connection
+	### sharing the cache that's bound as the same DN); see OpenLDAP::SearchCache.
+	###
+	###    conn.search_cache = OpenLDAP::SearchCache.new( ttl: 30 )
+	###    dn, attrs = conn.cached_search( people_base, :one, "(uid=#{uid})", %w[cn mail] ).first
+	###
+	def cached_search( base, scope=:subtree, filter='(objectClass=*)', attrs=nil )
+		return self.search( base, scope, filter, attrs ).to_a unless self.search_cache
+		return self.search_cache.search( self, base, scope, filter, attrs )
+	end
+
+
+	### Send a request to add an entry with the given +dn+ and +attributes+ (a Hash of
+	### attribute names to a value or an Array of values) without waiting for it to
+	### finish. Returns an OpenLDAP::Result; see Result#wait.
+	def add_async( dn, attributes, controls=nil )
+		mods = attributes.map do |attr, values|
+			[ OpenLDAP::LDAP_MOD_ADD, attr.to_s, self.stringify_values(values) ]
+		end
+
+		return self._add( dn.to_s, mods, controls )
+	end
+
+
+	### Add an entry with the given +dn+ and +attributes+, raising an appropriate
+	### exception if it fails.
+	###
+	###    conn.add( 'cn=jrandom,ou=People,dc=example,dc=com',
+	###        objectClass: %w[top person], cn: 'jrandom', sn: 'Random' )
+	###
+	def add( dn, attributes, controls=nil )
+		self.add_async( dn, attributes, controls ).wait
+		return true
+	end
+
+
+	### Send a request to modify the entry with the given +dn+ without waiting for it to
+	### finish. The +mods+ are either a Hash of attribute names to the values to replace
+	### them with, or an Array of [ op, attribute, values ] triples, where +op+ is one of
+	### :add, :delete, :replace, or :increment. Returns an OpenLDAP::Result; see
+	### Result#wait.
+	def modify_async( dn, mods, controls=nil )
+		mods = mods.map {|attr, values| [:replace, attr, values] } if mods.is_a?( Hash )
+		mods = mods.map do |op, attr, values|
+			numeric_op = MODIFICATION_OPS.fetch( op ) do
+				raise ArgumentError, "unknown modification operation %p" % [ op ]
+			end
+			[ numeric_op, attr.to_s, self.stringify_values(values) ]
+		end
+
+		return self._modify( dn.to_s, mods, controls )
+	end
+
+
+	### Modify the entry with the given +dn+, raising an appropriate exception if it
+	### fails. See #modify_async for the format of the +mods+.
+	###
+	###    conn.modify( dn, [[:replace, :mail, 'jrandom@example.com'], [:delete, :pager, nil]] )
+	###
+	def modify( dn, mods, controls=nil )
+		self.modify_async( dn, mods, controls ).wait
+		return true
+	end
+
+
+	### Send a request to delete the entry with the given +dn+ without waiting for it to
+	### finish. Returns an OpenLDAP::Result; see Result#wait.
+	def delete_async( dn, controls=nil )
+		return self._delete( dn.to_s, controls )
+	end
+
+
+	### Delete the entry with the given +dn+, raising an appropriate exception if it fails.
+	def delete( dn, controls=nil )
+		self.delete_async( dn, controls ).wait
+		return true
+	end
+
+
+	### Send a request to rename the entry with the given +dn+ to +newrdn+, moving it under
+	### +newsuperior+ if it's not +nil+, without waiting for it to finish. Returns an
+	### OpenLDAP::Result; see Result#wait.
+	def rename_async( dn, newrdn, newsuperior=nil, delete_old_rdn=true, controls=nil )
+		newsuperior = newsuperior.to_s if newsuperior
+		return self._rename( dn.to_s, newrdn.to_s, newsuperior, delete_old_rdn, controls )
+	end
+
+
+	### Rename the entry with the given +dn+ to +newrdn+, moving it under +newsuperior+
+	### if it's not +nil+, and raising an appropriate exception if it fails.
+	def rename( dn, newrdn, newsuperior=nil, delete_old_rdn=true, controls=nil )
+		self.rename_async( dn, newrdn, newsuperior, delete_old_rdn, controls ).wait
+		return true
+	end
+
+
+	### Send a request to compare +value+ with the values of the +attribute+ of the entry
+	### with the given +dn+ without waiting for it to finish. Returns an
+	### OpenLDAP::Result whose #compare_result is set once it's finished; see
+	### Result#wait.
+	def compare_async( dn, attribute, value, controls=nil )
+		return self._compare( dn.to_s, attribute.to_s, value.to_s, controls )
+	end
+
+
+	### Returns +true+ if the entry with the given +dn+ has +value+ as one of the values
+	### of its +attribute+, and +false+ if it doesn't. The server does the comparison,
+	### so only the outcome is sent back, however many values the attribute has. Raises
+	### an appropriate exception if the compare can't be done, e.g., if there's no such
+	### entry.
+	###
+	###    conn.compare( group_dn, :member, user_dn )   # => true
+	###
+	def compare( dn, attribute, value, controls=nil )
+		return self.compare_async( dn, attribute, value, controls ).wait.compare_result
+	end
+
+
+	### Send a batch of +comparisons+ back-to-back and collect their outcomes as the
+	### responses arrive, so the whole batch takes about one round trip instead of one
+	### per comparison. Each of the +comparisons+ is an Array of arguments to #compare.
+	###
+	### If called with a block, it's called with the index of each comparison, its
+	### outcome (+true+, +false+, or +nil+ if it failed), and the exception it failed
+	### with (or +nil+) as each one completes. Otherwise the outcomes are returned in the
+	### same order as the +comparisons+, and the first failed comparison's exception is
+	### raised once they've all finished.
+	###
+	###    admin, auditor = conn.compare_many([
+	###        [ 'cn=admins,ou=Groups,dc=example,dc=com', :member, user_dn ],
+	###        [ 'cn=auditors,ou=Groups,dc=example,dc=com', :member, user_dn ],
+	###    ])
+	###
+	def compare_many( comparisons )
+		results = []
+		begin
+			comparisons.each {|args| results << self.compare_async(*args) }
+		rescue
+			results.each( &:abandon )
+			raise
+		end
+
+		if block_given?
+			OpenLDAP::Result.each_completed( results ) do |index, result, _, error|
+				yield( index, result.compare_result, error )
+			end
+			return nil
+		end
+
+		errors = Array.new( results.length )
+		OpenLDAP::Result.each_completed( results ) do |index, _, _, error|
+			errors[ index ] = error
+		end
+
+		if ( error = errors.compact.first )
+			raise error
+		end
+
+		return results.map( &:compare_result )
+	end
+
+
+	### Return an OpenLDAP::BulkWriter that sends write operations on the connection,
+	### keeping up to +window+ of them outstanding at once. If a block is given, it's
+	### called with each operation that fails and its exception.
+	def bulk_writer( window: OpenLDAP::BulkWriter::DEFAULT_WINDOW, &error_handler )
+		return OpenLDAP::BulkWriter.new( self, window: window, &error_handler )
+	end
+
+
+	### Load the LDIF records from +source+, which is either the path to an LDIF file or
+	### an IO to read them from, sending them as write operations with up to +window+
+	### outstanding at once. See OpenLDAP::LDIF#load for the return value and the
+	### arguments of the block.
+	def load_ldif( source, window: OpenLDAP::BulkWriter::DEFAULT_WINDOW, &error_handler )
+		if source.respond_to?( :read )
+			return OpenLDAP::LDIF.new( source ).load( self, window, &error_handler )
+		else
+			return OpenLDAP::LDIF.open( source ) do |ldif|
+				ldif.load( self, window, &error_handler )
+			end
+		end
+	end
+
+
+	### Return the OpenLDAP::Schema of the server the connection is connected to. It's
+	### fetched the first time it's needed by any connection to the same server and
+	### cached after that; if +refresh+ is true, it's fetched again. Connections
+	### decoding typed values switch to the refreshed schema.
+	def schema( refresh=false )
+		return OpenLDAP::Schema.for( self, refresh )
+	end
+
+
+	### Turn decoding of attribute values into Integers, Times, and +true+/+false+
+	### according to the server's schema on or off. Values are returned as Strings
+	### when it's off, which is the default.
+	def typed_values=( enabled )
+		self.decode_schema = enabled ? self.schema : nil
+	end
+
+
+	### Returns +true+ if attribute values are decoded according to the server's schema.
+	def typed_values?
+		return self.decode_schema ? true : false
+	end
+
+
 	### Fetch an IO object wrapped around the file descriptor the library is using to
 	### communicate with the directory. Returns +nil+ if the connection hasn't yet
 	### been established.
@@ -174,12 +514,67 @@ class OpenLDAP::Connection
 	end
 
 
+	### Unbind from the directory, closing the connection and releasing the underlying
+	### session. The connection can't be used after it's been unbound. Connections that
+	### are garbage-collected are unbound automatically. Unbinding a connection that's
+	### already unbound does nothing; unbinding one that another thread or Fiber is
+	### waiting for results on raises an OpenLDAP::Error.
+	def unbind
+		rval = self._unbind
+		@socket = nil
+		return rval
+	end
+	alias_method :close, :unbind
+
+
 	### Return a String representation of the object suitable for debugging.
 	def inspect
 		return "#<%p:%#016x %s>" % [
 			self.class,
 			self.object_id * 2,
-			self.uris.map( &:to_s ).join(', '),
+			self.unbound? ? '(unbound)' : self.uris.map( &:to_s ).join(', '),
+		]
+	end
+
+
+	#########
+	protected
+	#########
+
+	### Tell the server to discard the rest of the pages of the paged search with the
+	### given arguments whose last page came with +cookie+ by requesting a page of
+	### size zero (RFC 2696).
+	def release_paged_search( cookie, base, scope, filter, attrs )
+		self.log.debug "Releasing an unfinished paged search"
+		self._search_page( 0, cookie, base, scope, filter, attrs ).wait
+	rescue OpenLDAP::Error => err
+		self.log.warn "Couldn't release an unfinished paged search: %s" % [ err.message ]
+	end
+
+
+	### Return the given attribute +values+ (a single value, an Array of them, or +nil+) as
+	### an Array of Strings.
+	def stringify_values( values )
+		return Array( values ).map( &:to_s )
+	end
+
+
+	### Return the Array of Virtual List View parameters the extension expects for the
+	### specified +window+ (see #search_sorted).
+	def make_vlv_window( window )
+		window = { offset: window.begin, after: window.size - 1 } if window.is_a?( Range )
+
+		unless window.key?( :offset ) || window.key?( :value )
+			raise ArgumentError, "VLV window requires an :offset or a :value"
+		end
+
+		return [
+			Integer( window[:before] || 0 ),
+			Integer( window[:after] || 0 ),
+			Integer( window[:offset] || 0 ),
+			Integer( window[:content_count] || 0 ),
+			window[:value] && window[:value].to_s,
+			window[:context],
 		]
 	end
 
@@ -188,6 +583,18 @@ class OpenLDAP::Connection
 	private
 	#######
 
+	### Switch the schema values are decoded with to the current one for the server;
+	### called by the extension when the +stale+ one it was using has been superseded.
+	### If the current one can't be fetched, the connection keeps the stale one so it
+	### tries again next time.
+	def refresh_decode_schema( stale )
+		self.decode_schema = OpenLDAP::Schema.for( self )
+	rescue Exception
+		self.decode_schema = stale
+		raise
+	end
+
+
 	### Strip all but the schema, host, and port from the given +url+ and return it as a
 	### String.
 	def simplify_url( url )
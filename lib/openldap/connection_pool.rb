@@ -0,0 +1,357 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'thread'
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+require 'openldap/connection'
+
+# A pool of bound OpenLDAP::Connections that are kept open and re-used across
+# requests, so the cost of connecting, starting TLS, and binding is only paid
+# once per connection.
+#
+#   pool = OpenLDAP::ConnectionPool.new( 'ldap://ldap.example.com',
+#       size: 8, bind_dn: 'cn=app,dc=example,dc=com', password: 'secret',
+#       start_tls: { tls_require_cert: :demand } )
+#
+#   pool.with_connection do |conn|
+#       conn.search( 'dc=example,dc=com', :subtree, '(uid=jrandom)' ).to_a
+#   end
+#
+class OpenLDAP::ConnectionPool
+	extend Loggability
+
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# Default options for new ConnectionPools
+	DEFAULT_OPTIONS = {
+		:size                => 5,
+		:checkout_timeout    => 5.0,
+		:idle_check_interval => 30.0,
+		:probe_timeout       => 2.0,
+		:bind_dn             => nil,
+		:password            => nil,
+		:start_tls           => nil,
+	}
+
+	# The exceptions which indicate that a connection is no longer usable
+	CONNECTION_ERRORS = [
+		OpenLDAP::ServerDown,
+		OpenLDAP::ConnectError,
+		OpenLDAP::Timeout,
+	]
+
+
+	### Create a new pool of connections to one of the specified +urls+. The last
+	### argument can be a Hash of options; any options not listed below are passed
+	### on to each OpenLDAP::Connection.
+	###
+	### [:size]                 The number of connections to keep open.
+	### [:checkout_timeout]     The number of seconds to wait for a connection before
+	###                         raising an OpenLDAP::CheckoutTimeout.
+	### [:idle_check_interval]  Connections which have been idle for longer than this many
+	###                         seconds are checked with a search of the root DSE before
+	###                         they're checked out again.
+	### [:probe_timeout]        The number of seconds to wait for the root DSE search.
+	### [:bind_dn], [:password] The credentials to bind each connection with; if
+	###                         +bind_dn+ is nil, connections are bound anonymously.
+	### [:start_tls]            If set, each connection starts TLS with this Hash of
+	###                         options (or the defaults if it's +true+) before binding.
+	def initialize( *urls )
+		options = if urls.last.is_a?( Hash ) then urls.pop else {} end
+		options = DEFAULT_OPTIONS.merge( options )
+
+		@urls                = urls
+		@size                = Integer( options.delete(:size) )
+		@checkout_timeout    = Float( options.delete(:checkout_timeout) )
+		@idle_check_interval = Float( options.delete(:idle_check_interval) )
+		@probe_timeout       = Float( options.delete(:probe_timeout) )
+		@bind_dn             = options.delete( :bind_dn )
+		@password            = options.delete( :password )
+		@start_tls           = options.delete( :start_tls )
+		@connection_options  = options
+
+		@mutex     = Mutex.new
+		@available = ConditionVariable.new
+		@idle      = []
+		@created   = 0
+		@in_use    = 0
+		@closed    = false
+
+		@checkouts         = 0
+		@checkout_timeouts = 0
+		@total_wait_time   = 0.0
+		@max_wait_time     = 0.0
+		@probes            = 0
+		@replaced          = 0
+
+		self.fill
+	end
+
+
+	######
+	public
+	######
+
+	# The maximum number of connections in the pool
+	attr_reader :size
+
+	# The number of seconds to wait for a connection when checking one out
+	attr_reader :checkout_timeout
+
+	# The number of seconds a connection can be idle before it's probed on checkout
+	attr_reader :idle_check_interval
+
+
+	### Open and bind connections until the pool is full.
+	def fill
+		count = @mutex.synchronize do
+			needed = @size - @created
+			@created += needed
+			needed
+		end
+
+		count.times do
+			begin
+				conn = self.make_connection
+			rescue
+				@mutex.synchronize { @created -= 1 }
+				raise
+			end
+			self.checkin( conn, false )
+		end
+	end
+
+
+	### Check a connection out of the pool, waiting up to +timeout+ seconds for one to
+	### become available. Raises an OpenLDAP::CheckoutTimeout if none does.
+	def checkout( timeout=@checkout_timeout )
+		started = now()
+		deadline = started + timeout
+		conn = idle_since = nil
+
+		@mutex.synchronize do
+			loop do
+				raise OpenLDAP::Error, "connection pool is closed" if @closed
+
+				if ( conn, idle_since = @idle.pop )
+					break
+				elsif @created < @size
+					@created += 1
+					break
+				end
+
+				remaining = deadline - now()
+				if remaining <= 0
+					@checkout_timeouts += 1
+					raise OpenLDAP::CheckoutTimeout,
+						"no connection available after %0.3fs" % [ timeout ]
+				end
+
+				@available.wait( @mutex, remaining )
+			end
+
+			@in_use += 1
+			self.record_checkout( now() - started )
+		end
+
+		begin
+			return self.checkout_connection( conn, idle_since )
+		rescue Exception
+			# The slot is lost along with the connection that failed to open
+			@mutex.synchronize do
+				@in_use -= 1
+				@created -= 1
+				@available.signal
+			end
+			raise
+		end
+	end
+
+
+	### Return the +conn+ to the pool. Connections which have been unbound are dropped.
+	def checkin( conn, checked_out=true )
+		@mutex.synchronize do
+			@in_use -= 1 if checked_out
+
+			if conn.unbound? || @closed
+				conn.unbind unless conn.unbound?
+				@created -= 1
+			else
+				@idle.push([ conn, now() ])
+			end
+
+			@available.signal
+		end
+	end
+
+
+	### Remove the checked-out +conn+ from the pool and unbind it; a new connection will be
+	### opened in its place when one is needed.
+	def discard( conn )
+		self.log.info "Discarding %p" % [ conn ]
+		conn.unbind unless conn.unbound?
+		self.checkin( conn )
+	end
+
+
+	### Check out a connection, yield it to the block, and check it back in afterward.
+	### If the block raises an exception other than an OpenLDAP::Error from a finished
+	### operation -- one that indicates the connection is no longer usable, or anything
+	### else (e.g., a Timeout::Error or an Interrupt) that might have stopped an
+	### operation before its responses arrived -- the connection is discarded instead
+	### of returned to the pool, so nobody else reads those responses.
+	def with_connection( timeout=@checkout_timeout )
+		conn = self.checkout( timeout )
+
+		begin
+			return yield( conn )
+		rescue Exception => err
+			unless self.idle_after?( err )
+				self.discard( conn )
+				conn = nil
+			end
+			raise
+		ensure
+			self.checkin( conn ) if conn
+		end
+	end
+
+
+	### Unbind all of the idle connections and refuse any further checkouts. Connections
+	### which are currently checked out are unbound when they're checked in.
+	def close
+		idle = @mutex.synchronize do
+			@closed = true
+			@available.broadcast
+			@created -= @idle.length
+			@idle.slice!( 0..-1 )
+		end
+
+		idle.each {|conn, _| conn.unbind unless conn.unbound? }
+	end
+
+
+	### Returns +true+ if the pool has been closed.
+	def closed?
+		return @closed
+	end
+
+
+	### Return a Hash of statistics about the pool's connections and checkouts.
+	def stats
+		return @mutex.synchronize do
+			{
+				size:              @size,
+				open:              @created,
+				idle:              @idle.length,
+				in_use:            @in_use,
+				utilization:       @in_use.fdiv( @size ),
+				checkouts:         @checkouts,
+				checkout_timeouts: @checkout_timeouts,
+				total_wait_time:   @total_wait_time,
+				mean_wait_time:    @checkouts.zero? ? 0.0 : @total_wait_time / @checkouts,
+				max_wait_time:     @max_wait_time,
+				probes:            @probes,
+				replaced:          @replaced,
+			}
+		end
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		stats = self.stats
+		return "#<%p:%#016x %s %d/%d in use>" % [
+			self.class,
+			self.object_id * 2,
+			@urls.map( &:to_s ).join(', '),
+			stats[:in_use],
+			stats[:size],
+		]
+	end
+
+
+	#########
+	protected
+	#########
+
+	### Create a new connection, start TLS on it if the pool is configured to, and
+	### bind it.
+	def make_connection
+		conn = OpenLDAP::Connection.new( *@urls, @connection_options.dup )
+
+		if @start_tls
+			tls_options = @start_tls.is_a?( Hash ) ? @start_tls : {}
+			conn.start_tls( tls_options )
+		end
+
+		conn.bind( @bind_dn, @password )
+		self.log.debug "Opened pooled connection %p" % [ conn ]
+
+		return conn
+	end
+
+
+	### Prepare the connection +conn+ (which was idle since +idle_since+) for checkout,
+	### probing it if it's been idle for too long and replacing it if it fails. If
+	### +conn+ is nil, open a new one.
+	def checkout_connection( conn, idle_since )
+		return self.make_connection if conn.nil?
+		return conn if now() - idle_since < @idle_check_interval
+		return conn if self.alive?( conn )
+
+		self.log.warn "Pooled connection %p failed its liveness probe; replacing it" % [ conn ]
+		conn.unbind unless conn.unbound?
+		@mutex.synchronize { @replaced += 1 }
+
+		return self.make_connection
+	end
+
+
+	### Returns +true+ if a connection that raised +err+ out of #with_connection can be
+	### returned to the pool, i.e., if +err+ came from the result of an operation that
+	### has finished and doesn't indicate that the connection is unusable.
+	def idle_after?( err )
+		return false unless err.is_a?( OpenLDAP::Error )
+		return CONNECTION_ERRORS.none? {|klass| err.is_a?(klass) }
+	end
+
+
+	### Returns +true+ if a base search of the root DSE on +conn+ succeeds.
+	def alive?( conn )
+		@mutex.synchronize { @probes += 1 }
+		result = conn.search( OpenLDAP::LDAP_ROOT_DSE, :base, '(objectClass=*)',
+			[OpenLDAP::LDAP_NO_ATTRS] )
+		result.fetch( @probe_timeout )
+		result.abandon
+		return true
+	rescue RuntimeError => err
+		self.log.debug "Liveness probe failed: %p" % [ err ]
+		return false
+	end
+
+
+	### Record a checkout which waited +waited+ seconds. Must be called with the
+	### mutex held.
+	def record_checkout( waited )
+		@checkouts += 1
+		@total_wait_time += waited
+		@max_wait_time = waited if waited > @max_wait_time
+	end
+
+
+	#######
+	private
+	#######
+
+	### Return the current time from a monotonic clock.
+	def now
+		return Process.clock_gettime( Process::CLOCK_MONOTONIC )
+	end
+
+end # class OpenLDAP::ConnectionPool
+
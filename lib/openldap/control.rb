@@ -0,0 +1,66 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'openldap' unless defined?( OpenLDAP )
+
+# OpenLDAP Control class -- a request or response control (RFC 4511, section 4.1.11)
+class OpenLDAP::Control
+	extend Loggability
+
+	# Loggability API -- log to the openldap logger.
+	log_to :openldap
+
+
+	# The errors a password policy response control can carry, in the order of their
+	# codes
+	PASSWORD_POLICY_ERRORS = [
+		:password_expired,
+		:account_locked,
+		:change_after_reset,
+		:password_mod_not_allowed,
+		:must_supply_old_password,
+		:insufficient_password_quality,
+		:password_too_short,
+		:password_too_young,
+		:password_in_history,
+	]
+
+
+	### If the control is a password policy response, return the error it reports as
+	### one of the PASSWORD_POLICY_ERRORS, or +nil+ if it doesn't report one.
+	def password_policy_error
+		return nil unless self.oid == OpenLDAP::LDAP_CONTROL_PASSWORDPOLICYRESPONSE
+		code = self._password_policy_error or return nil
+		return PASSWORD_POLICY_ERRORS.fetch( code, :unknown )
+	end
+
+
+	### Returns +true+ if +other+ is a control with the same OID, value and criticality.
+	def ==( other )
+		return other.is_a?( OpenLDAP::Control ) &&
+			other.oid == self.oid &&
+			other.value == self.value &&
+			other.critical? == self.critical?
+	end
+	alias_method :eql?, :==
+
+
+	### Return a hash value for the control that's the same for equal controls.
+	def hash
+		return [ self.class, self.oid, self.value, self.critical? ].hash
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %s%s (%s)>" % [
+			self.class,
+			self.object_id * 2,
+			self.oid,
+			self.critical? ? ' critical' : '',
+			self.value ? "%d-byte value" % [ self.value.bytesize ] : 'no value',
+		]
+	end
+
+end # class OpenLDAP::Control
+
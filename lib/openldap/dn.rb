@@ -0,0 +1,45 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+
+# A parsed distinguished name (RFC 4514). DNs compare equal (and hash alike) if
+# their normalized forms are the same, so they can be used to look up entries
+# without regard to the way they're written, or to the case of the values of the
+# common naming attributes (+cn+, +ou+, +dc+, +uid+, and so on):
+#
+#   admins = group['member'].map {|dn| OpenLDAP::DN.parse(dn) }.to_set
+#   admins.include?( OpenLDAP::DN.parse('UID=JDoe, ou=People,dc=example,dc=com') )
+#
+# OpenLDAP::DN.parse keeps the most recently parsed DNs in a cache, so parsing
+# the same strings over and over again is cheap. DNs can be passed anywhere a DN
+# String is expected.
+class OpenLDAP::DN
+	extend Loggability
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	### Return each of the DNs above this one in the tree, starting with its parent
+	### and ending with the empty DN.
+	def ancestors
+		ancestors = []
+		dn = self
+		ancestors << dn while ( dn = dn.parent )
+		return ancestors
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %s>" % [
+			self.class,
+			self.object_id * 2,
+			self.to_s,
+		]
+	end
+
+end # class OpenLDAP::DN
+
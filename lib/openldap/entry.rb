@@ -0,0 +1,32 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'openldap' unless defined?( OpenLDAP )
+
+# OpenLDAP Entry class
+class OpenLDAP::Entry
+	extend Loggability
+
+	# Loggability API -- log to the openldap logger.
+	log_to :openldap
+
+
+	### Return the entry's attributes as a Hash of attribute names to Arrays of values.
+	def to_h
+		return self.attribute_names.each_with_object( {} ) do |name, hash|
+			hash[ name ] = self[ name ]
+		end
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %s>" % [
+			self.class,
+			self.object_id * 2,
+			self.dn,
+		]
+	end
+
+end # class OpenLDAP::Entry
+
@@ -103,6 +103,11 @@ module OpenLDAP
 	end # class Error
 
 
+	# Exception raised when a connection can't be checked out of an
+	# OpenLDAP::ConnectionPool in time
+	class CheckoutTimeout < OpenLDAP::Error; end
+
+
 	### Define a new Exception class named +classname+ for the specified +result_code+
 	### and inheriting from +superclass+.
 	def self::def_ldap_exception( classname, result_code, superclass=OpenLDAP::Error )
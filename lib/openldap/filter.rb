@@ -0,0 +1,167 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+
+# A compiled search filter (RFC 4515) with placeholders for its values. Templates
+# are parsed once when the filter is created; #bind then only has to copy the
+# literal parts and escape the values, so building a filter for each request is
+# cheap and values can't change its structure.
+#
+# Filters can be built from a template String or with the builder methods, which
+# escape literal values, treat filter Strings as literal filters, and take
+# placeholders made with ::[]:
+#
+#   F = OpenLDAP::Filter
+#   USER_FILTER = F.and( F.eq(:objectClass, 'person'),
+#                        F.or(F.eq(:uid, F[:login]), F.eq(:mail, F[:login])) )
+#
+#   conn.search( base, :subtree, USER_FILTER.bind(login: params[:login]) )
+#
+# Filters without placeholders can be passed to Connection#search as they are.
+class OpenLDAP::Filter
+	extend Loggability
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# A placeholder for a value in a filter built with the builder methods; named
+	# ones are written as {name} in the template, and unnamed ones as ?.
+	Placeholder = Struct.new( :name ) do
+		### Return the placeholder as it appears in a template.
+		def to_s
+			return self.name ? "{#{self.name}}" : '?'
+		end
+	end
+
+	# The pattern attribute descriptions (RFC 4512, 2.5) given to the builder methods
+	# have to match: a name or OID and any options
+	ATTRIBUTE_DESCRIPTION = /\A(?:[a-z][a-z0-9\-]*|\d+(?:\.\d+)*)(?:;[a-z0-9\-]+)*\z/i
+
+
+	### Return a placeholder for a value to use with the builder methods: named if a
+	### +name+ is given, or positional if not.
+	def self::[]( name=nil )
+		return Placeholder.new( name && name.to_sym )
+	end
+
+
+	### Return a filter that matches entries that match all of the given +filters+.
+	def self::and( *filters )
+		return self.compose( '&', filters )
+	end
+
+
+	### Return a filter that matches entries that match any of the given +filters+.
+	def self::or( *filters )
+		return self.compose( '|', filters )
+	end
+
+
+	### Return a filter that matches entries that don't match +filter+.
+	def self::not( filter )
+		return new( "(!#{self.template_of(filter)})" )
+	end
+
+
+	### Return a filter that matches entries with a value of +attribute+ equal to
+	### +value+.
+	def self::eq( attribute, value )
+		return self.item( attribute, '=', value )
+	end
+
+
+	### Return a filter that matches entries with a value of +attribute+ greater than
+	### or equal to +value+.
+	def self::ge( attribute, value )
+		return self.item( attribute, '>=', value )
+	end
+
+
+	### Return a filter that matches entries with a value of +attribute+ less than or
+	### equal to +value+.
+	def self::le( attribute, value )
+		return self.item( attribute, '<=', value )
+	end
+
+
+	### Return a filter that matches entries with a value of +attribute+ approximately
+	### equal to +value+.
+	def self::approx( attribute, value )
+		return self.item( attribute, '~=', value )
+	end
+
+
+	### Return a filter that matches entries which have any value for +attribute+.
+	def self::present( attribute )
+		return new( "(#{self.attribute_description(attribute)}=*)" )
+	end
+
+
+	### Return a filter that matches entries with a value of +attribute+ that starts
+	### with +initial+, contains each of +any+ in order, and ends with +final+. Any of
+	### them can be +nil+ (or empty), but not all of them.
+	###
+	###    OpenLDAP::Filter.substring( :cn, OpenLDAP::Filter[:prefix] )
+	###    # => #<OpenLDAP::Filter (cn={prefix}*)>
+	def self::substring( attribute, initial=nil, any=[], final=nil )
+		parts = [ initial, *any, final ]
+		if parts.all? {|part| part.nil? || part == '' }
+			raise ArgumentError, "substring filter needs at least one substring"
+		end
+
+		pattern = parts.map {|part| part.nil? ? '' : self.template_value(part) }.join( '*' )
+		return new( "(#{self.attribute_description(attribute)}=#{pattern})" )
+	end
+
+
+	### Return a filter that combines the given +filters+ with the +operator+.
+	def self::compose( operator, filters )
+		raise ArgumentError, "no filters to combine" if filters.empty?
+		return new( "(#{operator}#{filters.map {|filter| self.template_of(filter) }.join})" )
+	end
+
+
+	### Return a filter for an item comparing +attribute+ and +value+ with +operator+.
+	def self::item( attribute, operator, value )
+		return new( "(#{self.attribute_description(attribute)}#{operator}" +
+			"#{self.template_value(value)})" )
+	end
+
+
+	### Return the template of +filter+, which can be a Filter or a filter String
+	### (which is compiled with ::literal to make sure it's well-formed, so any ? or
+	### braces in it are values rather than placeholders).
+	def self::template_of( filter )
+		filter = self.literal( filter ) unless filter.is_a?( self )
+		return filter.template
+	end
+
+
+	### Return +value+ as it should appear in a template: placeholders as they are,
+	### and everything else escaped.
+	def self::template_value( value )
+		return value.to_s if value.is_a?( Placeholder )
+		return self.escape_literal( value )
+	end
+
+
+	### Return +attribute+ as a String after checking that it's a valid attribute
+	### description.
+	def self::attribute_description( attribute )
+		attribute = attribute.to_s
+		raise ArgumentError, "invalid attribute description %p" % [ attribute ] unless
+			attribute =~ ATTRIBUTE_DESCRIPTION
+		return attribute
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p %s>" % [ self.class, self.template ]
+	end
+
+end # class OpenLDAP::Filter
+
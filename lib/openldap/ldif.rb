@@ -0,0 +1,59 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+
+# A streaming reader for LDIF (RFC 2849). Records are parsed one at a time from a
+# fixed-size buffer, so files of any size can be read in bounded memory, and
+# #load sends them as write operations without building Ruby objects for them.
+#
+#   OpenLDAP::LDIF.open( 'people.ldif' ) do |ldif|
+#       stats = ldif.load( conn, 64 ) do |dn, error, lineno|
+#           $stderr.puts "line %d: %s: %s" % [ lineno, dn, error.message ]
+#       end
+#   end
+#
+class OpenLDAP::LDIF
+	extend Loggability
+	include Enumerable
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	### Open the file at +path+ and return a new LDIF reader for it. If a block is
+	### given, the reader is yielded to it and the file is closed when it returns,
+	### and the value of the block is returned.
+	def self::open( path )
+		io = File.open( path, 'rb' )
+		ldif = new( io )
+		return ldif unless block_given?
+
+		begin
+			return yield( ldif )
+		ensure
+			io.close
+		end
+	end
+
+
+	### Enumerable API -- iterate over the records; see #each_record.
+	def each( &block )
+		return enum_for( :each ) unless block
+		return self.each_record( &block )
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %p (line %d)>" % [
+			self.class,
+			self.object_id * 2,
+			self.io,
+			self.lineno,
+		]
+	end
+
+end # class OpenLDAP::LDIF
+
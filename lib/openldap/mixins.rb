@@ -9,6 +9,19 @@ require 'openldap'
 #
 module OpenLDAP # :nodoc:
 
+	# A mixin for the library's logger that keeps the log level cached by the
+	# extension in sync with it.
+	module LogLevelCaching
+
+		### Set the level of the logger to +newlevel+ and update the extension's
+		### cached level.
+		def level=( newlevel )
+			super
+			OpenLDAP.cache_log_level if OpenLDAP.respond_to?( :cache_log_level )
+		end
+
+	end # module LogLevelCaching
+
 end # module OpenLDAP
 
 # vim: set nosta noet ts=4 sw=4:
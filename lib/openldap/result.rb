@@ -2,6 +2,7 @@
 #encoding: utf-8
 
 require 'uri'
+require 'set'
 require 'openldap' unless defined?( OpenLDAP )
 
 # OpenLDAP Result class
@@ -11,6 +12,54 @@ class OpenLDAP::Result
 	# Loggability API -- log to the openldap logger.
 	log_to :openldap
 
+	include Enumerable
+
+
+	# The index of the first argument to Connection#search after the attributes; a
+	# search given any of them (attrsonly, controls, a timeout, or a size limit) can't
+	# be re-issued as a paged search without changing what it returns
+	OPTIONS_ARG = 4
+
+
+	### Iterate over the entries of the search as they arrive; see #each_entry. If the
+	### server stops a plain search (see #pageable?) because it exceeded the server's
+	### size limit, the search is re-issued with Connection#search_paged and iteration
+	### continues with the entries that haven't been yielded yet.
+	def each( &block )
+		return enum_for( __method__ ) unless block
+		return self.each_entry( &block ) unless self.pageable?
+
+		seen = Set.new
+		begin
+			self.each_entry do |dn, attrs|
+				seen.add( dn )
+				yield( dn, attrs )
+			end
+		rescue OpenLDAP::SizelimitExceeded => err
+			self.log.info "%s after %d entries; falling back to a paged search" %
+				[ err.message, seen.length ]
+			base, scope, filter, attrs = self.search_args
+			scope ||= :subtree
+			filter ||= '(objectClass=*)'
+
+			self.connection.search_paged( base, scope, filter, attrs ) do |dn, entry|
+				yield( dn, entry ) unless seen.include?( dn )
+			end
+		end
+
+		return self
+	end
+
+
+	### Returns +true+ if the result is for a search that can be re-issued as a paged
+	### search if it exceeds the server's size limit, i.e., one that was only given a
+	### base, scope, filter, and attributes. Sorted, VLV, and paged searches don't have
+	### #search_args, since the controls they were sent with aren't among them.
+	def pageable?
+		args = self.search_args or return false
+		return args.drop( OPTIONS_ARG ).none?
+	end
+
 end # class OpenLDAP::Result
 
 
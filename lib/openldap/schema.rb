@@ -0,0 +1,99 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'thread'
+require 'monitor'
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+
+# The attribute types of a server's subschema (RFC 4512, 4.2), used to decode the
+# values of entries according to their syntaxes. Schemas are fetched once per
+# server and cached, since they rarely change; pass +refresh+ to fetch it again.
+# A schema that's been replaced by a newer one (or dropped from the cache) is
+# marked #stale?, and connections decoding values with it switch to the current
+# one the next time they decode an entry.
+#
+#   conn.typed_values = true
+#   conn.search( base, :subtree, '(uid=jdoe)', %w[uidNumber createTimestamp] ).first
+#   # => ["uid=jdoe,ou=People,dc=example,dc=com",
+#   #     {"uidNumber"=>[1000], "createTimestamp"=>[2024-01-02 03:04:05 UTC]}]
+#
+class OpenLDAP::Schema
+	extend Loggability
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# The DN of the subschema subentry to use if the root DSE doesn't say
+	DEFAULT_SUBSCHEMA_DN = 'cn=Subschema'
+
+
+	@cache = {}
+	@cache_mutex = Mutex.new
+	@fetch_locks = {}
+
+	class << self
+		# Schemas that have already been fetched, keyed by the URIs of the server
+		attr_reader :cache
+	end
+
+
+	### Return the schema of the server +conn+ is connected to, fetching it if it
+	### hasn't been fetched for that server yet or if +refresh+ is true. Only one
+	### fetch per server is done at a time, and fetches from different servers don't
+	### wait for each other.
+	def self::for( conn, refresh=false )
+		key = conn.uris.map( &:to_s ).join( ' ' )
+		# A Monitor, since fetching can come back here for a connection whose schema
+		# is being replaced
+		lock = @cache_mutex.synchronize { @fetch_locks[key] ||= Monitor.new }
+
+		lock.synchronize do
+			cached = @cache_mutex.synchronize { @cache[key] }
+			return cached if cached && !cached.stale? && !refresh
+
+			schema = self.fetch( conn )
+			@cache_mutex.synchronize { @cache[key] = schema }
+			cached.expire if cached
+
+			return schema
+		end
+	end
+
+
+	### Forget all of the schemas that have been fetched, so they're fetched again
+	### the next time they're needed.
+	def self::clear_cache
+		schemas = @cache_mutex.synchronize do
+			@cache.values.tap { @cache.clear }
+		end
+		schemas.each( &:expire )
+	end
+
+
+	### Fetch the subschema subentry named by the root DSE of the server +conn+ is
+	### connected to and return a new schema for its attribute types.
+	def self::fetch( conn )
+		_, root_dse = conn.search( '', :base, '(objectClass=*)', ['subschemaSubentry'] ).first
+		dn = Array( root_dse && root_dse['subschemaSubentry'] ).first || DEFAULT_SUBSCHEMA_DN
+
+		self.log.info "Fetching the schema from %s" % [ dn ]
+		_, subschema = conn.search( dn, :base, '(objectClass=subschema)', ['attributeTypes'] ).first
+		raise OpenLDAP::NoSuchObject, "no subschema subentry at %s" % [ dn ] unless subschema
+
+		return new( subschema['attributeTypes'] || [] )
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		return "#<%p:%#016x %d attribute types>" % [
+			self.class,
+			self.object_id * 2,
+			self.size,
+		]
+	end
+
+end # class OpenLDAP::Schema
+
@@ -0,0 +1,232 @@
+# -*- ruby -*-
+#encoding: utf-8
+
+require 'thread'
+require 'loggability'
+require 'openldap' unless defined?( OpenLDAP )
+require 'openldap/dn'
+
+# A cache of the entries found by recent searches, for lookups which are repeated
+# with the same arguments far more often than the entries they find change. A
+# search's entries are kept for +:ttl+ seconds, and searches which found nothing
+# (no entries, or no such base entry) for +:negative_ttl+ seconds. Once the cache
+# holds +:size+ searches, the least-recently used one is dropped to make room.
+#
+# Searches are cached by server, bind DN, base, scope, filter, and attributes, so
+# one cache can be shared by all of the connections of a pool. Entries are kept
+# marshalled into a String per search instead of as Hashes of Strings, so a full
+# cache doesn't add much to the work of the garbage collector; each hit returns
+# newly-loaded entries, which callers are free to change.
+#
+#   cache = OpenLDAP::SearchCache.new( ttl: 60, negative_ttl: 5, size: 10_000 )
+#   pool = OpenLDAP::ConnectionPool.new( 'ldap://ldap.example.com', search_cache: cache )
+#
+#   pool.with_connection do |conn|
+#       conn.cached_search( 'ou=People,dc=example,dc=com', :one, "(uid=#{uid})" ).first
+#   end
+#
+class OpenLDAP::SearchCache
+	extend Loggability
+
+
+	# Loggability API -- log to the :openldap logger
+	log_to :openldap
+
+
+	# Default options for new SearchCaches
+	DEFAULT_OPTIONS = {
+		:ttl          => 60.0,
+		:negative_ttl => 10.0,
+		:size         => 10_000,
+	}
+
+	# A cached search: its entries marshalled into a String (or +nil+ if it found
+	# none), the exception it failed with if it didn't find its base, and the time it
+	# expires at
+	Entry = Struct.new( :data, :error, :expires_at )
+
+
+	### Create a new cache with the given +options+:
+	###
+	### [:ttl]           The number of seconds to keep the entries of a search.
+	### [:negative_ttl]  The number of seconds to remember that a search found nothing;
+	###                  0 turns negative caching off.
+	### [:size]          The maximum number of searches to keep.
+	def initialize( options={} )
+		options = DEFAULT_OPTIONS.merge( options )
+
+		@ttl          = Float( options[:ttl] )
+		@negative_ttl = Float( options[:negative_ttl] )
+		@size         = Integer( options[:size] )
+
+		@mutex   = Mutex.new
+		@entries = {}
+
+		@hits        = 0
+		@misses      = 0
+		@evictions   = 0
+		@expirations = 0
+	end
+
+
+	######
+	public
+	######
+
+	# The number of seconds to keep the entries of a search
+	attr_reader :ttl
+
+	# The number of seconds to remember that a search found nothing
+	attr_reader :negative_ttl
+
+	# The maximum number of searches to keep
+	attr_reader :size
+
+
+	### Return an Array of the [dn, attributes] pairs of the entries found by searching
+	### under +base+ on +conn+, from the cache if the same search was done recently;
+	### otherwise the search is done and its entries are cached. Raises an appropriate
+	### exception if the search fails.
+	def search( conn, base, scope=:subtree, filter='(objectClass=*)', attrs=nil )
+		key = self.key_for( conn, base, scope, filter, attrs )
+
+		if ( entry = self.lookup(key) )
+			raise( entry.error.dup ) if entry.error
+			return entry.data ? Marshal.load( entry.data ) : []
+		end
+
+		begin
+			entries = conn.search( base, scope, filter, attrs ).to_a
+		rescue OpenLDAP::NoSuchObject => err
+			self.store( key, Entry.new(nil, err), @negative_ttl )
+			raise
+		end
+
+		if entries.empty?
+			self.store( key, Entry.new(nil, nil), @negative_ttl )
+		else
+			self.store( key, Entry.new(Marshal.dump(entries), nil), @ttl )
+		end
+
+		return entries
+	end
+
+
+	### Drop all of the cached searches.
+	def clear
+		@mutex.synchronize { @entries.clear }
+	end
+
+
+	### Return a Hash of the number of searches cached and of the hits, misses,
+	### evictions (to make room), and expirations there have been.
+	def stats
+		return @mutex.synchronize do
+			{
+				size:        @entries.length,
+				hits:        @hits,
+				misses:      @misses,
+				hit_rate:    ( @hits + @misses ).zero? ? 0.0 : @hits.fdiv( @hits + @misses ),
+				evictions:   @evictions,
+				expirations: @expirations,
+			}
+		end
+	end
+
+
+	### Return a String representation of the object suitable for debugging.
+	def inspect
+		stats = self.stats
+		return "#<%p:%#016x %d/%d searches, %d hits, %d misses>" % [
+			self.class,
+			self.object_id * 2,
+			stats[:size],
+			@size,
+			stats[:hits],
+			stats[:misses],
+		]
+	end
+
+
+	#########
+	protected
+	#########
+
+	### Return the key to cache the search of +conn+ with the given arguments under.
+	### DNs are normalized and the attributes sorted, so equivalent searches share a
+	### key.
+	def key_for( conn, base, scope, filter, attrs )
+		attrs = Array( attrs ).map {|attr| attr.to_s.downcase }.sort.uniq
+		return [
+			conn.uris.map( &:to_s ).join( ' ' ),
+			normalize_dn( conn.bind_dn ),
+			conn.typed_values?,
+			normalize_dn( base ),
+			scope,
+			filter.to_s,
+			attrs,
+		]
+	end
+
+
+	### Return the cached search for +key+ if there is one and it hasn't expired,
+	### counting the hit or miss.
+	def lookup( key )
+		@mutex.synchronize do
+			entry = @entries.delete( key )
+
+			if entry && entry.expires_at <= now()
+				@expirations += 1
+				entry = nil
+			end
+
+			unless entry
+				@misses += 1
+				return nil
+			end
+
+			# Put it back at the end, so the least-recently used searches stay first
+			@entries[ key ] = entry
+			@hits += 1
+			return entry
+		end
+	end
+
+
+	### Cache the search +entry+ for +key+ for +ttl+ seconds, dropping the
+	### least-recently used searches if the cache is full.
+	def store( key, entry, ttl )
+		return if ttl <= 0 || @size <= 0
+		entry.expires_at = now() + ttl
+
+		@mutex.synchronize do
+			@entries.delete( key )
+			while @entries.length >= @size
+				@entries.shift
+				@evictions += 1
+			end
+			@entries[ key ] = entry
+		end
+	end
+
+
+	#######
+	private
+	#######
+
+	### Return the normalized form of +dn+, or +dn+ as a String if it can't be parsed.
+	def normalize_dn( dn )
+		return nil if dn.nil?
+		return OpenLDAP::DN.normalize( dn )
+	rescue OpenLDAP::InvalidDNSyntax
+		return dn.to_s
+	end
+
+
+	### Return the current time from a monotonic clock.
+	def now
+		return Process.clock_gettime( Process::CLOCK_MONOTONIC )
+	end
+
+end # class OpenLDAP::SearchCache
+
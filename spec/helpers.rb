@@ -222,6 +222,62 @@ module OpenLDAP::SpecHelpers
 end
 
 
+### A minimal Fiber scheduler that runs each non-blocking Fiber until it finishes,
+### waiting for IO in place, and counts the waits it's asked to do.
+class OpenLDAP::SpecHelpers::CountingScheduler
+
+	### Create a new scheduler that hasn't waited for anything yet.
+	def initialize
+		@io_waits = 0
+	end
+
+
+	# The number of times the scheduler has been asked to wait for an IO
+	attr_reader :io_waits
+
+
+	### Fiber scheduler API -- start a non-blocking Fiber that runs the +block+.
+	def fiber( &block )
+		fiber = Fiber.new( blocking: false, &block )
+		fiber.resume
+		return fiber
+	end
+
+
+	### Fiber scheduler API -- wait up to +timeout+ seconds for +io+ to be ready for
+	### the given +events+.
+	def io_wait( io, events, timeout )
+		@io_waits += 1
+		return IO.select( [io], nil, nil, timeout ) ? events : false
+	end
+
+
+	### Fiber scheduler API -- sleep for +duration+ seconds.
+	def kernel_sleep( duration=nil )
+		IO.select( nil, nil, nil, duration )
+	end
+
+
+	### Fiber scheduler API -- only one Fiber runs at a time, so nothing should block
+	### on a Mutex or Queue.
+	def block( blocker, timeout=nil )
+		raise "unexpected wait on %p" % [ blocker ]
+	end
+
+
+	### Fiber scheduler API -- nothing is ever blocked, so there's nothing to do.
+	def unblock( blocker, fiber )
+	end
+
+
+	### Fiber scheduler API -- every Fiber runs to completion when it's started, so
+	### there's nothing left to run.
+	def close
+	end
+
+end
+
+
 ### Mock with Rspec
 RSpec.configure do |config|
 	include OpenLDAP::TestConstants
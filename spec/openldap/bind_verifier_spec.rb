@@ -0,0 +1,75 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/bind_verifier'
+
+describe OpenLDAP::BindVerifier, slapd: true do
+
+	before( :each ) do
+		@verifier = described_class.new( TEST_LDAP_URI, size: 2,
+			start_tls: { tls_require_cert: :never } )
+	end
+
+	after( :each ) do
+		@verifier.close
+	end
+
+
+	it "accepts valid credentials" do
+		expect( @verifier.verify(TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD) ).to eq( :accepted )
+	end
+
+
+	it "rejects invalid credentials without raising" do
+		expect( @verifier.verify(TEST_ADMIN_ROOT_DN, 'nopenopenope') ).to eq( :rejected )
+	end
+
+
+	it "rejects empty passwords without sending an unauthenticated bind" do
+		expect( @verifier.pool ).to_not receive( :with_connection )
+		expect( @verifier.verify(TEST_ADMIN_ROOT_DN, '') ).to eq( :rejected )
+	end
+
+
+	it "checks a batch of credentials across its connections" do
+		statuses = @verifier.verify_many([
+			[ TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD ],
+			[ TEST_ADMIN_ROOT_DN, 'wrong' ],
+			[ TEST_ADMIN_ROOT_DN, nil ],
+			[ TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD ],
+		])
+
+		expect( statuses ).to eq([ :accepted, :rejected, :rejected, :accepted ])
+		expect( @verifier.stats ).to include( accepted: 2, rejected: 2 )
+		expect( @verifier.pool.stats[:in_use] ).to eq( 0 )
+	end
+
+
+	it "discards the connections with binds still in flight if a batch can't be checked" do
+		expect( @verifier ).to receive( :finish_bind ).and_raise( OpenLDAP::Timeout, "bind verification" )
+
+		expect {
+			@verifier.verify_many([
+				[ TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD ],
+				[ TEST_ADMIN_ROOT_DN, 'wrong' ],
+			])
+		}.to raise_error( OpenLDAP::Timeout )
+
+		expect( @verifier.pool.stats ).to include( in_use: 0, idle: 0, open: 0 )
+	end
+
+
+	it "only reports accounts as locked if the password policy control says so" do
+		result = double( OpenLDAP::Result, controls: [] )
+		error = OpenLDAP::UnwillingToPerform.new( "bind" )
+		expect( @verifier.send(:status_for, result, error) ).to eq( :rejected )
+
+		control = double( OpenLDAP::Control, password_policy_error: :account_locked )
+		allow( result ).to receive( :controls ).and_return( [control] )
+		expect( @verifier.send(:status_for, result, error) ).to eq( :locked )
+	end
+
+end
+
@@ -0,0 +1,88 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/bulk_writer'
+
+describe OpenLDAP::BulkWriter, slapd: true do
+
+	let( :dns ) { (1..5).map {|i| "cn=bulk-test-#{i},#{TEST_BASE}" } }
+
+	before( :each ) do
+		@conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+		@conn.tls_require_cert = :never
+		@conn.start_tls
+		@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+	end
+
+	after( :each ) do
+		dns.each do |dn|
+			begin
+				@conn.delete( dn )
+			rescue OpenLDAP::NoSuchObject
+			end
+		end
+	end
+
+
+	it "keeps no more than its window of operations outstanding" do
+		writer = @conn.bulk_writer( window: 2 )
+
+		dns.each do |dn|
+			writer.add( dn, objectClass: %w[top organizationalRole], cn: dn[/cn=([^,]+)/, 1] )
+			expect( writer.outstanding ).to be <= 2
+		end
+		writer.finish
+
+		expect( writer.stats ).to include( sent: 5, succeeded: 5, failed: 0, outstanding: 0 )
+		expect( @conn.search(TEST_BASE, :one, '(cn=bulk-test-*)').to_a.length ).to eq( 5 )
+	end
+
+
+	it "reports failed operations without stopping" do
+		writer = @conn.bulk_writer( window: 3 )
+
+		writer << [ :delete, "cn=nonexistent,#{TEST_BASE}" ]
+		writer << [ :add, dns.first, {objectClass: %w[top organizationalRole], cn: 'bulk-test-1'} ]
+		writer.finish
+
+		expect( writer.stats ).to include( succeeded: 1, failed: 1 )
+		expect( writer.errors.length ).to eq( 1 )
+		expect( writer.errors.first[0] ).to eq([ :delete, "cn=nonexistent,#{TEST_BASE}" ])
+		expect( writer.errors.first[1] ).to be_a( OpenLDAP::NoSuchObject )
+	end
+
+
+	it "calls its error handler with failed operations if it has one" do
+		failures = []
+		writer = @conn.bulk_writer {|op, err| failures << [op.first, err.class] }
+
+		writer.delete( "cn=nonexistent,#{TEST_BASE}" )
+		writer.finish
+
+		expect( failures ).to eq([ [:delete, OpenLDAP::NoSuchObject] ])
+		expect( writer.errors ).to be_empty
+	end
+
+
+	it "rejects unknown operations" do
+		writer = @conn.bulk_writer
+		expect {
+			writer << [ :frobnicate, TEST_BASE ]
+		}.to raise_error( ArgumentError, /frobnicate/ )
+	end
+
+
+	it "raises errors in the arguments of operations instead of counting them as failures" do
+		writer = @conn.bulk_writer
+		expect {
+			writer.modify( TEST_BASE, [[:frobnicate, :description, 'bulk']] )
+		}.to raise_error( ArgumentError, /frobnicate/ )
+
+		expect( writer.errors ).to be_empty
+		expect( writer.stats ).to include( sent: 0, failed: 0 )
+	end
+
+end
+
@@ -0,0 +1,134 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'timeout'
+require 'openldap/connection_pool'
+
+describe OpenLDAP::ConnectionPool, slapd: true, log: :debug do
+
+	let( :pool ) do
+		described_class.new( TEST_LDAP_URI,
+			size: 2,
+			checkout_timeout: 0.2,
+			bind_dn: TEST_ADMIN_ROOT_DN,
+			password: TEST_ADMIN_PASSWORD,
+			start_tls: { tls_require_cert: :never } )
+	end
+
+	after( :each ) do
+		pool.close
+	end
+
+
+	it "opens and binds all of its connections up front" do
+		expect( pool.stats ).to include( size: 2, open: 2, idle: 2, in_use: 0 )
+	end
+
+
+	it "yields a bound connection to a block" do
+		pool.with_connection do |conn|
+			expect( conn ).to be_a( OpenLDAP::Connection )
+			expect( conn ).to_not be_unbound
+			expect( pool.stats ).to include( in_use: 1, utilization: 0.5 )
+		end
+
+		expect( pool.stats ).to include( in_use: 0, idle: 2, checkouts: 1 )
+	end
+
+
+	it "re-uses connections that are checked back in" do
+		first = pool.checkout
+		pool.checkin( first )
+		expect( pool.checkout ).to equal( first )
+	end
+
+
+	it "raises a CheckoutTimeout if no connection becomes available in time" do
+		2.times { pool.checkout }
+
+		expect {
+			pool.checkout
+		}.to raise_error( OpenLDAP::CheckoutTimeout )
+		expect( pool.stats ).to include( checkout_timeouts: 1, utilization: 1.0 )
+	end
+
+
+	it "replaces connections that are discarded" do
+		conn = pool.checkout
+		pool.discard( conn )
+
+		expect( conn ).to be_unbound
+		expect( pool.stats ).to include( open: 1, in_use: 0 )
+		2.times { expect(pool.checkout).to_not be_unbound }
+		expect( pool.stats ).to include( open: 2, in_use: 2 )
+	end
+
+
+	it "discards a connection if fetching a result on it times out" do
+		conn = nil
+		expect {
+			pool.with_connection do |pooled|
+				conn = pooled
+				OpenLDAP::Result.new( pooled, 9999 ).fetch( 0.1 )
+			end
+		}.to raise_error( OpenLDAP::Timeout )
+
+		expect( conn ).to be_unbound
+		expect( pool.stats ).to include( open: 1, in_use: 0 )
+	end
+
+
+	it "discards a connection if the block is interrupted by something other than an LDAP error" do
+		conn = nil
+		expect {
+			pool.with_connection do |pooled|
+				conn = pooled
+				pooled.search( TEST_BASE )
+				raise ::Timeout::Error, "interrupted"
+			end
+		}.to raise_error( ::Timeout::Error )
+
+		expect( conn ).to be_unbound
+		expect( pool.stats ).to include( open: 1, in_use: 0 )
+	end
+
+
+	it "keeps a connection whose operation failed with an LDAP error" do
+		conn = nil
+		expect {
+			pool.with_connection do |pooled|
+				conn = pooled
+				pooled.search( "cn=nonexistent,#{TEST_BASE}", :base ).to_a
+			end
+		}.to raise_error( OpenLDAP::NoSuchObject )
+
+		expect( conn ).to_not be_unbound
+		expect( pool.stats ).to include( open: 2, idle: 2, in_use: 0 )
+	end
+
+
+	it "probes connections that have been idle too long before checking them out" do
+		probed = described_class.new( TEST_LDAP_URI, size: 1, idle_check_interval: 0.0 )
+		begin
+			probed.with_connection {}
+			expect( probed.stats ).to include( probes: 1, replaced: 0 )
+		ensure
+			probed.close
+		end
+	end
+
+
+	it "unbinds its idle connections when it's closed" do
+		conn = pool.checkout
+		pool.checkin( conn )
+		pool.close
+
+		expect( conn ).to be_unbound
+		expect( pool ).to be_closed
+		expect { pool.checkout }.to raise_error( OpenLDAP::Error, /closed/ )
+	end
+
+end
+
@@ -4,6 +4,9 @@ require_relative '../helpers'
 
 require 'pry'
 require 'uri'
+require 'json'
+require 'stringio'
+require 'objspace'
 require 'rspec'
 require 'openldap/connection'
 
@@ -39,6 +42,39 @@ describe OpenLDAP::Connection, slapd: true, log: :debug do
 		end
 
 
+		it "can be unbound" do
+			expect( @conn ).to_not be_unbound
+			@conn.unbind
+			expect( @conn ).to be_unbound
+			expect {
+				@conn.uris
+			}.to raise_error( OpenLDAP::Error, /unbound/i )
+		end
+
+
+		it "can be unbound more than once" do
+			@conn.unbind
+			expect { @conn.close }.to_not raise_error
+			expect( @conn ).to be_unbound
+		end
+
+
+		it "reports the memory its session uses until it's unbound" do
+			bound_size = ObjectSpace.memsize_of( @conn )
+			@conn.unbind
+			expect( ObjectSpace.memsize_of(@conn) ).to be < bound_size
+		end
+
+
+		it "keeps track of how many native sessions are live" do
+			count = OpenLDAP::Connection.live_sessions
+			conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+			expect( OpenLDAP::Connection.live_sessions ).to eq( count + 1 )
+			conn.close
+			expect( OpenLDAP::Connection.live_sessions ).to eq( count )
+		end
+
+
 		it "can set the cacert file used for TLS" do
 			@conn.tls_cacertfile = Pathname( '/etc/openssl/cacerts/ldap.pem' )
 			expect( @conn.tls_cacertfile ).to eq( '/etc/openssl/cacerts/ldap.pem' )
@@ -220,6 +256,34 @@ describe OpenLDAP::Connection, slapd: true, log: :debug do
 			end
 
 
+			it "knows the DN it was last bound as" do
+				expect( @conn.bind_dn ).to be_nil
+				@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+				expect( @conn.bind_dn ).to eq( TEST_ADMIN_ROOT_DN )
+				@conn.bind
+				expect( @conn.bind_dn ).to be_nil
+			end
+
+
+			it "only knows the DN it was bound as once the bind has succeeded" do
+				@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+
+				result = @conn.bind_async( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+				expect( @conn.bind_dn ).to be_nil
+				result.wait
+				expect( @conn.bind_dn ).to eq( TEST_ADMIN_ROOT_DN )
+
+				expect {
+					@conn.bind( TEST_ADMIN_ROOT_DN, 'nopenopenope' )
+				}.to raise_error( OpenLDAP::InvalidCredentials )
+				expect( @conn.bind_dn ).to be_nil
+
+				@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+				@conn.unbind
+				expect( @conn.bind_dn ).to be_nil
+			end
+
+
 			it "raises an appropriate exception if unable to bind" do
 				expect {
 					@conn.bind( 'cn=nonexistant', 'nopenopenope' )
@@ -227,6 +291,249 @@ describe OpenLDAP::Connection, slapd: true, log: :debug do
 			end
 
 
+			it "can bind without blocking the calling thread" do
+				result = @conn.bind_async( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+
+				expect( result ).to be_a( OpenLDAP::Result )
+				expect( result.wait(5.0) ).to equal( result )
+				expect( result ).to be_completed
+			end
+
+
+			it "raises an appropriate exception when waiting for a failed bind" do
+				result = @conn.bind_async( 'cn=nonexistant', 'nopenopenope' )
+				expect {
+					result.wait
+				}.to raise_error( OpenLDAP::InvalidCredentials, /bind/i )
+			end
+
+
+			it "yields the bind in flight if called with a block" do
+				yielded = nil
+				@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD ) {|result| yielded = result }
+
+				expect( yielded ).to be_a( OpenLDAP::Result )
+				expect( yielded ).to be_completed
+			end
+
+
+			it "refuses to unbind while another thread is waiting for results" do
+				result = OpenLDAP::Result.new( @conn, 9999 )
+				waiter = Thread.new { result.fetch(1.0) rescue nil }
+				sleep 0.2
+
+				expect {
+					@conn.unbind
+				}.to raise_error( OpenLDAP::Error, /in progress/i )
+
+				waiter.join
+				expect { @conn.unbind }.to_not raise_error
+				expect( @conn ).to be_unbound
+			end
+
+
+			context "bound as the administrator" do
+
+				let( :test_dn ) { "cn=write-test,#{TEST_BASE}" }
+
+				before( :each ) do
+					@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+				end
+
+				after( :each ) do
+					[ test_dn, "cn=renamed-test,#{TEST_BASE}" ].each do |dn|
+						begin
+							@conn.delete( dn )
+						rescue OpenLDAP::NoSuchObject
+						end
+					end
+				end
+
+
+				it "can add, modify, rename, and delete entries" do
+					expect( @conn.add(test_dn, objectClass: %w[top organizationalRole], cn: 'write-test') ).
+						to eq( true )
+					expect( @conn.modify(test_dn, description: 'modified') ).to eq( true )
+					expect( @conn.search(test_dn, :base).first[1]['description'] ).to eq( ['modified'] )
+
+					expect( @conn.rename(test_dn, 'cn=renamed-test') ).to eq( true )
+					expect( @conn.delete("cn=renamed-test,#{TEST_BASE}") ).to eq( true )
+				end
+
+
+				context "with entries to sort" do
+
+					let( :names ) { %w[charlie alpha delta bravo] }
+					let( :roles ) { '(objectClass=organizationalRole)' }
+
+					before( :each ) do
+						names.each do |name|
+							@conn.add( "cn=#{name},#{TEST_BASE}", objectClass: %w[top organizationalRole], cn: name )
+						end
+					end
+
+					after( :each ) do
+						names.each do |name|
+							begin
+								@conn.delete( "cn=#{name},#{TEST_BASE}" )
+							rescue OpenLDAP::NoSuchObject
+							end
+						end
+					end
+
+
+					it "can ask the server to sort search results" do
+						result = @conn.search_sorted( TEST_BASE, :one, roles, %w[cn], sort: 'cn' )
+						expect( result.map {|_, entry| entry['cn'].first } ).
+							to eq( %w[admin alpha bravo charlie delta] )
+
+						result = @conn.search_sorted( TEST_BASE, :one, roles, %w[cn], sort: '-cn' )
+						expect( result.map {|_, entry| entry['cn'].first } ).
+							to eq( %w[delta charlie bravo alpha admin] )
+					end
+
+
+					it "doesn't re-issue sorted searches that exceed the size limit as paged searches" do
+						result = @conn.search_sorted( TEST_BASE, :one, roles, %w[cn], sort: '-cn' )
+						expect( result ).to_not be_pageable
+						allow( result ).to receive( :each_entry ) do |&block|
+							block.call( "cn=delta,#{TEST_BASE}", {'cn' => ['delta']} )
+							raise OpenLDAP::SizelimitExceeded, "search"
+						end
+
+						expect( @conn ).to_not receive( :search_paged )
+						expect {
+							result.to_a
+						}.to raise_error( OpenLDAP::SizelimitExceeded )
+					end
+
+
+					it "can fetch a window of sorted search results by position" do
+						result = @conn.search_sorted( TEST_BASE, :one, roles, %w[cn], sort: 'cn', window: 2..3 )
+						expect( result.map {|_, entry| entry['cn'].first } ).to eq( %w[alpha bravo] )
+						expect( result.target_position ).to eq( 2 )
+						expect( result.content_count ).to eq( 5 )
+					end
+
+
+					it "can fetch a window of sorted search results around a value" do
+						result = @conn.search_sorted( TEST_BASE, :one, roles, %w[cn], sort: 'cn',
+							window: {value: 'c', before: 1, after: 1} )
+						expect( result.map {|_, entry| entry['cn'].first } ).to eq( %w[bravo charlie delta] )
+						expect( result.target_position ).to eq( 4 )
+						expect( result.content_count ).to eq( 5 )
+					end
+
+				end
+
+
+				context "with an entry with values that need escaping" do
+
+					let( :description ) do
+						'An entry description that is long enough that exporting it as LDIF has ' +
+						'to fold it onto a second line, and then onto a third line as well, too'
+					end
+
+					before( :each ) do
+						@conn.add( test_dn, objectClass: %w[top person], cn: 'write-test', sn: 'Test',
+							description: [description, "tab\there\nquote\"\u0001"],
+							userPassword: "\xFF\x00secret".b )
+					end
+
+
+					it "folds long lines and base64-encodes unsafe values when exporting LDIF" do
+						io = StringIO.new
+						@conn.search( test_dn, :base, '(objectClass=*)', %w[description userPassword] ).
+							write_ldif( io )
+
+						expect( io.string ).to start_with( "version: 1\n\ndn: #{test_dn}\n" )
+						expect( io.string ).to include(
+							"description: An entry description that is long enough that exporting it as L\n" \
+							" DIF has to fold it onto a second line, and then onto a third line as well, \n" \
+							" too\n" \
+							"description:: dGFiCWhlcmUKcXVvdGUiAQ==\n"
+						)
+						expect( io.string ).to include( "userPassword:: /wBzZWNyZXQ=\n" )
+						expect( io.string ).to end_with( "\n\n" )
+					end
+
+
+					it "escapes control characters and base64-encodes non-UTF-8 values when exporting JSON" do
+						io = StringIO.new
+						@conn.search( test_dn, :base, '(objectClass=*)', %w[description userPassword] ).
+							write_ndjson( io )
+
+						expect( io.string.lines.length ).to eq( 1 )
+						expect( io.string ).to start_with( %Q[{"dn":"#{test_dn}",] )
+						expect( io.string ).to include(
+							%Q["description":["#{description}","tab\\there\\nquote\\"\\u0001"]]
+						)
+						expect( io.string ).to include( %q["userPassword":[{"base64":"/wBzZWNyZXQ="}]] )
+						expect( io.string ).to end_with( "}\n" )
+					end
+
+				end
+
+
+				it "returns the values of binary attributes as binary Strings" do
+					password = "\xFF\x00secret".b
+					@conn.add( test_dn, objectClass: %w[top person], cn: 'write-test', sn: 'Test',
+						userPassword: password )
+
+					attrs = @conn.search( test_dn, :base ).first[1]
+					expect( attrs['userPassword'] ).to eq( [password] )
+					expect( attrs['userPassword'].first.encoding ).to eq( Encoding::ASCII_8BIT )
+					expect( attrs['sn'].first.encoding ).to eq( Encoding::UTF_8 )
+				end
+
+
+				it "can send write operations without waiting for them" do
+					result = @conn.add_async( test_dn, objectClass: %w[top organizationalRole], cn: 'write-test' )
+					expect( result ).to be_a( OpenLDAP::Result )
+					expect( result.wait ).to equal( result )
+				end
+
+
+				it "can compare a value with the values of an entry's attribute" do
+					expect( @conn.compare(TEST_BASE, :dc, 'example') ).to eq( true )
+					expect( @conn.compare(TEST_BASE, :dc, 'elsewhere') ).to eq( false )
+				end
+
+
+				it "raises an appropriate exception if a compare can't be done" do
+					expect {
+						@conn.compare( "cn=nonexistent,#{TEST_BASE}", :cn, 'nonexistent' )
+					}.to raise_error( OpenLDAP::NoSuchObject, /compare/ )
+				end
+
+
+				it "can send a batch of compares and collect their outcomes in order" do
+					outcomes = @conn.compare_many([
+						[ TEST_BASE, :dc, 'elsewhere' ],
+						[ TEST_ADMIN_ROOT_DN, :cn, 'admin' ],
+						[ TEST_BASE, :o, 'Example Organization' ],
+					])
+
+					expect( outcomes ).to eq([ false, true, true ])
+				end
+
+
+				it "raises an appropriate exception if a write fails" do
+					expect {
+						@conn.delete( "cn=nonexistent,#{TEST_BASE}" )
+					}.to raise_error( OpenLDAP::NoSuchObject, /delete/ )
+				end
+
+
+				it "rejects unknown modification operations" do
+					expect {
+						@conn.modify( test_dn, [[:frobnicate, :cn, 'x']] )
+					}.to raise_error( ArgumentError, /frobnicate/ )
+				end
+
+			end
+
+
 			it "requires a base to search" do
 				expect {
 					@conn.search
@@ -240,6 +547,105 @@ describe OpenLDAP::Connection, slapd: true, log: :debug do
 			end
 
 
+			it "doesn't block other threads while waiting for search results" do
+				result = @conn.search( TEST_BASE )
+				counter = 0
+				ticker = Thread.new { loop { counter += 1; Thread.pass } }
+
+				expect( result.fetch(5.0).count ).to eq( 2 )
+				expect( counter ).to be > 0
+
+				ticker.kill
+			end
+
+
+			it "can decode the entries in search results" do
+				message = @conn.search( TEST_BASE, :base ).fetch
+				entries = message.each_entry.to_a
+
+				expect( entries.length ).to eq( 1 )
+				expect( entries.first[0] ).to eq( TEST_BASE )
+				expect( entries.first[1] ).to include(
+					'dc' => [ 'example' ],
+					'o'  => [ 'Example Organization' ]
+				)
+			end
+
+
+			it "shares one frozen String for each attribute name and objectClass value" do
+				entries = @conn.search( TEST_BASE ).to_a
+				names = entries.map {|_, attrs| attrs.keys.find {|name| name == 'objectClass' } }
+				classes = entries.flat_map {|_, attrs| attrs['objectClass'] }
+
+				expect( names.first ).to be_frozen
+				expect( names.last ).to equal( names.first )
+				expect( classes ).to all( be_frozen )
+			end
+
+
+			it "can stream the entries of search results" do
+				dns = @conn.search( TEST_BASE ).map {|dn, _| dn }
+				expect( dns ).to contain_exactly( TEST_BASE, TEST_ADMIN_ROOT_DN )
+			end
+
+
+			it "abandons the search if streaming stops early" do
+				result = @conn.search( TEST_BASE )
+				result.each_entry {|dn, _| break }
+				expect {
+					result.fetch( 0.5 )
+				}.to raise_error( OpenLDAP::Timeout )
+			end
+
+
+			it "waits for results via the current Fiber scheduler if there is one" do
+				skip "Fiber schedulers need Ruby 3.1+" if
+					Gem::Version.new( RUBY_VERSION ) < Gem::Version.new( '3.1' )
+
+				scheduler = OpenLDAP::SpecHelpers::CountingScheduler.new
+				dns = nil
+
+				Thread.new do
+					Fiber.set_scheduler( scheduler )
+					Fiber.schedule do
+						dns = @conn.search( TEST_BASE ).map {|dn, _| dn }
+					end
+				end.join
+
+				expect( dns ).to contain_exactly( TEST_BASE, TEST_ADMIN_ROOT_DN )
+				expect( scheduler.io_waits ).to be > 0
+			end
+
+
+			it "can export search results as LDIF" do
+				io = StringIO.new
+				count = @conn.search( TEST_BASE, :base ).write_ldif( io )
+
+				expect( count ).to eq( 1 )
+				expect( io.string ).to start_with( "version: 1\n\ndn: #{TEST_BASE}\n" )
+				expect( io.string ).to include( "o: Example Organization\n" )
+				expect( io.string ).to end_with( "\n\n" )
+			end
+
+
+			it "can export search results as newline-delimited JSON" do
+				io = StringIO.new
+				count = @conn.search( TEST_BASE ).write_ndjson( io )
+
+				expect( count ).to eq( 2 )
+				lines = io.string.lines.map {|line| JSON.parse(line) }
+				expect( lines.map {|entry| entry['dn'] } ).
+					to contain_exactly( TEST_BASE, TEST_ADMIN_ROOT_DN )
+				expect( lines.find {|entry| entry['dn'] == TEST_BASE }['dc'] ).to eq( ['example'] )
+			end
+
+
+			it "transcodes search arguments that aren't already UTF-8" do
+				filter = '(o=Example Organization)'.encode( 'iso-8859-1' )
+				expect( @conn.search(TEST_BASE, :base, filter).to_a.length ).to eq( 1 )
+			end
+
+
 			it "raises an appropriate exception on an invalid filter" do
 				expect {
 					@conn.search( TEST_BASE, :subtree, "(objectClass=*" );
@@ -253,6 +659,125 @@ describe OpenLDAP::Connection, slapd: true, log: :debug do
 			end
 
 
+			it "raises an appropriate exception if a search exceeds its size limit" do
+				result = @conn.search( TEST_BASE, :subtree, '(objectClass=*)', nil, false,
+					nil, nil, nil, 1 )
+				expect {
+					result.to_a
+				}.to raise_error( OpenLDAP::SizelimitExceeded )
+			end
+
+
+			it "can page through search results" do
+				dns = @conn.search_paged( TEST_BASE, page_size: 1 ).map {|dn, _| dn }
+				expect( dns ).to contain_exactly( TEST_BASE, TEST_ADMIN_ROOT_DN )
+			end
+
+
+			it "tells the server to discard the rest of a paged search that's stopped early" do
+				expect( @conn ).to receive( :_search_page ).
+					with( 1, nil, TEST_BASE, :subtree, '(objectClass=*)', nil ).and_call_original
+				expect( @conn ).to receive( :_search_page ).
+					with( 1, an_instance_of(String), TEST_BASE, :subtree, '(objectClass=*)', nil ).
+					and_call_original
+				expect( @conn ).to receive( :_search_page ).
+					with( 0, an_instance_of(String), TEST_BASE, :subtree, '(objectClass=*)', nil ).
+					and_call_original
+
+				expect( @conn.search_paged(TEST_BASE, page_size: 1).first(2).length ).to eq( 2 )
+			end
+
+
+			it "only falls back to a paged search for searches without options" do
+				expect( @conn.search(TEST_BASE, :subtree, '(objectClass=*)', %w[cn]) ).to be_pageable
+				expect( @conn.search(TEST_BASE, :subtree, '(objectClass=*)', nil, true) ).
+					to_not be_pageable
+				expect( @conn.search(TEST_BASE, :subtree, '(objectClass=*)', nil, false,
+					nil, nil, 5) ).to_not be_pageable
+			end
+
+
+			it "falls back to a paged search if the server's size limit is exceeded" do
+				result = @conn.search( TEST_BASE )
+				allow( result ).to receive( :each_entry ) do |&block|
+					block.call( TEST_BASE, {} )
+					raise OpenLDAP::SizelimitExceeded, "search"
+				end
+
+				dns = result.map {|dn, _| dn }
+				expect( dns ).to eq([ TEST_BASE, TEST_ADMIN_ROOT_DN ])
+			end
+
+
+			it "can send a batch of searches and collect the entries in order" do
+				entries = @conn.search_many([
+					[ TEST_ADMIN_ROOT_DN, :base ],
+					[ TEST_BASE, :base ],
+					[ TEST_BASE, :subtree ],
+				])
+
+				expect( entries.map(&:length) ).to eq([ 1, 1, 2 ])
+				expect( entries[0].first.first ).to eq( TEST_ADMIN_ROOT_DN )
+				expect( entries[1].first.first ).to eq( TEST_BASE )
+			end
+
+
+			it "can yield each search in a batch as it completes" do
+				completed = []
+				@conn.search_many([
+					[ TEST_BASE, :base ],
+					[ "cn=nonexistent,#{TEST_BASE}", :base ],
+				]) do |index, entries, error|
+					completed << [ index, entries.length, error.class ]
+				end
+
+				expect( completed ).to contain_exactly(
+					[ 0, 1, NilClass ],
+					[ 1, 0, OpenLDAP::NoSuchObject ]
+				)
+			end
+
+
+			it "raises the first error from a batch of searches once it's finished" do
+				expect {
+					@conn.search_many([
+						[ TEST_BASE, :base ],
+						[ "cn=nonexistent,#{TEST_BASE}", :base ],
+					])
+				}.to raise_error( OpenLDAP::NoSuchObject )
+			end
+
+
+			it "refuses to collect a batch while another operation is outstanding" do
+				@conn.search( TEST_BASE, :base )
+				sleep 0.1 # Let its response arrive before the batch's
+
+				expect {
+					@conn.search_many([ [TEST_BASE, :base], [TEST_ADMIN_ROOT_DN, :base] ])
+				}.to raise_error( OpenLDAP::Error, /isn't part of the batch/ )
+			end
+
+
+			it "converts a Range into a Virtual List View window" do
+				expect( @conn.send(:make_vlv_window, 5000..5050) ).
+					to eq([ 0, 50, 5000, 0, nil, nil ])
+			end
+
+
+			it "converts a Hash into a Virtual List View window" do
+				window = { value: 'Smith', before: 2, after: 20, context: 'ctx' }
+				expect( @conn.send(:make_vlv_window, window) ).
+					to eq([ 2, 20, 0, 0, 'Smith', 'ctx' ])
+			end
+
+
+			it "requires a Virtual List View window to have a target" do
+				expect {
+					@conn.search_sorted( TEST_BASE, sort: 'cn', window: {after: 10} )
+				}.to raise_error( ArgumentError, /offset or a :value/i )
+			end
+
+
 			# it "handles a single attr argument when searching" do
 			# 	result = @conn.search( TEST_BASE, :subtree, '(objectClass=*)', 'cn' )
 			#   expect( result.count ).to eq( 3 )
@@ -0,0 +1,95 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/control'
+
+describe OpenLDAP::Control do
+
+	it "can be created with an OID" do
+		control = described_class.new( OpenLDAP::LDAP_CONTROL_MANAGEDSAIT )
+
+		expect( control.oid ).to eq( OpenLDAP::LDAP_CONTROL_MANAGEDSAIT )
+		expect( control.value ).to be_nil
+		expect( control ).to_not be_critical
+	end
+
+
+	it "can be created with a BER-encoded value and criticality" do
+		value = "\x30\x03\x02\x01\x05".b
+		control = described_class.new( OpenLDAP::LDAP_CONTROL_PAGEDRESULTS, value, true )
+
+		expect( control.value ).to eq( value )
+		expect( control.value.encoding ).to eq( Encoding::ASCII_8BIT )
+		expect( control ).to be_critical
+	end
+
+
+	it "can't be re-initialized" do
+		control = described_class.new( OpenLDAP::LDAP_CONTROL_MANAGEDSAIT )
+		expect {
+			control.send( :initialize, OpenLDAP::LDAP_CONTROL_RELAX )
+		}.to raise_error( OpenLDAP::Error, /re-initialize/i )
+	end
+
+
+	it "is equal to another control with the same OID, value and criticality" do
+		expect( described_class.new(OpenLDAP::LDAP_CONTROL_RELAX, nil, true) ).
+			to eq( described_class.new(OpenLDAP::LDAP_CONTROL_RELAX, nil, true) )
+		expect( described_class.new(OpenLDAP::LDAP_CONTROL_RELAX, nil, true) ).
+			to_not eq( described_class.new(OpenLDAP::LDAP_CONTROL_RELAX) )
+	end
+
+
+	it "can decode the error of a password policy response" do
+		locked = described_class.new( OpenLDAP::LDAP_CONTROL_PASSWORDPOLICYRESPONSE,
+			"\x30\x03\x81\x01\x01".b )
+		warning = described_class.new( OpenLDAP::LDAP_CONTROL_PASSWORDPOLICYRESPONSE,
+			"\x30\x05\xa0\x03\x81\x01\x02".b )
+
+		expect( locked.password_policy_error ).to eq( :account_locked )
+		expect( warning.password_policy_error ).to be_nil
+		expect( described_class.new(OpenLDAP::LDAP_CONTROL_RELAX).password_policy_error ).to be_nil
+	end
+
+
+	context "sent with a search", slapd: true do
+
+		before( :each ) do
+			@conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+			@conn.tls_require_cert = :never
+			@conn.start_tls
+		end
+
+
+		it "can be re-used for several searches" do
+			control = described_class.new( OpenLDAP::LDAP_CONTROL_MANAGEDSAIT )
+
+			2.times do
+				result = @conn.search( TEST_BASE, :base, '(objectClass=*)', nil, false, [control] )
+				expect( result.to_a.length ).to eq( 1 )
+			end
+		end
+
+
+		it "makes the server refuse the search if it's critical and unsupported" do
+			control = described_class.new( '1.3.6.1.4.1.99999.1', nil, true )
+			result = @conn.search( TEST_BASE, :base, '(objectClass=*)', nil, false, control )
+
+			expect {
+				result.to_a
+			}.to raise_error( OpenLDAP::UnavailableCriticalExtension )
+		end
+
+
+		it "can be read from the result of a search" do
+			result = @conn.search( TEST_BASE, :base )
+			result.to_a
+			expect( result.controls ).to eq( [] )
+		end
+
+	end
+
+end
+
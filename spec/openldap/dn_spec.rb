@@ -0,0 +1,141 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/dn'
+
+describe OpenLDAP::DN do
+
+	let( :dn ) { described_class.new('UID=JDoe, OU=People,DC=Example,DC=com') }
+
+
+	after( :each ) do
+		described_class.cache_size = 4096
+		described_class.clear_cache
+	end
+
+
+	it "keeps the string it was parsed from" do
+		expect( dn.to_s ).to eq( 'UID=JDoe, OU=People,DC=Example,DC=com' )
+		expect( dn ).to be_frozen
+	end
+
+
+	it "normalizes the case and spacing of the DN" do
+		expect( dn.normalized ).to eq( 'uid=jdoe,ou=people,dc=example,dc=com' )
+	end
+
+
+	it "normalizes the order of the parts of multi-valued RDNs" do
+		expect( described_class.new('sn=Doe+cn=John,dc=example').normalized ).
+			to eq( 'cn=john+sn=doe,dc=example' )
+	end
+
+
+	it "only folds the case of values of attributes that match without regard to it" do
+		principal = described_class.new( 'krbPrincipalName=JDoe@EXAMPLE.COM,DC=Example' )
+
+		expect( principal.normalized ).to eq( 'krbprincipalname=JDoe@EXAMPLE.COM,dc=example' )
+		expect( principal ).to_not eq( described_class.new('krbPrincipalName=jdoe@example.com,dc=example') )
+		expect( principal ).to eq( described_class.new('KRBPRINCIPALNAME=JDoe@EXAMPLE.COM,dc=EXAMPLE') )
+	end
+
+
+	it "provides access to its RDNs" do
+		expect( dn.size ).to eq( 4 )
+		expect( dn.rdns ).to eq( %w[UID=JDoe OU=People DC=Example DC=com] )
+		expect( dn.rdn ).to eq( 'UID=JDoe' )
+		expect( dn[:ou] ).to eq( 'People' )
+		expect( dn['dc'] ).to eq( 'Example' )
+		expect( dn['cn'] ).to be_nil
+	end
+
+
+	it "unescapes the values of its RDNs" do
+		dn = described_class.new( 'cn=Doe\, John,dc=example' )
+		expect( dn[:cn] ).to eq( 'Doe, John' )
+		expect( dn.size ).to eq( 2 )
+	end
+
+
+	it "knows its parent and ancestors" do
+		expect( dn.parent ).to eq( described_class.new('ou=people,dc=example,dc=com') )
+		expect( dn.ancestors.map(&:to_s) ).
+			to eq([ 'OU=People,DC=Example,DC=com', 'DC=Example,DC=com', 'DC=com', '' ])
+		expect( described_class.new('').parent ).to be_nil
+	end
+
+
+	it "keeps its parent once it's been asked for it" do
+		expect( dn.parent ).to equal( dn.parent )
+		expect( dn.parent.normalized ).to eq( 'ou=people,dc=example,dc=com' )
+		expect( dn.parent[:dc] ).to eq( 'Example' )
+		expect( dn.parent ).to be_frozen
+		expect( dn.ancestors.last.normalized ).to eq( '' )
+	end
+
+
+	it "knows where it is in the tree relative to other DNs" do
+		expect( dn ).to be_child_of( 'ou=people,dc=example,dc=com' )
+		expect( dn ).to_not be_child_of( 'dc=example,dc=com' )
+		expect( dn ).to be_descendant_of( 'dc=EXAMPLE, dc=COM' )
+		expect( dn ).to_not be_descendant_of( dn )
+		expect( dn ).to_not be_descendant_of( 'dc=ample,dc=com' )
+		expect( described_class.new('dc=com') ).to be_ancestor_of( dn )
+		expect( described_class.new('ou=People,dc=example,dc=com') ).to be_parent_of( dn )
+		expect( described_class.new('') ).to be_ancestor_of( dn )
+	end
+
+
+	it "is equal to and hashes like DNs with the same normalized form" do
+		other = described_class.new( 'uid=jdoe,ou=people,dc=example,dc=com' )
+
+		expect( dn ).to eq( other )
+		expect( dn ).to eql( other )
+		expect( dn.hash ).to eq( other.hash )
+		expect( { dn => :member } ).to include( other )
+		expect( dn ).to_not eq( 'uid=jdoe,ou=people,dc=example,dc=com' )
+	end
+
+
+	it "raises an appropriate exception for invalid DNs" do
+		expect {
+			described_class.new( 'not a DN' )
+		}.to raise_error( OpenLDAP::InvalidDNSyntax, /not a DN/ )
+	end
+
+
+	describe "cache" do
+
+		it "returns the same DN for a string that was parsed recently" do
+			dn = described_class.parse( 'uid=jdoe,dc=example,dc=com' )
+			expect( described_class.parse('uid=jdoe,dc=example,dc=com') ).to equal( dn )
+			expect( described_class.parse(dn) ).to equal( dn )
+			expect( described_class.normalize('UID=JDoe, DC=Example,DC=com') ).
+				to eq( 'uid=jdoe,dc=example,dc=com' )
+		end
+
+
+		it "drops the least-recently used DNs when it's full" do
+			described_class.cache_size = 2
+
+			first = described_class.parse( 'uid=first' )
+			second = described_class.parse( 'uid=second' )
+			described_class.parse( 'uid=first' )
+			described_class.parse( 'uid=third' )
+
+			expect( described_class.parse('uid=first') ).to equal( first )
+			expect( described_class.parse('uid=second') ).to_not equal( second )
+		end
+
+
+		it "can be turned off" do
+			described_class.cache_size = 0
+			expect( described_class.parse('uid=jdoe') ).to_not equal( described_class.parse('uid=jdoe') )
+		end
+
+	end
+
+end
+
@@ -0,0 +1,62 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/entry'
+
+describe OpenLDAP::Entry, :slapd do
+
+	before( :each ) do
+		@conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+		@conn.tls_require_cert = :never
+		@conn.start_tls
+		@entry = @conn.search( TEST_BASE, :base ).fetch.entries.first
+	end
+
+
+	it "knows its DN" do
+		expect( @entry.dn ).to eq( TEST_BASE )
+	end
+
+
+	it "returns the values of an attribute" do
+		expect( @entry['objectClass'] ).to contain_exactly( 'dcObject', 'organization' )
+	end
+
+
+	it "looks up attributes without regard to case" do
+		expect( @entry['OBJECTCLASS'] ).to equal( @entry['objectClass'] )
+	end
+
+
+	it "returns its attribute names as shared, frozen Strings" do
+		other = @conn.search( TEST_BASE, :base ).fetch.entries.first
+		expect( @entry.attribute_names ).to all( be_frozen )
+		expect( @entry.attribute_names.first ).to equal( other.attribute_names.first )
+	end
+
+
+	it "returns nil for an attribute it doesn't have" do
+		expect( @entry['sn'] ).to be_nil
+	end
+
+
+	it "knows the names of its attributes" do
+		expect( @entry.attribute_names.map(&:downcase) ).to include( 'objectclass', 'o', 'dc' )
+	end
+
+
+	it "can be converted to a Hash" do
+		expect( @entry.to_h ).to include( 'dc' => ['example'] )
+	end
+
+
+	it "keeps its message alive after it's been dropped" do
+		entries = @conn.search( TEST_BASE, :base ).fetch.entries
+		GC.start
+		expect( entries.first['dc'] ).to eq( ['example'] )
+	end
+
+end
+
@@ -0,0 +1,184 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/filter'
+
+describe OpenLDAP::Filter do
+
+	describe "escaping" do
+
+		it "escapes the characters that are special in filter values" do
+			expect( described_class.escape('Smith (ret*) \\o/') ).
+				to eq( 'Smith \\28ret\\2a\\29 \\5co/' )
+			expect( described_class.escape("a\0b") ).to eq( 'a\\00b' )
+		end
+
+
+		it "leaves values without special characters alone" do
+			value = 'an ordinary value with no special characters in it, ünïcödé too'
+			expect( described_class.escape(value) ).to eq( value )
+		end
+
+
+		it "escapes the non-ASCII bytes of binary values" do
+			value = "\x01\xFF(".b
+			expect( described_class.escape(value) ).to eq( "\x01\\ff\\28" )
+		end
+
+
+		it "also escapes placeholder characters when escaping literals" do
+			expect( described_class.escape('who? {me}') ).to eq( 'who? {me}' )
+			expect( described_class.escape_literal('who? {me}') ).to eq( 'who\\3f \\7bme\\7d' )
+		end
+
+	end
+
+
+	describe "templates" do
+
+		it "can be created from a template without placeholders" do
+			filter = described_class.new( '(&(objectClass=person)(uid=jdoe))' )
+			expect( filter.placeholders ).to be_empty
+			expect( filter.to_s ).to eq( '(&(objectClass=person)(uid=jdoe))' )
+			expect( filter.to_str ).to eq( filter.to_s )
+		end
+
+
+		it "binds values to positional placeholders in order" do
+			filter = described_class.new( '(&(uid=?)(uidNumber>=?))' )
+			expect( filter.placeholders ).to eq( [nil, nil] )
+			expect( filter.bind('j*', 1000) ).to eq( '(&(uid=j\\2a)(uidNumber>=1000))' )
+		end
+
+
+		it "binds values to named placeholders from a Hash" do
+			filter = described_class.new( '(&(uid=?)(|(ou={ou})(department={ou})))' )
+			expect( filter.placeholders ).to eq( [nil, :ou, :ou] )
+			expect( filter.bind('jdoe', ou: 'R&D (East)') ).
+				to eq( '(&(uid=jdoe)(|(ou=R&D \\28East\\29)(department=R&D \\28East\\29)))' )
+		end
+
+
+		it "binds booleans and Times as LDAP strings" do
+			filter = described_class.new( '(&(flag=?)(createTimestamp>=?))' )
+			time = Time.new( 2024, 1, 2, 3, 4, 5, '+02:00' )
+			expect( filter.bind(true, time) ).to eq( '(&(flag=TRUE)(createTimestamp>=20240102010405Z))' )
+		end
+
+
+		it "refuses to bind the wrong number of values" do
+			filter = described_class.new( '(uid=?)' )
+			expect { filter.bind }.to raise_error( ArgumentError, /wrong number/i )
+			expect { filter.bind('a', 'b') }.to raise_error( ArgumentError, /wrong number/i )
+		end
+
+
+		it "refuses to bind nil or leave out a named value" do
+			expect {
+				described_class.new( '(uid=?)' ).bind( nil )
+			}.to raise_error( ArgumentError, /nil/ )
+			expect {
+				described_class.new( '(uid={uid})' ).bind( ou: 'People' )
+			}.to raise_error( ArgumentError, /uid/ )
+		end
+
+
+		it "leaves braces that don't enclose a placeholder name alone" do
+			filter = described_class.new( '(&(description={na me})(cn=}{)(ou={))' )
+			expect( filter.placeholders ).to be_empty
+			expect( filter.to_s ).to eq( '(&(description={na me})(cn=}{)(ou={))' )
+		end
+
+
+		it "can be created from a filter string with raw placeholder characters in its values" do
+			filter = described_class.literal( '(&(cn=who?)(description={me}))' )
+			expect( filter.placeholders ).to be_empty
+			expect( filter.to_s ).to eq( '(&(cn=who\\3f)(description=\\7bme\\7d))' )
+		end
+
+
+		it "can't be converted to a String while it has placeholders" do
+			expect {
+				described_class.new( '(uid=?)' ).to_s
+			}.to raise_error( ArgumentError, /placeholders/i )
+		end
+
+
+		it "rejects malformed templates" do
+			expect { described_class.new('') }.to raise_error( ArgumentError, /empty/i )
+			expect { described_class.new('(uid=jdoe') }.to raise_error( ArgumentError, /parentheses/i )
+			expect { described_class.new('(uid=jdoe))') }.to raise_error( ArgumentError, /parentheses/i )
+			expect { described_class.new('(uid=\\zz)') }.to raise_error( ArgumentError, /escape/i )
+		end
+
+	end
+
+
+	describe "builders" do
+
+		let( :f ) { described_class }
+
+
+		it "build filters with escaped literal values" do
+			filter = f.and( f.eq(:objectClass, 'person'), f.ge(:uidNumber, 1000),
+				f.not(f.present(:mail)), f.approx('sn', 'sm?th') )
+			expect( filter.to_s ).
+				to eq( '(&(objectClass=person)(uidNumber>=1000)(!(mail=*))(sn~=sm\\3fth))' )
+		end
+
+
+		it "build filters with placeholders" do
+			filter = f.or( f.eq(:uid, f[:login]), f.eq(:mail, f[:login]), f.le(:uidNumber, f[]) )
+			expect( filter.template ).to eq( '(|(uid={login})(mail={login})(uidNumber<=?))' )
+			expect( filter.bind(500, login: 'jdoe*') ).
+				to eq( '(|(uid=jdoe\\2a)(mail=jdoe\\2a)(uidNumber<=500))' )
+		end
+
+
+		it "build substring filters" do
+			expect( f.substring(:cn, 'J', ['o*h'], 'n').to_s ).to eq( '(cn=J*o\\2ah*n)' )
+			expect( f.substring(:cn, nil, [], f[:suffix]).bind(suffix: 'son') ).to eq( '(cn=*son)' )
+			expect { f.substring(:cn) }.to raise_error( ArgumentError, /substring/ )
+		end
+
+
+		it "can combine filters with filter strings" do
+			expect( f.and('(objectClass=person)', f.eq('cn;lang-en', 'x')).to_s ).
+				to eq( '(&(objectClass=person)(cn;lang-en=x))' )
+			expect { f.and('(objectClass=person') }.to raise_error( ArgumentError, /parentheses/i )
+		end
+
+
+		it "treat filter strings as literal filters" do
+			expect( f.or('(cn=who?)', f.eq(:uid, f[])).bind('me') ).to eq( '(|(cn=who\\3f)(uid=me))' )
+			expect( f.not('(description={me})').to_s ).to eq( '(!(description=\\7bme\\7d))' )
+		end
+
+
+		it "refuse invalid attribute descriptions" do
+			expect { f.eq('cn=*)(uid', 'x') }.to raise_error( ArgumentError, /attribute description/ )
+		end
+
+	end
+
+
+	describe "used to search", slapd: true do
+
+		it "can be passed to Connection#search once its values are bound" do
+			conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+			conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+			filter = described_class.eq( :objectClass, '*' )
+
+			expect( conn.search(TEST_BASE, :base, filter).to_a ).to be_empty
+			expect( conn.search(TEST_BASE, :base, described_class.present(:objectClass)).to_a.map(&:first) ).
+				to contain_exactly( TEST_BASE )
+			expect( conn.search(TEST_BASE, :base, described_class.literal('(objectClass=?)')).to_a ).
+				to be_empty
+		end
+
+	end
+
+end
+
@@ -0,0 +1,165 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'stringio'
+require 'openldap/ldif'
+
+describe OpenLDAP::LDIF do
+
+	def records_from( source )
+		return described_class.new( StringIO.new(source) ).to_a
+	end
+
+
+	it "reads add records, grouping the values of each attribute" do
+		records = records_from( <<~END_LDIF )
+			version: 1
+
+			# A comment
+			dn: cn=test,dc=example,dc=com
+			objectClass: top
+			objectClass: organizationalRole
+			cn: test
+		END_LDIF
+
+		expect( records ).to eq([
+			[ :add, 'cn=test,dc=example,dc=com',
+			  {'objectClass' => %w[top organizationalRole], 'cn' => ['test']} ]
+		])
+	end
+
+
+	it "unfolds continued lines and decodes base64 values" do
+		records = records_from( <<~END_LDIF )
+			dn: cn=folded,dc=exam
+			 ple,dc=com
+			description:: w6lsw6hu
+			jpegPhoto:: AAH/
+		END_LDIF
+
+		dn, data = records.first[ 1..2 ]
+		expect( dn ).to eq( 'cn=folded,dc=example,dc=com' )
+		expect( data['description'] ).to eq( ["élèn"] )
+		expect( data['jpegPhoto'].first ).to eq( "\x00\x01\xFF".b )
+		expect( data['jpegPhoto'].first.encoding ).to eq( Encoding::ASCII_8BIT )
+	end
+
+
+	it "reads modify, delete, and modrdn records" do
+		records = records_from( <<~END_LDIF )
+			dn: cn=test,dc=example,dc=com
+			changetype: modify
+			replace: description
+			description: new
+			-
+			delete: seeAlso
+			-
+
+			dn: cn=gone,dc=example,dc=com
+			changetype: delete
+
+			dn: cn=old,dc=example,dc=com
+			changetype: modrdn
+			newrdn: cn=new
+			deleteoldrdn: 0
+		END_LDIF
+
+		expect( records ).to eq([
+			[ :modify, 'cn=test,dc=example,dc=com',
+			  [[:replace, 'description', ['new']], [:delete, 'seeAlso', []]] ],
+			[ :delete, 'cn=gone,dc=example,dc=com', nil ],
+			[ :modrdn, 'cn=old,dc=example,dc=com',
+			  {newrdn: 'cn=new', delete_old_rdn: false, newsuperior: nil} ],
+		])
+	end
+
+
+	it "reads records that span several reads of the IO" do
+		source = (1..5000).map {|i| "dn: cn=user#{i},dc=example,dc=com\ncn: user#{i}\n" }.join( "\n" )
+		ldif = described_class.new( StringIO.new(source) )
+
+		expect( ldif.count ).to eq( 5000 )
+		expect( ldif.lineno ).to eq( 14999 )
+	end
+
+
+	it "raises a ParseError with the line number of a malformed record" do
+		expect {
+			records_from( "dn: cn=ok,dc=example,dc=com\ncn: ok\n\nnot a record\n" )
+		}.to raise_error( OpenLDAP::LDIF::ParseError, /line 4/ )
+	end
+
+
+	it "can't be created for an object that can't be read" do
+		expect {
+			described_class.new( :nope )
+		}.to raise_error( TypeError, /can't read/i )
+	end
+
+
+	context "loaded into a directory", slapd: true do
+
+		let( :dns ) { (1..3).map {|i| "cn=ldif-test-#{i},#{TEST_BASE}" } }
+
+		before( :each ) do
+			@conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+			@conn.tls_require_cert = :never
+			@conn.start_tls
+			@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+		end
+
+		after( :each ) do
+			dns.each do |dn|
+				begin
+					@conn.delete( dn )
+				rescue OpenLDAP::NoSuchObject
+				end
+			end
+		end
+
+
+		it "sends each record as a write operation" do
+			source = dns.map do |dn|
+				"dn: #{dn}\nobjectClass: organizationalRole\ncn: #{dn[/cn=([^,]+)/, 1]}\n"
+			end.join( "\n" )
+
+			stats = @conn.load_ldif( StringIO.new(source), window: 2 )
+
+			expect( stats ).to include( records: 3, succeeded: 3, failed: 0, errors: [] )
+			expect( @conn.search(TEST_BASE, :one, '(cn=ldif-test-*)').to_a.length ).to eq( 3 )
+		end
+
+
+		it "reports records that fail without stopping" do
+			source = "dn: #{dns.first}\nchangetype: delete\n\n" +
+				"dn: #{dns.last}\nobjectClass: organizationalRole\ncn: ldif-test-3\n"
+			failures = []
+
+			stats = @conn.load_ldif( StringIO.new(source) ) do |dn, error, lineno|
+				failures << [ dn, error.class, lineno ]
+			end
+
+			expect( stats ).to include( records: 2, succeeded: 1, failed: 1 )
+			expect( failures ).to eq([ [dns.first, OpenLDAP::NoSuchObject, 1] ])
+		end
+
+
+		it "fails records with critical controls, since it can't send them" do
+			source = "dn: #{dns[0]}\ncontrol: 1.2.840.113556.1.4.805 true\n" +
+				"objectClass: organizationalRole\ncn: ldif-test-1\n\n" +
+				"dn: #{dns[1]}\ncontrol: 1.2.840.113556.1.4.805 false\n" +
+				"objectClass: organizationalRole\ncn: ldif-test-2\n"
+
+			stats = @conn.load_ldif( StringIO.new(source) )
+
+			expect( stats ).to include( records: 2, succeeded: 1, failed: 1 )
+			expect( stats[:errors].map {|dn, error, _| [dn, error.class] } ).
+				to eq([ [dns[0], OpenLDAP::UnavailableCriticalExtension] ])
+		end
+
+	end
+
+end
+
@@ -3,6 +3,7 @@
 require_relative '../helpers'
 
 require 'rspec'
+require 'objspace'
 require 'openldap/message'
 
 describe OpenLDAP::Message, :slapd do
@@ -17,5 +18,18 @@ describe OpenLDAP::Message, :slapd do
 		result = OpenLDAP::Result.new( @ldap, @msgid )
 	end
 
+
+	it "can't be instantiated directly" do
+		expect { OpenLDAP::Message.new }.to raise_error( TypeError, /allocator undefined/i )
+	end
+
+
+	it "includes the size of its BER data in its reported memory size" do
+		conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+		message = conn.search( TEST_BASE, :base ).fetch
+
+		expect( ObjectSpace.memsize_of(message) ).to be > TEST_BASE.bytesize
+	end
+
 end
 
@@ -0,0 +1,126 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/schema'
+
+describe OpenLDAP::Schema do
+
+	let( :attribute_types ) {[
+		"( 2.5.4.41 NAME 'name' EQUALITY caseIgnoreMatch " +
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.15{32768} )",
+		"( 2.5.4.3 NAME ( 'cn' 'commonName' ) DESC 'common name(s)' SUP name )",
+		"( 1.3.6.1.1.1.1.0 NAME 'uidNumber' EQUALITY integerMatch " +
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 SINGLE-VALUE )",
+		"( 2.5.18.1 NAME 'createTimestamp' EQUALITY generalizedTimeMatch " +
+			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.24 SINGLE-VALUE NO-USER-MODIFICATION " +
+			"USAGE directoryOperation )",
+		"( 1.3.6.1.4.1.99999.1 NAME 'exampleFlag' SYNTAX 1.3.6.1.4.1.1466.115.121.1.7 )",
+		"( 2.5.4.35 NAME 'userPassword' SYNTAX 1.3.6.1.4.1.1466.115.121.1.40{128} )",
+	]}
+
+	let( :schema ) { described_class.new(attribute_types) }
+
+
+	it "knows the syntaxes of its attribute types, including inherited ones" do
+		expect( schema.size ).to eq( 6 )
+		expect( schema.syntax('uidNumber') ).to eq( '1.3.6.1.4.1.1466.115.121.1.27' )
+		expect( schema.syntax('commonName') ).to eq( '1.3.6.1.4.1.1466.115.121.1.15' )
+		expect( schema.syntax('2.5.4.3') ).to eq( '1.3.6.1.4.1.1466.115.121.1.15' )
+		expect( schema.syntax('nonexistent') ).to be_nil
+	end
+
+
+	it "looks up attribute types without regard to case or options" do
+		expect( schema.value_type('UIDNUMBER') ).to eq( :integer )
+		expect( schema.value_type('cn;lang-en') ).to eq( :string )
+		expect( schema.value_type('createTimestamp') ).to eq( :time )
+		expect( schema.value_type('exampleFlag') ).to eq( :boolean )
+		expect( schema.value_type('userPassword') ).to eq( :binary )
+		expect( schema.value_type('nonexistent') ).to be_nil
+	end
+
+
+	it "decodes values according to their syntaxes" do
+		expect( schema.decode('uidNumber', '1000') ).to eq( 1000 )
+		expect( schema.decode('uidNumber', '-123456789012345678901') ).to eq( -123456789012345678901 )
+		expect( schema.decode('exampleFlag', 'TRUE') ).to equal( true )
+		expect( schema.decode('exampleFlag', 'FALSE') ).to equal( false )
+		expect( schema.decode('createTimestamp', '20240102030405.25Z') ).
+			to eq( Time.utc(2024, 1, 2, 3, 4, 5.25) )
+		expect( schema.decode('createTimestamp', '20240102030405-0500') ).
+			to eq( Time.utc(2024, 1, 2, 8, 4, 5) )
+		expect( schema.decode('userPassword', 'secret').encoding ).to eq( Encoding::ASCII_8BIT )
+		expect( schema.decode('cn', 'Jane') ).to eq( 'Jane' )
+	end
+
+
+	it "returns values that aren't valid for their syntax as Strings" do
+		expect( schema.decode('uidNumber', 'lots') ).to eq( 'lots' )
+		expect( schema.decode('createTimestamp', '20241340') ).to eq( '20241340' )
+		expect( schema.decode('exampleFlag', 'yes') ).to eq( 'yes' )
+	end
+
+
+	it "skips attribute types it can't parse" do
+		schema = described_class.new( attribute_types + ['not an attribute type'] )
+		expect( schema.size ).to eq( 6 )
+	end
+
+
+	context "fetched from a server", slapd: true do
+
+		before( :each ) do
+			described_class.clear_cache
+			@conn = OpenLDAP::Connection.new( TEST_LDAP_URI )
+			@conn.tls_require_cert = :never
+			@conn.start_tls
+			@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+		end
+
+
+		it "is only fetched once per server unless it's refreshed" do
+			schema = @conn.schema
+			expect( schema.value_type('createTimestamp') ).to eq( :time )
+			expect( OpenLDAP::Connection.new(TEST_LDAP_URI).schema ).to equal( schema )
+			expect( @conn.schema(true) ).to_not equal( schema )
+		end
+
+
+		it "switches connections decoding values to a schema that's been refreshed" do
+			@conn.typed_values = true
+			stale = @conn.decode_schema
+
+			schema = OpenLDAP::Connection.new( TEST_LDAP_URI ).schema( true )
+			expect( stale ).to be_stale
+			@conn.search( TEST_BASE, :base ).to_a
+			expect( @conn.decode_schema ).to equal( schema )
+
+			described_class.clear_cache
+			expect( schema ).to be_stale
+			_, attrs = @conn.search( TEST_BASE, :base, '(objectClass=*)', %w[createTimestamp] ).first
+			expect( attrs['createTimestamp'].first ).to be_a( Time )
+			expect( @conn.decode_schema ).to_not be_stale
+			expect( described_class.cache.values ).to include( @conn.decode_schema )
+		end
+
+
+		it "decodes the values of entries when a connection asks for typed values" do
+			@conn.typed_values = true
+			_, attrs = @conn.search( TEST_BASE, :base, '(objectClass=*)',
+				%w[dc createTimestamp] ).first
+
+			expect( @conn ).to be_typed_values
+			expect( attrs['createTimestamp'].first ).to be_a( Time )
+			expect( attrs['dc'] ).to eq( ['example'] )
+
+			@conn.typed_values = false
+			_, attrs = @conn.search( TEST_BASE, :base, '(objectClass=*)', %w[createTimestamp] ).first
+			expect( attrs['createTimestamp'].first ).to be_a( String )
+		end
+
+	end
+
+end
+
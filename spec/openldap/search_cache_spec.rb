@@ -0,0 +1,84 @@
+#!/usr/bin/env rspec -cfd -b
+
+require_relative '../helpers'
+
+require 'rspec'
+require 'openldap/search_cache'
+
+describe OpenLDAP::SearchCache, slapd: true do
+
+	before( :each ) do
+		@cache = described_class.new( ttl: 60, negative_ttl: 60, size: 2 )
+		@conn = OpenLDAP::Connection.new( TEST_LDAP_URI, search_cache: @cache )
+		@conn.bind( TEST_ADMIN_ROOT_DN, TEST_ADMIN_PASSWORD )
+	end
+
+	after( :each ) do
+		@conn.unbind
+	end
+
+
+	it "returns the entries of a repeated search without searching again" do
+		expect( @conn ).to receive( :search ).once.and_call_original
+
+		first = @conn.cached_search( TEST_BASE, :base, '(objectClass=*)', %w[dc objectClass] )
+		second = @conn.cached_search( TEST_BASE.upcase, :base, '(objectClass=*)', %w[objectClass dc] )
+
+		expect( second ).to eq( first )
+		expect( second.first.first ).to eq( TEST_BASE )
+		expect( @cache.stats ).to include( hits: 1, misses: 1, size: 1 )
+	end
+
+
+	it "returns entries that can be changed without changing the cached ones" do
+		@conn.cached_search( TEST_BASE, :base ).first[1].clear
+		expect( @conn.cached_search(TEST_BASE, :base).first[1] ).to_not be_empty
+	end
+
+
+	it "caches searches separately for each bind DN" do
+		@conn.cached_search( TEST_BASE, :base )
+		@conn.bind
+
+		expect( @conn ).to receive( :search ).once.and_call_original
+		@conn.cached_search( TEST_BASE, :base )
+	end
+
+
+	it "caches searches that found nothing" do
+		expect( @conn ).to receive( :search ).twice.and_call_original
+
+		2.times do
+			expect( @conn.cached_search(TEST_BASE, :base, '(objectClass=nonexistent)') ).to be_empty
+			expect {
+				@conn.cached_search( "cn=nonexistent,#{TEST_BASE}", :base )
+			}.to raise_error( OpenLDAP::NoSuchObject )
+		end
+	end
+
+
+	it "drops the least-recently used searches when it's full" do
+		3.times {|i| @conn.cached_search(TEST_BASE, :base, "(objectClass=#{i})") }
+		expect( @cache.stats ).to include( size: 2, evictions: 1 )
+	end
+
+
+	it "expires searches after their TTL" do
+		cache = described_class.new( ttl: 0.01 )
+		cache.search( @conn, TEST_BASE, :base )
+		sleep 0.02
+
+		expect( @conn ).to receive( :search ).once.and_call_original
+		cache.search( @conn, TEST_BASE, :base )
+		expect( cache.stats ).to include( hits: 0, misses: 2, expirations: 1 )
+	end
+
+
+	it "can be cleared" do
+		@conn.cached_search( TEST_BASE, :base )
+		@cache.clear
+		expect( @cache.stats[:size] ).to eq( 0 )
+	end
+
+end
+
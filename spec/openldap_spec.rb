@@ -57,6 +57,40 @@ describe OpenLDAP do
 		                                  :vendor_name, :vendor_version )
 	end
 
+	it "doesn't call its logger for messages below the logger's level" do
+		OpenLDAP.logger.level = :info
+		expect( OpenLDAP.logger ).to_not receive( :debug )
+
+		OpenLDAP.split_url( 'ldap://ldap.acme.com/dc=acme,dc=com' )
+	end
+
+	it "keeps the extension's cached log level in sync with its logger" do
+		OpenLDAP.logger.level = :warn
+		expect( OpenLDAP.cache_log_level ).to eq( :warn )
+	end
+
+	it "knows which attributes have binary values" do
+		expect( OpenLDAP.binary_attribute?('jpegPhoto') ).to be_truthy
+		expect( OpenLDAP.binary_attribute?('USERCERTIFICATE') ).to be_truthy
+		expect( OpenLDAP.binary_attribute?('cn;binary') ).to be_truthy
+		expect( OpenLDAP.binary_attribute?('cn;lang-en') ).to be_falsey
+		expect( OpenLDAP.binary_attribute?('jpeg') ).to be_falsey
+		expect( OpenLDAP.binary_attribute?(:cn) ).to be_falsey
+	end
+
+	it "has a list of attributes whose values are interned" do
+		original = OpenLDAP.interned_attributes
+		expect( original ).to include( 'objectClass' )
+
+		begin
+			OpenLDAP.interned_attributes = [ :employeeType, 'objectClass' ]
+			expect( OpenLDAP.interned_attributes ).to eq( %w[employeeType objectClass] )
+			expect( OpenLDAP.interned_attributes ).to be_frozen
+		ensure
+			OpenLDAP.interned_attributes = original
+		end
+	end
+
 	it "has a hash of extension versions for the library it's linked against" do
 		expect( OpenLDAP.api_feature_info ).to be_a( Hash )
 		expect( OpenLDAP.api_feature_info ).to include( *OpenLDAP.api_info[:extensions] )